@@ -0,0 +1,511 @@
+#include "tiny_vfs.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = tinyvfs::fs;
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Config
+    {
+        size_t small_files = 4000;
+        size_t small_size = 2048;
+        size_t huge_files = 3;
+        size_t huge_size = 64u << 20;
+        size_t overlay_mounts = 16;
+        size_t wide_files = 20000;
+        size_t iterations = 20000;
+        std::string filter;
+    };
+
+    struct Stats
+    {
+        std::vector<double> samples;
+        double seconds = 0;
+        std::uint64_t bytes = 0;
+    };
+
+    double percentile(std::vector<double>& sorted, double p)
+    {
+        if (sorted.empty())
+            return 0;
+        size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+        return sorted[std::min(index, sorted.size() - 1)];
+    }
+
+    void report(const std::string& name, Stats stats)
+    {
+        std::sort(stats.samples.begin(), stats.samples.end());
+        const double count = static_cast<double>(stats.samples.size());
+        char line[256];
+        if (stats.bytes > 0)
+        {
+            std::snprintf(line, sizeof(line), "%-34s %9zu %12.1f MB/s %10.2f %10.2f %10.2f %10.2f",
+                name.c_str(), stats.samples.size(),
+                static_cast<double>(stats.bytes) / (1024.0 * 1024.0) / stats.seconds,
+                percentile(stats.samples, 0.50), percentile(stats.samples, 0.90),
+                percentile(stats.samples, 0.99), stats.samples.empty() ? 0.0 : stats.samples.back());
+        }
+        else
+        {
+            std::snprintf(line, sizeof(line), "%-34s %9zu %12.0f op/s  %10.2f %10.2f %10.2f %10.2f",
+                name.c_str(), stats.samples.size(), count / stats.seconds,
+                percentile(stats.samples, 0.50), percentile(stats.samples, 0.90),
+                percentile(stats.samples, 0.99), stats.samples.empty() ? 0.0 : stats.samples.back());
+        }
+        std::cout << line << "\n";
+    }
+
+    bool selected(const Config& config, const std::string& name)
+    {
+        return config.filter.empty() || name.find(config.filter) != std::string::npos;
+    }
+
+    // Times `op(i)` per call; `op` returns the number of bytes it moved (0 for lookups).
+    void run(const Config& config, const std::string& name, size_t iterations,
+        const std::function<std::uint64_t(size_t)>& op)
+    {
+        if (!selected(config, name) || iterations == 0)
+            return;
+
+        Stats stats;
+        stats.samples.reserve(iterations);
+        auto start = Clock::now();
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            auto before = Clock::now();
+            stats.bytes += op(i);
+            auto after = Clock::now();
+            stats.samples.push_back(std::chrono::duration<double, std::micro>(after - before).count());
+        }
+        stats.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        report(name, std::move(stats));
+    }
+
+    bool write_file(const fs::path& path, size_t size, std::mt19937& rng)
+    {
+        std::error_code ec;
+        fs::create_directories(path.parent_path(), ec);
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        std::vector<char> data(std::min<size_t>(size, 1u << 20));
+        // Mildly compressible text-like bytes.
+        for (char& c : data)
+            c = static_cast<char>('a' + rng() % 16);
+        for (size_t left = size; left > 0;)
+        {
+            size_t count = std::min(left, data.size());
+            out.write(data.data(), static_cast<std::streamsize>(count));
+            left -= count;
+        }
+        return out.good();
+    }
+
+    // Drops the files' pages from the OS cache where that is possible without root, so
+    // the next pass measures storage rather than memory.
+    void evict_os_cache(const fs::path& root)
+    {
+#if defined(_WIN32)
+        (void)root;
+#else
+        std::error_code ec;
+        for (fs::recursive_directory_iterator it(root, ec), end; it != end; it.increment(ec))
+        {
+            if (ec || !it->is_regular_file(ec))
+                continue;
+            int fd = ::open(it->path().c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                continue;
+#if defined(POSIX_FADV_DONTNEED)
+            ::fdatasync(fd);
+            ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+            ::close(fd);
+        }
+#endif
+    }
+
+    std::string small_name(size_t i)
+    {
+        return "dir" + std::to_string(i % 40) + "/file" + std::to_string(i) + ".bin";
+    }
+
+    void print_usage()
+    {
+        std::cout << "usage: tiny_vfs_bench [--quick] [--filter text] [--root dir] [--keep]\n"
+                     "  --quick    small trees and few iterations (smoke run)\n"
+                     "  --filter   only run benchmarks whose name contains text\n"
+                     "  --root     directory for the generated trees (default: temp dir)\n"
+                     "  --keep     keep the generated trees\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Config config;
+    fs::path root = fs::temp_directory_path() / "tiny_vfs_bench";
+    bool keep = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view arg = argv[i];
+        if (arg == "--quick")
+        {
+            config.small_files = 400;
+            config.huge_files = 1;
+            config.huge_size = 4u << 20;
+            config.overlay_mounts = 8;
+            config.wide_files = 2000;
+            config.iterations = 2000;
+        }
+        else if (arg == "--filter" && i + 1 < argc)
+        {
+            config.filter = argv[++i];
+        }
+        else if (arg == "--root" && i + 1 < argc)
+        {
+            root = argv[++i];
+        }
+        else if (arg == "--keep")
+        {
+            keep = true;
+        }
+        else
+        {
+            print_usage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    std::error_code ec;
+    fs::remove_all(root, ec);
+    std::mt19937 rng(12345);
+
+    std::cout << "generating trees in " << root.string() << "\n";
+    const fs::path small = root / "small";
+    const fs::path huge = root / "huge";
+    const fs::path wide = root / "wide";
+    for (size_t i = 0; i < config.small_files; ++i)
+        write_file(small / small_name(i), config.small_size, rng);
+    for (size_t i = 0; i < config.huge_files; ++i)
+        write_file(huge / ("huge" + std::to_string(i) + ".bin"), config.huge_size, rng);
+    for (size_t i = 0; i < config.wide_files; ++i)
+        write_file(wide / ("tex" + std::to_string(i) + (i % 2 ? ".dds" : ".png")), 64, rng);
+    // Each overlay layer holds a slice of the small tree; the bottom layer holds all of it.
+    for (size_t layer = 1; layer < config.overlay_mounts; ++layer)
+    {
+        for (size_t i = layer; i < config.small_files; i += config.overlay_mounts * 4)
+            write_file(root / ("layer" + std::to_string(layer)) / small_name(i), config.small_size, rng);
+    }
+
+    std::vector<std::string> small_paths;
+    std::vector<std::string> missing_paths;
+    for (size_t i = 0; i < config.small_files; ++i)
+    {
+        small_paths.push_back("assets/" + small_name(i));
+        missing_paths.push_back("assets/" + small_name(i) + ".meta");
+    }
+    std::shuffle(small_paths.begin(), small_paths.end(), rng);
+
+    tinyvfs::Vfs flat;
+    flat.mount_disk("assets", small);
+    flat.mount_disk("huge", huge);
+    flat.mount_disk("wide", wide);
+
+    tinyvfs::Vfs stacked;
+    stacked.mount_disk("assets", small);
+    for (size_t layer = 1; layer < config.overlay_mounts; ++layer)
+        stacked.mount_disk("assets", root / ("layer" + std::to_string(layer)));
+
+    const size_t n = config.iterations;
+    const size_t files = small_paths.size();
+    char line[256];
+    std::snprintf(line, sizeof(line), "%-34s %9s %17s %10s %10s %10s %10s", "benchmark", "ops", "throughput",
+        "p50 us", "p90 us", "p99 us", "max us");
+    std::cout << line << "\n";
+
+    {
+        const std::vector<std::string> inputs = {
+            "assets/textures/albedo.dds",
+            "assets\\textures\\albedo.dds",
+            "/assets/./textures/../textures/albedo.dds",
+            "assets//levels/forest/chunk_0042/props/../terrain/heightmap.r16",
+        };
+        std::string out;
+        for (size_t k = 0; k < inputs.size(); ++k)
+        {
+            run(config, "normalize/" + std::string(k == 0 ? "canonical" : k == 1 ? "backslash" : k == 2 ? "dots" : "long"),
+                n * 5, [&](size_t)
+                {
+                    tinyvfs::detail::normalize_virtual_path(inputs[k], out);
+                    return std::uint64_t{0};
+                });
+        }
+    }
+
+    evict_os_cache(root);
+    run(config, "read_file/small/cold", files, [&](size_t i)
+    {
+        auto blob = flat.read_file(small_paths[i]);
+        return blob ? static_cast<std::uint64_t>(blob->size()) : 0;
+    });
+    run(config, "read_file/small/warm", n, [&](size_t i)
+    {
+        auto blob = flat.read_file(small_paths[i % files]);
+        return blob ? static_cast<std::uint64_t>(blob->size()) : 0;
+    });
+
+    evict_os_cache(huge);
+    run(config, "read_file/huge/cold", config.huge_files, [&](size_t i)
+    {
+        auto blob = flat.read_file("huge/huge" + std::to_string(i) + ".bin");
+        return blob ? static_cast<std::uint64_t>(blob->size()) : 0;
+    });
+    run(config, "read_file/huge/warm", config.huge_files * 4, [&](size_t i)
+    {
+        auto blob = flat.read_file("huge/huge" + std::to_string(i % config.huge_files) + ".bin");
+        return blob ? static_cast<std::uint64_t>(blob->size()) : 0;
+    });
+    run(config, "map_file/huge/touch", config.huge_files * 4, [&](size_t i)
+    {
+        auto view = flat.map_file("huge/huge" + std::to_string(i % config.huge_files) + ".bin");
+        if (!view)
+            return std::uint64_t{0};
+        volatile std::uint8_t sink = 0;
+        for (size_t offset = 0; offset < view->size(); offset += 4096)
+            sink = sink + static_cast<std::uint8_t>(view->data()[offset]);
+        return static_cast<std::uint64_t>(view->size());
+    });
+
+    run(config, "exists_file/hit/flat", n, [&](size_t i)
+    {
+        flat.exists_file(small_paths[i % files]);
+        return std::uint64_t{0};
+    });
+    run(config, "exists_file/miss/flat", n, [&](size_t i)
+    {
+        flat.exists_file(missing_paths[i % files]);
+        return std::uint64_t{0};
+    });
+    run(config, "exists_file/hit/overlay" + std::to_string(config.overlay_mounts), n, [&](size_t i)
+    {
+        stacked.exists_file(small_paths[i % files]);
+        return std::uint64_t{0};
+    });
+    run(config, "exists_file/miss/overlay" + std::to_string(config.overlay_mounts), n, [&](size_t i)
+    {
+        stacked.exists_file(missing_paths[i % files]);
+        return std::uint64_t{0};
+    });
+    stacked.set_miss_cache(true);
+    run(config, "exists_file/miss/overlay" + std::to_string(config.overlay_mounts) + "/cached", n, [&](size_t i)
+    {
+        stacked.exists_file(missing_paths[i % files]);
+        return std::uint64_t{0};
+    });
+    stacked.set_miss_cache(false);
+    run(config, "stat/overlay" + std::to_string(config.overlay_mounts), n, [&](size_t i)
+    {
+        stacked.stat(small_paths[i % files]);
+        return std::uint64_t{0};
+    });
+    run(config, "read_file/overlay" + std::to_string(config.overlay_mounts), n, [&](size_t i)
+    {
+        auto blob = stacked.read_file(small_paths[i % files]);
+        return blob ? static_cast<std::uint64_t>(blob->size()) : 0;
+    });
+
+    if (selected(config, "indexed"))
+    {
+        auto start = Clock::now();
+        stacked.build_index();
+        std::snprintf(line, sizeof(line), "%-34s %9d %12.2f ms", "build_index/overlay", 1,
+            std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        std::cout << line << "\n";
+        run(config, "indexed/exists_file/hit", n, [&](size_t i)
+        {
+            stacked.exists_file(small_paths[i % files]);
+            return std::uint64_t{0};
+        });
+        run(config, "indexed/exists_file/miss", n, [&](size_t i)
+        {
+            stacked.exists_file(missing_paths[i % files]);
+            return std::uint64_t{0};
+        });
+        run(config, "indexed/read_file", n, [&](size_t i)
+        {
+            auto blob = stacked.read_file(small_paths[i % files]);
+            return blob ? static_cast<std::uint64_t>(blob->size()) : 0;
+        });
+
+        // Startup against a saved snapshot instead of a scan.
+        const fs::path snapshot = root / "overlay.tvfsidx";
+        stacked.save_index(snapshot);
+        const std::pair<const char*, tinyvfs::IndexCheck> checks[] = {
+            {"load_index/none", tinyvfs::IndexCheck::none},
+            {"load_index/directories", tinyvfs::IndexCheck::directories},
+            {"load_index/files", tinyvfs::IndexCheck::files}};
+        for (const auto& check : checks)
+        {
+            stacked.clear_index();
+            start = Clock::now();
+            bool loaded = stacked.load_index(snapshot, check.second);
+            std::snprintf(line, sizeof(line), "%-34s %9d %12.2f ms%s", check.first, 1,
+                std::chrono::duration<double, std::milli>(Clock::now() - start).count(), loaded ? "" : " (rejected)");
+            std::cout << line << "\n";
+        }
+        run(config, "snapshot/exists_file/hit", n, [&](size_t i)
+        {
+            stacked.exists_file(small_paths[i % files]);
+            return std::uint64_t{0};
+        });
+        run(config, "snapshot/exists_file/miss", n, [&](size_t i)
+        {
+            stacked.exists_file(missing_paths[i % files]);
+            return std::uint64_t{0};
+        });
+        stacked.clear_index();
+    }
+
+    {
+        const tinyvfs::StaticVfs static_flat(
+            tinyvfs::static_disk("assets", small),
+            tinyvfs::static_disk("huge", huge),
+            tinyvfs::static_disk("wide", wide));
+        run(config, "static/read_file/small/warm", n, [&](size_t i)
+        {
+            auto blob = static_flat.read_file(small_paths[i % files]);
+            return blob ? static_cast<std::uint64_t>(blob->size()) : 0;
+        });
+        run(config, "static/exists_file/hit", n, [&](size_t i)
+        {
+            static_flat.exists_file(small_paths[i % files]);
+            return std::uint64_t{0};
+        });
+        run(config, "static/exists_file/miss", n, [&](size_t i)
+        {
+            static_flat.exists_file(missing_paths[i % files]);
+            return std::uint64_t{0};
+        });
+    }
+
+    {
+        tinyvfs::Vfs cached;
+        auto disk = std::make_shared<tinyvfs::SubtreeBackend>(std::make_shared<tinyvfs::DiskBackend>(), small);
+        cached.mount("assets", std::make_shared<tinyvfs::CachingBackend>(disk, 256u << 20));
+        run(config, "cached/read_file/first", files, [&](size_t i)
+        {
+            auto blob = cached.read_file(small_paths[i]);
+            return blob ? static_cast<std::uint64_t>(blob->size()) : 0;
+        });
+        run(config, "cached/read_file/hit", n, [&](size_t i)
+        {
+            auto blob = cached.read_file(small_paths[i % files]);
+            return blob ? static_cast<std::uint64_t>(blob->size()) : 0;
+        });
+    }
+
+    {
+        tinyvfs::Vfs in_memory;
+        in_memory.mount("assets", std::make_shared<tinyvfs::MemoryBackend>());
+        const std::string contents(config.small_size, 'm');
+        run(config, "memory/write_file", files, [&](size_t i)
+        {
+            in_memory.write_file(small_paths[i], contents.data(), contents.size());
+            return static_cast<std::uint64_t>(contents.size());
+        });
+        run(config, "memory/read_file", n, [&](size_t i)
+        {
+            auto blob = in_memory.read_file(small_paths[i % files]);
+            return blob ? static_cast<std::uint64_t>(blob->size()) : 0;
+        });
+        run(config, "memory/exists_file/miss", n, [&](size_t i)
+        {
+            in_memory.exists_file(missing_paths[i % files]);
+            return std::uint64_t{0};
+        });
+    }
+
+    {
+        const fs::path pack_path = root / "small.pak";
+        tinyvfs::PackWriter writer;
+        for (size_t i = 0; i < config.small_files; ++i)
+            writer.add_file(small_name(i), small / small_name(i));
+        if (writer.write(pack_path) == tinyvfs::Result::ok)
+        {
+            tinyvfs::Vfs packed;
+            packed.mount_pack("assets", pack_path);
+            run(config, "pack/exists_file/hit", n, [&](size_t i)
+            {
+                packed.exists_file(small_paths[i % files]);
+                return std::uint64_t{0};
+            });
+            run(config, "pack/read_file", n, [&](size_t i)
+            {
+                auto blob = packed.read_file(small_paths[i % files]);
+                return blob ? static_cast<std::uint64_t>(blob->size()) : 0;
+            });
+
+            const tinyvfs::StaticVfs static_packed(tinyvfs::static_mount("assets", tinyvfs::PackBackend::open(pack_path)));
+            run(config, "static/pack/read_file", n, [&](size_t i)
+            {
+                auto blob = static_packed.read_file(small_paths[i % files]);
+                return blob ? static_cast<std::uint64_t>(blob->size()) : 0;
+            });
+        }
+    }
+
+    const size_t list_runs = std::max<size_t>(1, n / 1000);
+    evict_os_cache(wide);
+    run(config, "list_files/wide/filtered", list_runs, [&](size_t)
+    {
+        size_t count = 0;
+        flat.list_files("wide", {"png"}, [&](std::string_view) { ++count; });
+        return std::uint64_t{0};
+    });
+    run(config, "list_dirs/small", list_runs * 10, [&](size_t)
+    {
+        size_t count = 0;
+        flat.list_dirs("assets", [&](std::string_view) { ++count; });
+        return std::uint64_t{0};
+    });
+    run(config, "walk/small/serial", list_runs, [&](size_t)
+    {
+        size_t count = 0;
+        flat.walk("assets", {}, [&](std::string_view) { ++count; });
+        return std::uint64_t{0};
+    });
+    run(config, "walk/small/4 threads", list_runs, [&](size_t)
+    {
+        size_t count = 0;
+        flat.walk("assets", {}, [&](std::string_view) { ++count; }, 4);
+        return std::uint64_t{0};
+    });
+    run(config, "walk/overlay", list_runs, [&](size_t)
+    {
+        size_t count = 0;
+        stacked.walk("assets", {}, [&](std::string_view) { ++count; });
+        return std::uint64_t{0};
+    });
+
+    if (!keep)
+        fs::remove_all(root, ec);
+    return 0;
+}
@@ -1,11 +1,15 @@
 #include "tiny_vfs.h"
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdio>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <vector>
 
 namespace fs = tinyvfs::fs;
@@ -66,6 +70,69 @@ namespace
         return {};
     }
 
+    struct CountingAllocator final : tinyvfs::BlobAllocator
+    {
+        int live = 0;
+        size_t bytes = 0;
+
+        void* allocate(size_t size, size_t alignment) override
+        {
+            ++live;
+            bytes += size;
+            return ::operator new(size, std::align_val_t(alignment));
+        }
+
+        void deallocate(void* ptr, size_t, size_t alignment) noexcept override
+        {
+            --live;
+            ::operator delete(ptr, std::align_val_t(alignment));
+        }
+    };
+
+    // Holds the first stat() after arm() until release(), with its answer already taken,
+    // so a test can slip a write in between.
+    struct GatedStatBackend final : tinyvfs::Backend
+    {
+        std::shared_ptr<tinyvfs::MemoryBackend> inner = std::make_shared<tinyvfs::MemoryBackend>();
+        std::atomic<bool> armed{false};
+        std::atomic<bool> entered{false};
+        std::atomic<bool> released{false};
+
+        bool exists_file(std::string_view path) override { return inner->exists_file(path); }
+        bool exists_dir(std::string_view path) override { return inner->exists_dir(path); }
+        std::optional<tinyvfs::Blob> read_file(std::string_view path) override { return inner->read_file(path); }
+
+        tinyvfs::Result write_file(std::string_view path, const void* data, size_t size) override
+        {
+            return inner->write_file(path, data, size);
+        }
+
+        std::optional<tinyvfs::FileStat> stat(std::string_view path) override
+        {
+            auto result = inner->stat(path);
+            if (armed.exchange(false))
+            {
+                entered = true;
+                while (!released)
+                    std::this_thread::yield();
+            }
+            return result;
+        }
+
+        tinyvfs::Result list_files(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const tinyvfs::EnumerateRef& callback,
+            bool allow_duplicates) override
+        {
+            return inner->list_files(path, extensions, callback, allow_duplicates);
+        }
+
+        tinyvfs::Result list_dirs(std::string_view path, const tinyvfs::EnumerateRef& callback, bool allow_duplicates) override
+        {
+            return inner->list_dirs(path, callback, allow_duplicates);
+        }
+    };
+
     bool contains(const std::vector<std::string>& items, const std::string& name)
     {
         return std::find(items.begin(), items.end(), name) != items.end();
@@ -99,6 +166,21 @@ int main()
     t.check(vfs.exists_file("content/hello.txt"), "exists_file content/hello.txt");
     t.check(!vfs.exists_file("content/missing.txt"), "missing file is absent");
 
+    t.check(vfs.exists_file("/content//hello.txt/"), "normalization collapses separators");
+    t.check(vfs.exists_file("content/./textures/../hello.txt"), "normalization resolves dot segments");
+    t.check(!vfs.exists_file("content/../../hello.txt"), "normalization rejects escaping path");
+    t.check(vfs.exists_dir("./content/textures/."), "normalization for exists_dir");
+
+    std::string long_dir = "content";
+    for (int i = 0; i < 12; ++i)
+        long_dir += "/segment_with_a_fairly_long_name_" + std::to_string(i);
+    fs::path long_disk = content;
+    for (int i = 0; i < 12; ++i)
+        long_disk /= "segment_with_a_fairly_long_name_" + std::to_string(i);
+    t.check(write_text_file(long_disk / "deep.txt", "deep"), "write long path file");
+    t.check(vfs.exists_file(long_dir + "/deep.txt"), "canonical long path resolves");
+    t.check(vfs.exists_file(long_dir + "/./x/../deep.txt"), "long path normalization spills to heap");
+
     auto text = vfs.read_text("content/hello.txt");
     t.check(text.has_value(), "read_text returns value");
     t.check(text && *text == "hello from disk", "read_text content matches");
@@ -150,6 +232,1241 @@ int main()
         });
     t.check(contains(overlay_files, "overlay.txt"), "list_files sees overlay file");
 
+    std::vector<std::string> walked;
+    t.check(vfs.walk("content", {"txt"}, [&](std::string_view name) { walked.emplace_back(name); }) == tinyvfs::Result::ok,
+        "walk returns ok");
+    t.check(contains(walked, "textures/albedo.txt"), "walk recurses into subdirectories");
+    t.check(contains(walked, "overlay.txt") && contains(walked, "out.txt"), "walk merges overlay mounts");
+    t.check(std::count(walked.begin(), walked.end(), "hello.txt") == 1, "walk de-duplicates overlay files");
+    t.check(!contains(walked, "data.bin"), "walk filters by extension");
+
+    std::vector<std::string> walked_parallel;
+    vfs.walk("content", {"txt"}, [&](std::string_view name) { walked_parallel.emplace_back(name); }, 4);
+    std::sort(walked.begin(), walked.end());
+    std::sort(walked_parallel.begin(), walked_parallel.end());
+    t.check(walked == walked_parallel, "parallel walk matches serial walk");
+
+    bool pooled_walks = true;
+    std::vector<std::thread> walkers;
+    std::mutex pooled_mutex;
+    for (int i = 0; i < 3; ++i)
+    {
+        walkers.emplace_back([&]
+        {
+            for (int round = 0; round < 4; ++round)
+            {
+                std::vector<std::string> names;
+                vfs.walk("content", {"txt"}, [&](std::string_view name) { names.emplace_back(name); }, 1000);
+                std::sort(names.begin(), names.end());
+                std::lock_guard<std::mutex> lock(pooled_mutex);
+                pooled_walks = pooled_walks && names == walked;
+            }
+        });
+    }
+    for (auto& walker : walkers)
+        walker.join();
+    t.check(pooled_walks, "concurrent walks share the backend's pool");
+
+    std::vector<std::string> walked_root;
+    vfs.walk("", {}, [&](std::string_view name) { walked_root.emplace_back(name); });
+    t.check(contains(walked_root, "content/textures/albedo.txt") && contains(walked_root, "shaders/basic.hlsl"),
+        "walk from root prefixes mount paths");
+    t.check(vfs.walk("nowhere", {}, [](std::string_view) {}) == tinyvfs::Result::not_found, "walk of unknown path");
+
+    vfs.set_io_workers(2, 4);
+    std::atomic<int> async_hits{0};
+    for (int i = 0; i < 16; ++i)
+    {
+        vfs.read_file_async("content/hello.txt", [&](std::optional<tinyvfs::Blob> blob)
+        {
+            if (blob && blob->as_string_view() == "hello from overlay")
+                ++async_hits;
+        });
+    }
+    vfs.wait_async();
+    t.check(async_hits == 16, "read_file_async delivers every read");
+    auto async_future = vfs.read_file_async("content/missing.txt");
+    t.check(!async_future.get().has_value(), "read_file_async future reports missing file");
+    std::atomic<int> chained_hits{0};
+    for (int i = 0; i < 8; ++i)
+    {
+        vfs.read_file_async("content/hello.txt", [&](std::optional<tinyvfs::Blob> blob)
+        {
+            if (blob)
+                ++chained_hits;
+            vfs.read_file_async("content/overlay.txt", [&](std::optional<tinyvfs::Blob> next)
+            {
+                if (next)
+                    ++chained_hits;
+            });
+        });
+        if (i == 4)
+            vfs.set_io_workers(2, 4);
+    }
+    vfs.wait_async();
+    t.check(chained_hits == 16, "wait_async covers reads queued from callbacks");
+    vfs.set_io_workers(1, 16);
+    std::atomic<int> retired_hits{0};
+    vfs.read_file_async("content/hello.txt", [&](std::optional<tinyvfs::Blob>)
+    {
+        vfs.set_io_workers(2, 16);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        ++retired_hits;
+    });
+    for (int i = 0; i < 4; ++i)
+    {
+        vfs.read_file_async("content/hello.txt", [&](std::optional<tinyvfs::Blob> blob)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            if (blob)
+                ++retired_hits;
+        });
+    }
+    vfs.wait_async();
+    t.check(retired_hits == 5, "wait_async covers a pool replaced from its own worker");
+
+    {
+        tinyvfs::IoScheduler scheduler(1);
+        std::atomic<bool> gate_started{false};
+        std::atomic<bool> gate_open{false};
+        scheduler.submit(tinyvfs::IoRequest(), [&](tinyvfs::Result)
+        {
+            gate_started = true;
+            while (!gate_open)
+                std::this_thread::yield();
+        });
+        while (!gate_started)
+            std::this_thread::yield();
+
+        std::vector<std::string> order;
+        auto record = [&](std::string name)
+        {
+            return [&order, name](tinyvfs::Result result)
+            {
+                if (result == tinyvfs::Result::ok)
+                    order.push_back(name);
+            };
+        };
+        tinyvfs::IoRequest request;
+        request.priority = tinyvfs::IoPriority::background;
+        scheduler.submit(request, record("background"));
+        request.priority = tinyvfs::IoPriority::normal;
+        scheduler.submit(request, record("normal"));
+        request.deadline = std::chrono::steady_clock::now() + std::chrono::hours(1);
+        scheduler.submit(request, record("normal-deadline"));
+        request.deadline = std::chrono::steady_clock::time_point::max();
+        request.priority = tinyvfs::IoPriority::critical;
+        scheduler.submit(request, record("critical"));
+        request.priority = tinyvfs::IoPriority::high;
+        scheduler.submit(request, record("high"));
+        tinyvfs::IoTicket stale = scheduler.submit(request, record("cancelled"));
+        request.deadline = std::chrono::steady_clock::now() - std::chrono::milliseconds(1);
+        std::atomic<int> expired{0};
+        scheduler.submit(request, [&](tinyvfs::Result result)
+        {
+            if (result == tinyvfs::Result::cancelled)
+                ++expired;
+        });
+        t.check(scheduler.queued() == 7 && scheduler.cancel(stale) && !scheduler.cancel(stale),
+            "scheduler cancels queued request once");
+        gate_open = true;
+        scheduler.wait_idle();
+        t.check(order == std::vector<std::string>{"critical", "high", "normal-deadline", "normal", "background"},
+            "scheduler runs by priority, then deadline");
+        t.check(expired == 1, "scheduler drops expired request");
+    }
+    {
+        tinyvfs::IoScheduler scheduler(2);
+        scheduler.set_device_limit(5, 1);
+        std::atomic<bool> holder_started{false};
+        std::atomic<bool> holder_release{false};
+        tinyvfs::IoRequest on_device;
+        on_device.device = 5;
+        scheduler.submit(on_device, [&](tinyvfs::Result)
+        {
+            holder_started = true;
+            while (!holder_release)
+                std::this_thread::yield();
+        });
+        while (!holder_started)
+            std::this_thread::yield();
+        std::atomic<bool> blocked_cancelled{false};
+        on_device.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(20);
+        scheduler.submit(on_device, [&](tinyvfs::Result result)
+        {
+            if (result == tinyvfs::Result::cancelled)
+                blocked_cancelled = true;
+        });
+        const auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!blocked_cancelled && std::chrono::steady_clock::now() < give_up)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        t.check(blocked_cancelled, "blocked request expires at its deadline without other activity");
+        holder_release = true;
+        scheduler.wait_idle();
+    }
+    {
+        tinyvfs::IoScheduler scheduler(4);
+        scheduler.set_device_limit(7, 1);
+        std::atomic<int> running{0};
+        std::atomic<int> device_peak{0};
+        std::atomic<int> background_peak{0};
+        auto track = [&](std::atomic<int>& peak)
+        {
+            return [&](tinyvfs::Result)
+            {
+                int now = ++running;
+                for (int seen = peak; now > seen && !peak.compare_exchange_weak(seen, now);)
+                {
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                --running;
+            };
+        };
+        tinyvfs::IoRequest on_device;
+        on_device.device = 7;
+        for (int i = 0; i < 4; ++i)
+            scheduler.submit(on_device, track(device_peak));
+        scheduler.wait_idle();
+        tinyvfs::IoRequest bulk;
+        bulk.priority = tinyvfs::IoPriority::background;
+        for (int i = 0; i < 8; ++i)
+            scheduler.submit(bulk, track(background_peak));
+        scheduler.wait_idle();
+        t.check(device_peak == 1, "scheduler honours device queue depth");
+        t.check(background_peak >= 1 && background_peak <= 2, "background work leaves workers free");
+    }
+    std::atomic<int> scheduled_hits{0};
+    tinyvfs::IoRequest urgent;
+    urgent.priority = tinyvfs::IoPriority::critical;
+    vfs.read_file_async("content/hello.txt", urgent, [&](tinyvfs::Result result, std::optional<tinyvfs::Blob> blob)
+    {
+        if (result == tinyvfs::Result::ok && blob && blob->as_string_view() == "hello from overlay")
+            ++scheduled_hits;
+    });
+    vfs.read_file_async("content/missing.txt", urgent, [&](tinyvfs::Result result, std::optional<tinyvfs::Blob> blob)
+    {
+        if (result == tinyvfs::Result::not_found && !blob)
+            ++scheduled_hits;
+    });
+    vfs.wait_async();
+    t.check(scheduled_hits == 2 && !vfs.cancel_read(0), "prioritised read_file_async");
+    std::atomic<int> scheduled_chain_hits{0};
+    vfs.read_file_async("content/hello.txt", urgent, [&](tinyvfs::Result, std::optional<tinyvfs::Blob>)
+    {
+        vfs.io_scheduler()->set_device_limit(3, 2);
+        vfs.read_file_async("content/hello.txt", urgent, [&](tinyvfs::Result result, std::optional<tinyvfs::Blob> blob)
+        {
+            if (result == tinyvfs::Result::ok && blob)
+                ++scheduled_chain_hits;
+        });
+    });
+    vfs.wait_async();
+    t.check(scheduled_chain_hits == 1, "wait_async covers prioritised reads queued from callbacks");
+
+    std::atomic<bool> stop_readers{false};
+    std::atomic<int> reader_failures{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i)
+    {
+        readers.emplace_back([&]
+        {
+            while (!stop_readers)
+            {
+                auto blob = vfs.read_file("content/hello.txt");
+                if (!blob || blob->as_string_view() != "hello from overlay")
+                    ++reader_failures;
+            }
+        });
+    }
+    for (int i = 0; i < 200; ++i)
+    {
+        vfs.mount_disk("hot", shaders);
+        vfs.unmount("hot");
+    }
+    stop_readers = true;
+    for (auto& reader : readers)
+        reader.join();
+    t.check(reader_failures == 0, "reads stay consistent while mounts change");
+    // Deeper than the hazard slots, so the innermost calls pin the table by shared_ptr.
+    std::function<bool(int)> nested_read = [&](int depth)
+    {
+        if (depth == 0)
+            return vfs.read_text("content/hello.txt").value_or("") == "hello from overlay";
+        bool nested_ok = false;
+        vfs.list_files("content", {}, [&](std::string_view name)
+        {
+            if (name == "hello.txt")
+                nested_ok = nested_read(depth - 1);
+        });
+        return nested_ok;
+    };
+    t.check(nested_read(80), "reads nested past the hazard slots");
+
+    auto file = vfs.open("content/hello.txt");
+    t.check(file.has_value(), "open returns handle");
+    if (file)
+    {
+        t.check(file->size() == 18, "open reports size");
+        char head[5] = {};
+        t.check(file->read(head, sizeof(head)) == 5 && std::string_view(head, 5) == "hello", "File::read");
+        t.check(file->tell() == 5, "File::tell advances");
+        char tail[7] = {};
+        t.check(file->read_at(11, tail, sizeof(tail)) == 7 && std::string_view(tail, 7) == "overlay", "File::read_at");
+        t.check(file->seek(16) && file->read(tail, sizeof(tail)) == 2 && file->eof(), "File::read stops at end");
+        t.check(!file->seek(19), "File::seek rejects past end");
+    }
+    t.check(!vfs.open("content/missing.txt"), "open misses absent file");
+
+    CountingAllocator allocator;
+    {
+        auto allocated = vfs.read_file("content/hello.txt", allocator);
+        t.check(allocated && allocated->as_string_view() == "hello from overlay", "read_file with allocator");
+        t.check(allocator.live == 1 && allocator.bytes == 18, "read_file uses allocator");
+        tinyvfs::Blob shared = *allocated;
+        t.check(shared.data() == allocated->data(), "Blob copies share storage");
+    }
+    t.check(allocator.live == 0, "Blob releases allocator storage");
+
+    char into[32] = {};
+    size_t into_size = 0;
+    t.check(vfs.read_file_into("content/hello.txt", into, sizeof(into), into_size) == tinyvfs::Result::ok &&
+            std::string_view(into, into_size) == "hello from overlay",
+        "read_file_into fills caller buffer");
+    t.check(vfs.read_file_into("content/hello.txt", into, 4, into_size) == tinyvfs::Result::buffer_too_small &&
+            into_size == 18,
+        "read_file_into reports required size");
+    t.check(vfs.read_file_into("content/missing.txt", into, sizeof(into), into_size) == tinyvfs::Result::not_found,
+        "read_file_into misses absent file");
+
+    auto view = vfs.map_file("content/hello.txt");
+    t.check(view.has_value(), "map_file returns view");
+    t.check(view && view->as_string_view() == "hello from overlay", "map_file honours overlay");
+    auto bin_view = vfs.map_file("content/data.bin");
+    t.check(bin_view && bin_view->size() == 2 && bin_view->data()[1] == std::byte{0x02}, "map_file maps binary data");
+    t.check(!vfs.map_file("content/missing.txt"), "map_file misses absent file");
+
+    t.check(vfs.build_index(), "build_index succeeds");
+    t.check(vfs.has_index(), "has_index after build");
+    auto indexed_text = vfs.read_text("content/hello.txt");
+    t.check(indexed_text && *indexed_text == "hello from overlay", "index resolves to overlay");
+    t.check(vfs.exists_file("content/textures/albedo.txt"), "index covers subdirectories");
+    t.check(vfs.exists_file("shaders/basic.hlsl"), "index covers every mount");
+    t.check(!vfs.exists_file("content/missing.txt"), "index misses absent file");
+
+    const char indexed_data[] = "indexed";
+    t.check(vfs.write_file("content/indexed.txt", indexed_data, sizeof(indexed_data) - 1) == tinyvfs::Result::ok,
+        "write_file with index returns ok");
+    t.check(vfs.exists_file("content/indexed.txt"), "write_file updates index");
+
+    t.check(vfs.mount_disk("extra", shaders), "mount drops index");
+    t.check(!vfs.has_index(), "index cleared on mount");
+
+    std::vector<std::string> batch_results(4);
+    std::vector<int> batch_calls(4, 0);
+    vfs.read_files({"content/hello.txt", "content/missing.txt", "shaders/basic.hlsl", "../bad"},
+        [&](size_t index, std::optional<tinyvfs::Blob> blob)
+        {
+            ++batch_calls[index];
+            if (blob)
+                batch_results[index] = blob->to_string();
+        });
+    t.check(std::all_of(batch_calls.begin(), batch_calls.end(), [](int calls) { return calls == 1; }),
+        "read_files reports each path once");
+    t.check(batch_results[0] == "hello from overlay", "read_files honours overlay");
+    t.check(batch_results[1].empty() && batch_results[3].empty(), "read_files reports misses");
+    t.check(batch_results[2] == "float4 main() : SV_Target { return 1; }", "read_files spans mounts");
+
+    fs::path cached_dir = root / "cached";
+    t.check(write_text_file(cached_dir / "config.json", "{\"v\":1}"), "write cached config");
+    t.check(write_text_file(cached_dir / "other.json", "{\"other\":true}"), "write cached other");
+    auto cache = std::make_shared<tinyvfs::CachingBackend>(
+        std::make_shared<tinyvfs::SubtreeBackend>(std::make_shared<tinyvfs::DiskBackend>(), cached_dir),
+        16);
+    tinyvfs::Vfs cache_vfs;
+    t.check(cache_vfs.mount("cfg", cache), "mount caching backend");
+    auto first_read = cache_vfs.read_file("cfg/config.json");
+    t.check(first_read && first_read->as_string_view() == "{\"v\":1}", "cache miss reads backend");
+    t.check(cache->cached_bytes() == 7, "cache stores read");
+    t.check(write_text_file(cached_dir / "config.json", "{\"v\":2}"), "modify cached file behind cache");
+    auto second_read = cache_vfs.read_file("cfg/config.json");
+    t.check(second_read && second_read->data() == first_read->data(), "cache hit shares buffer");
+    const char fresh[] = "{\"v\":3}";
+    t.check(cache_vfs.write_file("cfg/config.json", fresh, sizeof(fresh) - 1) == tinyvfs::Result::ok, "write through cache");
+    auto third_read = cache_vfs.read_text("cfg/config.json");
+    t.check(third_read && *third_read == "{\"v\":3}", "write invalidates cache");
+    cache_vfs.read_file("cfg/other.json");
+    t.check(cache->cached_bytes() <= cache->budget(), "cache respects byte budget");
+    auto evicted = cache_vfs.read_text("cfg/config.json");
+    t.check(evicted && *evicted == "{\"v\":3}", "evicted entry reloads");
+
+    tinyvfs::PackWriter writer;
+    const char packed_text[] = "packed readme";
+    t.check(writer.add("readme.txt", packed_text, sizeof(packed_text) - 1), "pack add readme");
+    t.check(writer.add("levels/one/layout.json", "{}", 2), "pack add nested file");
+    t.check(writer.add_file("levels/one/hello.txt", content / "hello.txt"), "pack add from disk");
+    t.check(!writer.add("readme.txt", "x", 1), "pack rejects duplicate path");
+    t.check(!writer.add("../escape.txt", "x", 1), "pack rejects escaping path");
+    fs::path pack_path = root / "content.pak";
+    t.check(writer.write(pack_path) == tinyvfs::Result::ok, "pack write");
+
+    tinyvfs::Vfs pack_vfs;
+    t.check(pack_vfs.mount_pack("pak", pack_path), "mount_pack");
+    t.check(!pack_vfs.mount_pack("bad", content / "hello.txt"), "mount_pack rejects non-pack");
+    auto packed = pack_vfs.read_text("pak/readme.txt");
+    t.check(packed && *packed == "packed readme", "pack read_text");
+    auto packed_disk = pack_vfs.read_text("pak/levels/one/hello.txt");
+    t.check(packed_disk && *packed_disk == "hello from disk", "pack streamed source file");
+    auto packed_view = pack_vfs.map_file("pak/levels/one/layout.json");
+    t.check(packed_view && packed_view->as_string_view() == "{}", "pack map_file");
+    auto packed_file = pack_vfs.open("pak/readme.txt");
+    char packed_word[6] = {};
+    t.check(packed_file && packed_file->read_at(7, packed_word, sizeof(packed_word)) == 6 &&
+            std::string_view(packed_word, 6) == "readme",
+        "pack open read_at");
+    t.check(pack_vfs.exists_dir("pak/levels/one"), "pack exists_dir");
+    t.check(!pack_vfs.exists_dir("pak/levels/two"), "pack missing dir");
+    t.check(!pack_vfs.exists_file("pak/levels"), "pack dir is not a file");
+    t.check(pack_vfs.write_file("pak/new.txt", "x", 1) == tinyvfs::Result::not_supported, "pack is read-only");
+
+    std::vector<std::string> pack_files;
+    pack_vfs.list_files("pak/levels/one", {"json"}, [&](std::string_view name) { pack_files.emplace_back(name); });
+    t.check(pack_files.size() == 1 && contains(pack_files, "layout.json"), "pack list_files filters");
+    std::vector<std::string> pack_dirs;
+    pack_vfs.list_dirs("pak", [&](std::string_view name) { pack_dirs.emplace_back(name); });
+    t.check(pack_dirs.size() == 1 && contains(pack_dirs, "levels"), "pack list_dirs");
+    tinyvfs::PackWriter tree_writer;
+    for (const char* tree_name : {"a/c/e.txt", "a-b/x.txt", "a/b.txt", "ab.txt", "a/c/f/g.txt", "a0/y.txt", "a/c/d.txt"})
+        tree_writer.add(tree_name, "t", 1);
+    const fs::path tree_path = root / "tree.pak";
+    auto tree_pack = tree_writer.write(tree_path) == tinyvfs::Result::ok ? tinyvfs::PackBackend::open(tree_path) : nullptr;
+    t.check(tree_pack != nullptr, "write nested pack");
+    if (tree_pack)
+    {
+        std::vector<std::string> tree_dirs;
+        std::vector<std::string> tree_files;
+        std::vector<std::string> tree_walk;
+        std::vector<std::string> root_dirs;
+        tree_pack->list_dirs("a", [&](std::string_view name) { tree_dirs.emplace_back(name); }, false);
+        tree_pack->list_files("a", {}, [&](std::string_view name) { tree_files.emplace_back(name); }, false);
+        tree_pack->walk("a", {"txt"}, [&](std::string_view name) { tree_walk.emplace_back(name); }, 1);
+        tree_pack->list_dirs("", [&](std::string_view name) { root_dirs.emplace_back(name); }, false);
+        t.check(tree_dirs == std::vector<std::string>{"c"} && tree_files == std::vector<std::string>{"b.txt"} &&
+                tree_walk.size() == 4 && contains(tree_walk, "c/f/g.txt") && root_dirs.size() == 3 &&
+                contains(root_dirs, "a-b") && contains(root_dirs, "a0"),
+            "pack listings keep sibling prefixes apart");
+        t.check(tree_pack->exists_dir("a/c/f") && !tree_pack->exists_dir("a/c/d.txt") && !tree_pack->exists_dir("a/c/f/g") &&
+                tree_pack->list_files("a/x", {}, [](std::string_view) {}, false) == tinyvfs::Result::not_found,
+            "pack exists_dir from the path order");
+    }
+
+    tinyvfs::PackWriter aligned_writer;
+    t.check(!aligned_writer.set_alignment(3) && aligned_writer.set_alignment(4096), "pack alignment must be a power of two");
+    t.check(aligned_writer.add("first.txt", "first", 5) && aligned_writer.add("second.txt", "second", 6),
+        "aligned pack add");
+    fs::path aligned_path = root / "aligned.pak";
+    t.check(aligned_writer.write(aligned_path) == tinyvfs::Result::ok, "aligned pack write");
+    std::error_code aligned_ec;
+    t.check(fs::file_size(aligned_path, aligned_ec) > 2 * 4096, "aligned pack pads file data");
+    tinyvfs::Vfs aligned_vfs;
+    t.check(aligned_vfs.mount_pack("pak", aligned_path), "mount aligned pack");
+    auto aligned_first = aligned_vfs.map_file("pak/first.txt");
+    auto aligned_second = aligned_vfs.map_file("pak/second.txt");
+    t.check(aligned_first && aligned_second && aligned_first->as_string_view() == "first" &&
+            aligned_second->as_string_view() == "second" &&
+            reinterpret_cast<std::uintptr_t>(aligned_second->data()) % 4096 == 0 &&
+            aligned_second->data() - aligned_first->data() == 4096,
+        "aligned pack keeps order and alignment");
+
+    std::vector<std::string> pack_batch(3);
+    pack_vfs.read_files({"pak/levels/one/hello.txt", "pak/readme.txt", "pak/none"},
+        [&](size_t index, std::optional<tinyvfs::Blob> blob)
+        {
+            pack_batch[index] = blob ? blob->to_string() : "<missing>";
+        });
+    t.check(pack_batch[0] == "hello from disk" && pack_batch[1] == "packed readme" && pack_batch[2] == "<missing>",
+        "pack read_files");
+    t.check(pack_vfs.build_index(), "pack build_index");
+    int indexed_batch_hits = 0;
+    pack_vfs.read_files({"pak/readme.txt", "pak/none"}, [&](size_t index, std::optional<tinyvfs::Blob> blob)
+    {
+        if ((index == 0) == blob.has_value())
+            ++indexed_batch_hits;
+    });
+    t.check(indexed_batch_hits == 2, "indexed read_files");
+
+    std::vector<std::string> pack_walk;
+    pack_vfs.walk("pak/levels", {"txt"}, [&](std::string_view name) { pack_walk.emplace_back(name); });
+    t.check(pack_walk.size() == 1 && contains(pack_walk, "one/hello.txt"), "pack walk");
+
+    t.check(pack_vfs.mount_disk("pak", overlay), "mount disk over pack");
+    t.check(pack_vfs.exists_file("pak/overlay.txt"), "disk overlay over pack");
+    t.check(pack_vfs.exists_file("pak/readme.txt"), "pack still visible under overlay");
+
+    tinyvfs::Vfs nested_vfs;
+    for (int i = 0; i < 40; ++i)
+        nested_vfs.mount_disk("packages/pkg" + std::to_string(i), overlay);
+    t.check(nested_vfs.mount_disk("packages/pkg7/inner", content), "mount nested below package");
+    t.check(nested_vfs.exists_file("packages/pkg39/overlay.txt"), "per-package mount lookup");
+    t.check(!nested_vfs.exists_file("packages/pkg40/overlay.txt"), "unknown package misses");
+    t.check(nested_vfs.read_text("packages/pkg7/inner/hello.txt").value_or("") == "hello from disk",
+        "nested mount lookup");
+    t.check(nested_vfs.exists_dir("packages/pkg7"), "mount root is a directory");
+    std::vector<std::string> package_dirs;
+    nested_vfs.list_dirs("packages", [&](std::string_view name) { package_dirs.emplace_back(name); });
+    t.check(package_dirs.size() == 40 && contains(package_dirs, "pkg0") && contains(package_dirs, "pkg39"),
+        "list_dirs reports child mounts");
+    std::vector<std::string> nested_walk;
+    nested_vfs.walk("packages/pkg7", {"txt"}, [&](std::string_view name) { nested_walk.emplace_back(name); });
+    t.check(contains(nested_walk, "overlay.txt") && contains(nested_walk, "inner/hello.txt"),
+        "walk includes nested mounts");
+
+    tinyvfs::Vfs stat_vfs;
+    t.check(stat_vfs.mount_disk("content", content), "mount for stat");
+    t.check(stat_vfs.mount_pack("pak", pack_path), "mount pack for stat");
+    auto hello_stat = stat_vfs.stat("content/hello.txt");
+    t.check(hello_stat && hello_stat->type == tinyvfs::FileType::file && hello_stat->size == 15 &&
+            hello_stat->mtime_ns > 0,
+        "stat disk file");
+    auto textures_stat = stat_vfs.stat("content/textures");
+    t.check(textures_stat && textures_stat->type == tinyvfs::FileType::directory, "stat disk directory");
+    t.check(!stat_vfs.stat("content/missing.txt"), "stat missing file");
+    auto packed_stat = stat_vfs.stat("pak/readme.txt");
+    t.check(packed_stat && packed_stat->type == tinyvfs::FileType::file && packed_stat->size == 13,
+        "stat pack file");
+    auto packed_dir_stat = stat_vfs.stat("pak/levels");
+    t.check(packed_dir_stat && packed_dir_stat->type == tinyvfs::FileType::directory, "stat pack directory");
+    auto root_stat = stat_vfs.stat("");
+    t.check(root_stat && root_stat->type == tinyvfs::FileType::directory, "stat virtual root");
+
+    stat_vfs.set_stat_cache(true);
+    t.check(stat_vfs.has_stat_cache(), "stat cache enabled");
+    t.check(!stat_vfs.stat("content/stat_new.txt"), "stat cache records miss");
+    t.check(write_text_file(content / "stat_new.txt", "1234"), "write stat_new.txt behind vfs");
+    t.check(!stat_vfs.stat("content/stat_new.txt"), "stat cache serves cached miss");
+    stat_vfs.clear_stat_cache();
+    auto new_stat = stat_vfs.stat("content/stat_new.txt");
+    t.check(new_stat && new_stat->size == 4, "clear_stat_cache drops entries");
+    t.check(stat_vfs.write_file("content/stat_new.txt", "123456", 6) == tinyvfs::Result::ok, "write through stat cache");
+    new_stat = stat_vfs.stat("content/stat_new.txt");
+    t.check(new_stat && new_stat->size == 6, "write_file invalidates stat cache");
+    t.check(stat_vfs.build_index(), "index with stat cache");
+    t.check(stat_vfs.has_stat_cache() && stat_vfs.stat("content/hello.txt").has_value(), "indexed stat");
+    tinyvfs::Vfs indexed_stat_vfs;
+    t.check(indexed_stat_vfs.mount_disk("content", content) && indexed_stat_vfs.build_index(), "index for stat");
+    fs::create_directories(content / "made_after_index");
+    auto indexed_dir_stat = indexed_stat_vfs.stat("content/textures");
+    t.check(indexed_dir_stat && indexed_dir_stat->type == tinyvfs::FileType::directory && indexed_dir_stat->mtime_ns > 0,
+        "indexed stat of scanned directory");
+    auto indexed_root_stat = indexed_stat_vfs.stat("content");
+    t.check(indexed_root_stat && indexed_root_stat->type == tinyvfs::FileType::directory &&
+            !indexed_stat_vfs.stat("content/made_after_index") && !indexed_stat_vfs.stat("content/nope/none.txt"),
+        "indexed stat answers misses without probing mounts");
+    tinyvfs::Vfs small_stat_vfs;
+    small_stat_vfs.mount_disk("content", content);
+    small_stat_vfs.set_stat_cache(true, 4);
+    int small_stat_hits = 0;
+    for (int round = 0; round < 2; ++round)
+    {
+        for (int i = 0; i < 40; ++i)
+            small_stat_hits += small_stat_vfs.stat("content/miss" + std::to_string(i)) ? 0 : 1;
+        small_stat_hits += small_stat_vfs.stat("content/hello.txt") ? 1 : 0;
+    }
+    t.check(small_stat_hits == 82, "bounded stat cache stays correct");
+    small_stat_vfs.set_miss_cache(true);
+    small_stat_vfs.set_watching(false);
+    small_stat_vfs.clear_index();
+    t.check(small_stat_vfs.has_stat_cache() && small_stat_vfs.has_miss_cache(), "caches survive republishing");
+    tinyvfs::Vfs parent_stat_vfs;
+    t.check(parent_stat_vfs.mount("mem", std::make_shared<tinyvfs::MemoryBackend>()), "mount memory for stat cache");
+    parent_stat_vfs.set_stat_cache(true);
+    t.check(!parent_stat_vfs.stat("mem/made") && parent_stat_vfs.write_file("mem/made/new.txt", "x", 1) == tinyvfs::Result::ok,
+        "write creates a cached-missing parent");
+    auto made_stat = parent_stat_vfs.stat("mem/made");
+    t.check(made_stat && made_stat->type == tinyvfs::FileType::directory, "write_file drops cached parent misses");
+    auto gated = std::make_shared<GatedStatBackend>();
+    tinyvfs::Vfs gated_vfs;
+    t.check(gated_vfs.mount("gated", gated), "mount gated backend");
+    gated_vfs.set_stat_cache(true);
+    gated->armed = true;
+    std::thread gated_stat([&] { gated_vfs.stat("gated/late.txt"); });
+    while (!gated->entered)
+        std::this_thread::yield();
+    t.check(gated_vfs.write_file("gated/late.txt", "late", 4) == tinyvfs::Result::ok, "write during stat");
+    gated->released = true;
+    gated_stat.join();
+    t.check(gated_vfs.stat("gated/late.txt").has_value(), "stat racing a write does not cache the old miss");
+
+    fs::path listing = root / "listing";
+    t.check(write_text_file(listing / "a.png", "a") && write_text_file(listing / "b.dds", "b") &&
+            write_text_file(listing / "sub" / "c.png", "c"),
+        "write listing files");
+    tinyvfs::Vfs listing_vfs;
+    t.check(listing_vfs.mount_disk("l", listing), "mount listing");
+    std::vector<std::string> listed_files;
+    t.check(listing_vfs.list_files("l", {"png"},
+                [&](std::string_view name) { listed_files.emplace_back(name); }) == tinyvfs::Result::ok &&
+            listed_files.size() == 1 && contains(listed_files, "a.png"),
+        "disk list_files filters by extension");
+    std::vector<std::string> stored_names;
+    tinyvfs::EnumerateFn stored_callback = [&](std::string_view name) { stored_names.emplace_back(name); };
+    stored_callback("first");
+    t.check(listing_vfs.list_files("l", {"dds"}, stored_callback) == tinyvfs::Result::ok && stored_names.size() == 2 &&
+            stored_names[1] == "b.dds",
+        "stored EnumerateFn owns its lambda");
+    std::vector<std::string> listed_dirs;
+    t.check(listing_vfs.list_dirs("l",
+                [&](std::string_view name) { listed_dirs.emplace_back(name); }) == tinyvfs::Result::ok &&
+            listed_dirs.size() == 1 && contains(listed_dirs, "sub"),
+        "disk list_dirs");
+    tinyvfs::DiskBackend disk_backend;
+    tinyvfs::Backend& listing_backend = disk_backend;
+    t.check(listing_backend.list_files((listing / "none").generic_string(), {}, [](std::string_view) {}) ==
+            tinyvfs::Result::not_found,
+        "disk list_files missing dir");
+    t.check(listing_backend.list_dirs((listing / "a.png").generic_string(), [](std::string_view) {}) ==
+            tinyvfs::Result::not_found,
+        "disk list_dirs on a file");
+#if !defined(_WIN32)
+    std::error_code link_ec;
+    fs::create_symlink(listing / "a.png", listing / "link.png", link_ec);
+    fs::create_directory_symlink(listing / "sub", listing / "sublink", link_ec);
+    if (!link_ec)
+    {
+        listed_files.clear();
+        listing_vfs.list_files("l", {"png"}, [&](std::string_view name) { listed_files.emplace_back(name); });
+        t.check(listed_files.size() == 2 && contains(listed_files, "link.png"), "disk list_files follows file links");
+        listed_dirs.clear();
+        listing_vfs.list_dirs("l", [&](std::string_view name) { listed_dirs.emplace_back(name); });
+        t.check(listed_dirs.size() == 2 && contains(listed_dirs, "sublink"), "disk list_dirs reports dir links");
+        std::vector<std::string> link_walk;
+        listing_vfs.walk("l", {"png"}, [&](std::string_view name) { link_walk.emplace_back(name); });
+        t.check(link_walk.size() == 3 && contains(link_walk, "sub/c.png") && !contains(link_walk, "sublink/c.png"),
+            "disk walk skips dir links");
+    }
+#endif
+
+    size_t batched_names = 0;
+    size_t name_batches = 0;
+    t.check(nested_vfs.list_dirs_batched("packages", [&](const std::string_view* names, size_t count)
+    {
+        ++name_batches;
+        for (size_t i = 0; i < count; ++i)
+            batched_names += names[i].rfind("pkg", 0) == 0 ? 1 : 0;
+    }, 16) == tinyvfs::Result::ok, "list_dirs_batched");
+    t.check(batched_names == 40 && name_batches == 3, "list_dirs_batched chunks");
+    std::vector<std::string> batched_walk;
+    t.check(listing_vfs.walk_batched("l", {}, [&](const std::string_view* names, size_t count)
+    {
+        batched_walk.insert(batched_walk.end(), names, names + count);
+    }) == tinyvfs::Result::ok && contains(batched_walk, "sub/c.png") && contains(batched_walk, "b.dds"),
+        "walk_batched");
+    size_t function_hits = 0;
+    struct CountingFunctor
+    {
+        size_t* hits;
+        void operator()(std::string_view) const { ++*hits; }
+    };
+    listing_vfs.list_files("l", {"png", "dds"}, CountingFunctor{&function_hits});
+    t.check(function_hits >= 2, "list_files accepts function objects");
+
+    fs::path writes = root / "writes";
+    fs::create_directories(writes);
+    tinyvfs::Vfs write_vfs;
+    t.check(write_vfs.mount_disk("w", writes), "mount writes");
+    t.check(write_vfs.write_file_gather("w/save.bin", {{"head-", 5}, {"", 0}, {"body-", 5}, {"tail", 4}}) ==
+            tinyvfs::Result::ok,
+        "write_file_gather");
+    t.check(write_vfs.read_text("w/save.bin").value_or("") == "head-body-tail", "gathered chunks in order");
+    tinyvfs::WriteOptions atomic_options;
+    atomic_options.atomic = true;
+    atomic_options.preallocate = true;
+    t.check(write_vfs.write_file_gather("w/save.bin", {{"new ", 4}, {"save", 4}}, atomic_options) == tinyvfs::Result::ok,
+        "atomic gathered write");
+    t.check(write_vfs.read_text("w/save.bin").value_or("") == "new save", "atomic write replaces contents");
+    t.check(write_vfs.write_file("w/empty.bin", nullptr, 0, atomic_options) == tinyvfs::Result::ok &&
+            write_vfs.stat("w/empty.bin") && write_vfs.stat("w/empty.bin")->size == 0,
+        "atomic empty write");
+    t.check(write_vfs.write_file("w/missing/save.bin", "x", 1, atomic_options) == tinyvfs::Result::not_found,
+        "atomic write into missing dir");
+    t.check(write_vfs.write_file("w/missing/save.bin", "x", 1) == tinyvfs::Result::not_found,
+        "write into missing dir");
+    std::vector<std::string> written_names;
+    write_vfs.list_files("w", {}, [&](std::string_view name) { written_names.emplace_back(name); });
+    t.check(written_names.size() == 2, "atomic writes leave no temporaries");
+
+    std::vector<std::string> many_chunks(200);
+    std::vector<tinyvfs::WriteChunk> chunk_list;
+    std::string expected_many;
+    for (size_t i = 0; i < many_chunks.size(); ++i)
+    {
+        many_chunks[i] = std::to_string(i) + ",";
+        chunk_list.push_back(tinyvfs::WriteChunk{many_chunks[i].data(), many_chunks[i].size()});
+        expected_many += many_chunks[i];
+    }
+    t.check(write_vfs.write_file_gather("w/many.txt", chunk_list.data(), chunk_list.size()) == tinyvfs::Result::ok &&
+            write_vfs.read_text("w/many.txt").value_or("") == expected_many,
+        "gather write past one writev batch");
+
+    fs::path squeezed = root / "squeezed";
+    fs::create_directories(squeezed);
+    t.check(write_text_file(squeezed / "plain.txt", "stored as is"), "write plain.txt");
+    auto squeezed_disk = std::make_shared<tinyvfs::SubtreeBackend>(std::make_shared<tinyvfs::DiskBackend>(), squeezed);
+    tinyvfs::Vfs squeezed_vfs;
+    t.check(squeezed_vfs.mount("z", std::make_shared<tinyvfs::CompressedBackend>(squeezed_disk, 4, 1024)),
+        "mount compressed backend");
+    std::string level_data;
+    for (int i = 0; i < 2000; ++i)
+        level_data += "entity " + std::to_string(i % 37) + " at " + std::to_string(i) + "\n";
+    t.check(squeezed_vfs.write_file("z/level.txt", level_data.data(), level_data.size()) == tinyvfs::Result::ok,
+        "compressed write");
+    std::error_code size_ec;
+    auto stored_size = fs::file_size(squeezed / "level.txt", size_ec);
+    t.check(!size_ec && stored_size < level_data.size() / 2, "compressed file is smaller on disk");
+    t.check(squeezed_vfs.read_text("z/level.txt").value_or("") == level_data, "compressed round trip");
+    auto level_stat = squeezed_vfs.stat("z/level.txt");
+    t.check(level_stat && level_stat->size == level_data.size(), "compressed stat reports raw size");
+    auto level_file = squeezed_vfs.open("z/level.txt");
+    std::string level_range(3000, '\0');
+    t.check(level_file && level_file->size() == level_data.size() &&
+            level_file->read_at(1000, level_range.data(), level_range.size()) == level_range.size() &&
+            level_range == level_data.substr(1000, 3000),
+        "compressed range read across blocks");
+    t.check(level_file && level_file->seek(level_data.size() - 10) &&
+            level_file->read(level_range.data(), level_range.size()) == 10,
+        "compressed read clamps at end");
+    std::atomic<int> shared_handle_failures{0};
+    if (level_file)
+    {
+        std::vector<std::thread> range_readers;
+        for (int r = 0; r < 4; ++r)
+        {
+            range_readers.emplace_back([&, r]
+            {
+                std::string range(700, '\0');
+                for (int i = 0; i < 100; ++i)
+                {
+                    const size_t offset = static_cast<size_t>((r * 977 + i * 131) % 40000);
+                    const size_t got = level_file->read_at(offset, range.data(), range.size());
+                    if (range.compare(0, got, level_data, offset, got) != 0)
+                        ++shared_handle_failures;
+                }
+            });
+        }
+        for (auto& reader : range_readers)
+            reader.join();
+    }
+    t.check(level_file && shared_handle_failures == 0, "compressed handle serves concurrent read_at");
+    t.check(squeezed_vfs.read_text("z/plain.txt").value_or("") == "stored as is", "uncompressed files pass through");
+    auto writer_blob = tinyvfs::CompressedBackend::encode(level_data.data(), level_data.size(), 512);
+    t.check(write_bytes_file(squeezed / "bad.txt",
+                std::vector<std::byte>(writer_blob.data(), writer_blob.data() + writer_blob.size() / 2)),
+        "write truncated compressed file");
+    t.check(!squeezed_vfs.read_file("z/bad.txt"), "truncated compressed file is rejected");
+
+    t.check(tinyvfs::detail::Xxh64::hash("", 0) == 0xef46db3751d8e999ull &&
+            tinyvfs::detail::Xxh64::hash("abc", 3) == 0x44bc2cf5ad770999ull,
+        "XXH64 reference vectors");
+    tinyvfs::detail::Xxh64 streamed;
+    for (char c : std::string_view("abc"))
+        streamed.update(&c, 1);
+    tinyvfs::detail::Xxh64 streamed_long;
+    for (char c : level_data)
+        streamed_long.update(&c, 1);
+    t.check(streamed.digest() == 0x44bc2cf5ad770999ull &&
+            streamed_long.digest() == tinyvfs::detail::Xxh64::hash(level_data.data(), level_data.size()),
+        "XXH64 streamed a byte at a time");
+
+    fs::path cas = root / "cas";
+    auto cas_disk = std::make_shared<tinyvfs::SubtreeBackend>(std::make_shared<tinyvfs::DiskBackend>(), cas);
+    auto store = tinyvfs::ContentStoreBackend::open(cas_disk);
+    t.check(store != nullptr, "open empty content store");
+    auto cas_cache = std::make_shared<tinyvfs::CachingBackend>(store, 1u << 20);
+    tinyvfs::Vfs cas_vfs;
+    t.check(cas_vfs.mount("cas", cas_cache), "mount content store");
+    const std::string shared_text = "identical in base and patch";
+    t.check(cas_vfs.write_file("cas/base/shared.txt", shared_text.data(), shared_text.size()) == tinyvfs::Result::ok &&
+            cas_vfs.write_file("cas/patch/shared.txt", shared_text.data(), shared_text.size()) == tinyvfs::Result::ok &&
+            cas_vfs.write_file("cas/patch/new.txt", "only in patch", 13) == tinyvfs::Result::ok,
+        "content store writes");
+    t.check(store && store->file_count() == 3 && store->object_count() == 2, "identical contents stored once");
+    t.check(cas_vfs.read_text("cas/base/shared.txt").value_or("") == shared_text &&
+            cas_vfs.read_text("cas/patch/shared.txt").value_or("") == shared_text,
+        "content store reads");
+    t.check(cas_cache->cached_bytes() == shared_text.size(), "cache shares identical contents");
+    std::vector<std::string> cas_dirs;
+    cas_vfs.list_dirs("cas", [&](std::string_view name) { cas_dirs.emplace_back(name); });
+    t.check(cas_dirs.size() == 2 && contains(cas_dirs, "base") && contains(cas_dirs, "patch"), "content store list_dirs");
+    std::vector<std::string> cas_walk;
+    cas_vfs.walk("cas/patch", {"txt"}, [&](std::string_view name) { cas_walk.emplace_back(name); });
+    t.check(cas_walk.size() == 2 && contains(cas_walk, "new.txt"), "content store walk");
+    auto cas_stat = cas_vfs.stat("cas/patch/new.txt");
+    t.check(cas_stat && cas_stat->size == 13, "content store stat");
+
+    auto reopened = tinyvfs::ContentStoreBackend::open(cas_disk);
+    t.check(reopened && reopened->file_count() == 3 && reopened->read_file("patch/new.txt") &&
+            reopened->read_file("patch/new.txt")->to_string() == "only in patch",
+        "content store manifest persists");
+    auto new_hash = reopened ? reopened->content_hash("patch/new.txt") : std::nullopt;
+    t.check(new_hash.has_value(), "content store reports hashes");
+    if (new_hash)
+    {
+        char object_name[17] = {};
+        std::snprintf(object_name, sizeof(object_name), "%016llx", static_cast<unsigned long long>(*new_hash));
+        t.check(write_text_file(cas / "objects" / object_name, "tampered bytes"), "tamper with object");
+        t.check(!reopened->read_file("patch/new.txt"), "content store rejects corrupted object");
+        t.check(!reopened->map_file("patch/new.txt"), "content store rejects corrupted mapping");
+    }
+    t.check(write_text_file(cas / "manifest.tvfs", "not a manifest"), "corrupt manifest");
+    t.check(tinyvfs::ContentStoreBackend::open(cas_disk) == nullptr, "content store rejects corrupt manifest");
+    const fs::path cas_blocked = root / "cas_blocked";
+    fs::create_directories(cas_blocked / "manifest.tvfs");
+    auto blocked_store = tinyvfs::ContentStoreBackend::open(
+        std::make_shared<tinyvfs::SubtreeBackend>(std::make_shared<tinyvfs::DiskBackend>(), cas_blocked));
+    t.check(blocked_store && blocked_store->write_file("a.txt", "a", 1) != tinyvfs::Result::ok &&
+            blocked_store->file_count() == 0 && !blocked_store->exists_file("a.txt"),
+        "failed manifest save leaves entries unchanged");
+
+    auto warm_cache = std::make_shared<tinyvfs::CachingBackend>(
+        std::make_shared<tinyvfs::SubtreeBackend>(std::make_shared<tinyvfs::DiskBackend>(), content), 1u << 20);
+    tinyvfs::Vfs warm_vfs;
+    t.check(warm_vfs.mount("warm", warm_cache), "mount prefetch cache");
+    t.check(warm_vfs.mount_disk("disk", content), "mount prefetch disk");
+    t.check(warm_vfs.mount_pack("pak", pack_path), "mount prefetch pack");
+    warm_vfs.prefetch({"warm/hello.txt", "warm/missing.txt", "disk/hello.txt", "pak/readme.txt"});
+    warm_vfs.wait_async();
+    t.check(warm_cache->cached_bytes() == 15, "prefetch fills caching backend");
+    t.check(warm_vfs.prefetch_now("disk/hello.txt") && warm_vfs.prefetch_now("pak/readme.txt"), "prefetch disk and pack");
+    t.check(!warm_vfs.prefetch_now("disk/textures") && !warm_vfs.prefetch_now("disk/missing.txt"),
+        "prefetch skips directories and missing files");
+    t.check(warm_vfs.read_text("disk/hello.txt").value_or("") == "hello from disk", "read after prefetch");
+
+    const fs::path optional_dir = root / "optional";
+    fs::create_directories(optional_dir);
+    tinyvfs::Vfs miss_vfs;
+    t.check(miss_vfs.mount_disk("opt", optional_dir) && miss_vfs.mount_disk("opt", shaders), "mount miss cache layers");
+    t.check(!miss_vfs.has_miss_cache(), "miss cache off by default");
+    miss_vfs.set_miss_cache(true);
+    t.check(miss_vfs.has_miss_cache(), "miss cache enabled");
+    t.check(!miss_vfs.exists_file("opt/basic.hlsl.meta") && !miss_vfs.read_file("opt/basic.fr.hlsl"),
+        "optional files missing");
+    t.check(miss_vfs.miss_cache_size() == 2, "misses recorded");
+    t.check(miss_vfs.exists_file("opt/basic.hlsl") && miss_vfs.miss_cache_size() == 2, "hits are not recorded");
+    t.check(write_text_file(optional_dir / "basic.hlsl.meta", "meta"), "create file behind the vfs");
+    t.check(!miss_vfs.exists_file("opt/basic.hlsl.meta") && !miss_vfs.open("opt/basic.hlsl.meta"),
+        "cached miss skips backends");
+    miss_vfs.clear_miss_cache();
+    t.check(miss_vfs.exists_file("opt/basic.hlsl.meta"), "clear_miss_cache");
+    t.check(!miss_vfs.read_file("opt/basic.fr.hlsl") && miss_vfs.miss_cache_size() == 1, "read miss recorded again");
+    t.check(miss_vfs.write_file("opt/basic.fr.hlsl", "fr", 2) == tinyvfs::Result::ok &&
+            miss_vfs.read_text("opt/basic.fr.hlsl").value_or("") == "fr",
+        "write_file drops cached miss");
+    t.check(!miss_vfs.exists_file("opt/basic.de.hlsl") && miss_vfs.miss_cache_size() == 1, "miss before mount");
+    t.check(miss_vfs.mount_disk("extra", content) && miss_vfs.has_miss_cache() && miss_vfs.miss_cache_size() == 0,
+        "mount starts a new miss cache");
+    miss_vfs.set_miss_cache(false);
+    t.check(!miss_vfs.has_miss_cache() && miss_vfs.miss_cache_size() == 0, "miss cache disabled");
+    miss_vfs.set_miss_cache(true, 4);
+    for (int i = 0; i < 200; ++i)
+        miss_vfs.exists_file("opt/absent" + std::to_string(i));
+    t.check(miss_vfs.miss_cache_size() <= 16 && miss_vfs.exists_file("opt/basic.hlsl"), "bounded miss cache");
+    std::vector<std::thread> miss_threads;
+    std::atomic<int> miss_wrong{0};
+    for (int w = 0; w < 4; ++w)
+        miss_threads.emplace_back([&, w]
+        {
+            for (int i = 0; i < 200; ++i)
+                if (miss_vfs.exists_file("opt/absent" + std::to_string((i * 7 + w) % 50)) ||
+                    !miss_vfs.exists_file("opt/basic.hlsl"))
+                    ++miss_wrong;
+        });
+    for (std::thread& thread : miss_threads)
+        thread.join();
+    t.check(miss_wrong == 0, "sharded miss cache under concurrent probes");
+    miss_vfs.set_miss_cache(false);
+
+#if defined(__linux__) || defined(_WIN32)
+    const fs::path live_base = root / "live_base";
+    const fs::path live_top = root / "live_top";
+    fs::create_directories(live_base);
+    fs::create_directories(live_top);
+    t.check(write_text_file(live_base / "a.txt", "one"), "write watched file");
+    auto live_cache = std::make_shared<tinyvfs::CachingBackend>(
+        std::make_shared<tinyvfs::SubtreeBackend>(std::make_shared<tinyvfs::DiskBackend>(), live_top), 1u << 20);
+    tinyvfs::Vfs live_vfs;
+    t.check(live_vfs.mount_disk("live", live_base) && live_vfs.mount("live", live_cache), "mount watched layers");
+    live_vfs.set_stat_cache(true);
+    live_vfs.set_miss_cache(true);
+    t.check(live_vfs.build_index(), "index watched layers");
+    t.check(live_vfs.set_watching(true) == 2, "watch both layers");
+
+    std::vector<std::pair<tinyvfs::ChangeKind, std::string>> changes;
+    auto poll_live = [&]
+    {
+        changes.clear();
+        return live_vfs.poll_changes([&](tinyvfs::ChangeKind kind, std::string_view path)
+        {
+            changes.emplace_back(kind, std::string(path));
+        });
+    };
+    auto changed = [&](tinyvfs::ChangeKind kind, std::string_view path)
+    {
+        return changes.size() == 1 && changes[0].first == kind && changes[0].second == path;
+    };
+
+    t.check(poll_live() && changes.empty(), "no changes yet");
+    t.check(live_vfs.read_text("live/a.txt").value_or("") == "one" && !live_vfs.exists_file("live/new.txt") &&
+            live_vfs.stat("live/a.txt") && live_vfs.stat("live/a.txt")->size == 3,
+        "watched state before edits");
+
+    t.check(write_text_file(live_base / "new.txt", "new"), "create file externally");
+    t.check(poll_live() && changed(tinyvfs::ChangeKind::added, "live/new.txt"), "added event");
+    t.check(live_vfs.exists_file("live/new.txt") && live_vfs.read_text("live/new.txt").value_or("") == "new",
+        "added file visible through index and miss cache");
+
+    t.check(write_text_file(live_base / "a.txt", "two!"), "modify file externally");
+    t.check(poll_live() && changed(tinyvfs::ChangeKind::modified, "live/a.txt"), "modified event");
+    t.check(live_vfs.stat("live/a.txt") && live_vfs.stat("live/a.txt")->size == 4, "stat cache updated");
+
+    t.check(write_text_file(live_top / "a.txt", "top"), "shadow file externally");
+    t.check(poll_live() && changed(tinyvfs::ChangeKind::modified, "live/a.txt"), "shadowing file reported as modified");
+    t.check(live_vfs.read_text("live/a.txt").value_or("") == "top", "index follows the new winner");
+    t.check(write_text_file(live_top / "a.txt", "top2"), "modify cached file externally");
+    t.check(poll_live() && live_vfs.read_text("live/a.txt").value_or("") == "top2", "content cache invalidated");
+    t.check(write_text_file(live_base / "a.txt", "hidden"), "modify shadowed file");
+    t.check(poll_live() && changes.empty(), "shadowed change not reported");
+
+    fs::remove(live_top / "a.txt");
+    t.check(poll_live() && changed(tinyvfs::ChangeKind::modified, "live/a.txt"), "unshadowed file reported as modified");
+    t.check(live_vfs.read_text("live/a.txt").value_or("") == "hidden", "lower layer serves again");
+    fs::remove(live_base / "new.txt");
+    t.check(poll_live() && changed(tinyvfs::ChangeKind::removed, "live/new.txt"), "removed event");
+    t.check(!live_vfs.exists_file("live/new.txt") && !live_vfs.stat("live/new.txt"), "removed file gone");
+
+    t.check(write_text_file(live_base / "sub" / "x.txt", "x"), "create directory externally");
+    t.check(poll_live() && changed(tinyvfs::ChangeKind::added, "live/sub/x.txt"), "new directory contents reported");
+    t.check(write_text_file(live_base / "sub" / "y.txt", "y"), "create file in new directory");
+    t.check(poll_live() && changed(tinyvfs::ChangeKind::added, "live/sub/y.txt"), "new directory is watched");
+    t.check(live_vfs.write_file("live/sub/z.txt", "z", 1, tinyvfs::WriteOptions{true, false}) == tinyvfs::Result::ok,
+        "atomic write through the vfs");
+    t.check(poll_live() && changed(tinyvfs::ChangeKind::added, "live/sub/z.txt"), "atomic write temp file coalesced away");
+    std::error_code rename_ec;
+    fs::rename(live_base / "sub", root / "moved_sub", rename_ec);
+    t.check(!rename_ec && !poll_live(), "moved directory reports lost changes");
+    t.check(!live_vfs.exists_file("live/sub/x.txt") && live_vfs.has_index(), "index rebuilt after lost changes");
+    t.check(live_vfs.set_watching(false) == 0, "stop watching");
+#endif
+
+    auto memory = std::make_shared<tinyvfs::MemoryBackend>(4096);
+    tinyvfs::Vfs memory_vfs;
+    t.check(memory_vfs.mount("gen", memory), "mount memory backend");
+    const std::string generated = "float4 main() : SV_Target { return 0.5; }";
+    t.check(memory_vfs.write_file("gen/shaders/tint.hlsl", generated.data(), generated.size()) == tinyvfs::Result::ok,
+        "memory write creates parents");
+    t.check(memory_vfs.write_file_gather("gen/config/baked.ini", {{"a=1\n", 4}, {"b=2\n", 4}}) == tinyvfs::Result::ok,
+        "memory gathered write");
+    t.check(memory_vfs.read_text("gen/config/baked.ini").value_or("") == "a=1\nb=2\n", "memory gathered read");
+    auto memory_blob = memory_vfs.read_file("gen/shaders/tint.hlsl");
+    auto memory_view = memory_vfs.map_file("gen/shaders/tint.hlsl");
+    t.check(memory_blob && memory_view && memory_blob->to_string() == generated &&
+            memory_blob->data() == memory_view->data(),
+        "memory reads and maps alias stored bytes");
+    t.check(memory_vfs.exists_dir("gen/shaders") && !memory_vfs.exists_file("gen/shaders") &&
+            !memory_vfs.exists_file("gen/shaders/missing.hlsl"),
+        "memory exists checks");
+    auto memory_stat = memory_vfs.stat("gen/config/baked.ini");
+    t.check(memory_stat && memory_stat->type == tinyvfs::FileType::file && memory_stat->size == 8 &&
+            memory_stat->mtime_ns > 0,
+        "memory stat");
+    t.check(memory_vfs.write_file("gen/shaders/tint.hlsl", "new", 3) == tinyvfs::Result::ok &&
+            memory_vfs.read_text("gen/shaders/tint.hlsl").value_or("") == "new" &&
+            memory_blob->to_string() == generated,
+        "memory overwrite leaves earlier blobs intact");
+    t.check(memory->write_file("shaders/tint.hlsl/nested", "x", 1) == tinyvfs::Result::io_error &&
+            memory->write_file("shaders", "x", 1) == tinyvfs::Result::io_error,
+        "memory write conflicts with existing entries");
+    t.check(memory->write_blob("big/blob.bin", tinyvfs::Blob::allocate(10000)) == tinyvfs::Result::ok,
+        "memory adopts blob");
+    std::string large(3000, 'L');
+    t.check(memory_vfs.write_file("gen/big/large.bin", large.data(), large.size()) == tinyvfs::Result::ok &&
+            memory_vfs.read_text("gen/big/large.bin").value_or("") == large,
+        "memory large file gets its own block");
+    std::vector<std::string> memory_files;
+    memory_vfs.list_files("gen/config", {}, [&](std::string_view name) { memory_files.emplace_back(name); });
+    std::vector<std::string> memory_dirs;
+    memory_vfs.list_dirs("gen", [&](std::string_view name) { memory_dirs.emplace_back(name); });
+    std::vector<std::string> memory_walk;
+    memory_vfs.walk("gen", {"hlsl", "ini"}, [&](std::string_view name) { memory_walk.emplace_back(name); });
+    t.check(memory_files.size() == 1 && memory_files[0] == "baked.ini", "memory list_files");
+    t.check(memory_dirs.size() == 3 && contains(memory_dirs, "big") && contains(memory_dirs, "config") &&
+            contains(memory_dirs, "shaders"),
+        "memory list_dirs");
+    t.check(memory_walk.size() == 2 && contains(memory_walk, "shaders/tint.hlsl") && contains(memory_walk, "config/baked.ini"),
+        "memory walk");
+    t.check(memory->file_count() == 4 && memory->stored_bytes() == 3 + 8 + 10000 + large.size(), "memory accounting");
+    t.check(memory->remove("big") && !memory_vfs.exists_file("gen/big/large.bin") && memory->file_count() == 2,
+        "memory remove directory");
+    t.check(memory->remove("shaders/tint.hlsl") && !memory->remove("shaders/tint.hlsl") && memory->exists_dir("shaders"),
+        "memory remove file");
+    memory->clear();
+    t.check(memory->file_count() == 0 && memory->stored_bytes() == 0 && !memory_vfs.exists_dir("gen/config"),
+        "memory clear");
+
+    // Needs a case-sensitive file system to tell the modes apart.
+#if !defined(_WIN32) && !defined(__APPLE__)
+    const fs::path mixed = root / "Mixed";
+    t.check(write_text_file(mixed / "Textures" / "Albedo.PNG", "albedo") &&
+            write_text_file(mixed / "Textures" / "Normal.png", "upper") &&
+            write_text_file(mixed / "Textures" / "normal.png", "lower"),
+        "write mixed-case files");
+    tinyvfs::Vfs exact_vfs;
+    t.check(exact_vfs.mount_disk("mixed", mixed), "mount case-sensitive disk");
+    t.check(!exact_vfs.exists_file("mixed/textures/albedo.png"), "case-sensitive by default");
+    tinyvfs::Vfs folded_vfs;
+    t.check(folded_vfs.mount_disk("mixed", mixed, tinyvfs::DiskBackendOptions{true}), "mount case-insensitive disk");
+    t.check(folded_vfs.exists_file("mixed/textures/albedo.png") && folded_vfs.exists_dir("mixed/TEXTURES") &&
+            folded_vfs.read_text("mixed/TEXTURES/albedo.png").value_or("") == "albedo" &&
+            folded_vfs.map_file("mixed/textures/ALBEDO.png") && folded_vfs.open("mixed/textures/Albedo.png") &&
+            folded_vfs.stat("mixed/textures/albedo.png"),
+        "case-insensitive lookups");
+    t.check(folded_vfs.read_text("mixed/textures/Normal.png").value_or("") == "upper" &&
+            folded_vfs.read_text("mixed/textures/normal.png").value_or("") == "lower",
+        "exact spelling wins over folded match");
+    t.check(!folded_vfs.exists_file("mixed/textures/missing.png") && !folded_vfs.exists_file("mixed/albedo.png"),
+        "case-insensitive misses");
+    t.check(write_text_file(mixed / "Textures" / "Late.png", "late"), "create file behind the backend");
+    t.check(folded_vfs.exists_file("mixed/textures/late.png"), "changed directory relisted");
+    t.check(folded_vfs.write_file("mixed/textures/albedo.png", "new", 3) == tinyvfs::Result::ok &&
+            exact_vfs.read_text("mixed/Textures/Albedo.PNG").value_or("") == "new",
+        "write overwrites existing spelling");
+    t.check(folded_vfs.write_file("mixed/textures/Fresh.png", "fresh", 5) == tinyvfs::Result::ok &&
+            exact_vfs.exists_file("mixed/Textures/Fresh.png") && folded_vfs.exists_file("mixed/textures/fresh.png"),
+        "write creates file in matching directory");
+    std::vector<std::string> folded_files;
+    folded_vfs.list_files("mixed/TEXTURES", {}, [&](std::string_view name) { folded_files.emplace_back(name); });
+    std::vector<std::string> folded_walk;
+    folded_vfs.walk("mixed/textures", {"png"}, [&](std::string_view name) { folded_walk.emplace_back(name); });
+    t.check(folded_files.size() == 5 && contains(folded_files, "Albedo.PNG") && folded_walk.size() == 5 &&
+            contains(folded_walk, "Albedo.PNG"),
+        "case-insensitive listing and extension filter");
+    size_t exact_listed = 0;
+    size_t missing_listed = 0;
+    folded_vfs.list_files("mixed/Textures", {}, [&](std::string_view) { ++exact_listed; });
+    folded_vfs.list_files("mixed/nothing", {}, [&](std::string_view) { ++missing_listed; });
+    folded_vfs.walk("mixed/NOTHING", {}, [&](std::string_view) { ++missing_listed; });
+    t.check(exact_listed == 5 && missing_listed == 0, "case-insensitive listing of exact spellings and misses");
+    tinyvfs::detail::FoldedNames folded_names(mixed);
+    std::string respelled;
+    const std::string mixed_text = mixed.lexically_normal().generic_string();
+    t.check(folded_names.resolve(mixed_text + "/TEXTURES/albedo.png", respelled, false) &&
+            respelled == mixed_text + "/Textures/Albedo.PNG",
+        "folding starts below the base directory");
+#endif
+
+    const fs::path direct = root / "direct";
+    const size_t direct_sizes[] = {0, 1, 4095, 4096, 4097, (3u << 20) + 123};
+    std::vector<std::string> direct_data;
+    for (size_t size : direct_sizes)
+    {
+        std::string& bytes = direct_data.emplace_back(size, '\0');
+        for (size_t i = 0; i < size; ++i)
+            bytes[i] = static_cast<char>((i * 31 + size) % 251);
+        t.check(write_text_file(direct / ("f" + std::to_string(size) + ".bin"), bytes), "write direct test file");
+    }
+    tinyvfs::DiskBackendOptions direct_options;
+    direct_options.direct_io_threshold = 1;
+    tinyvfs::Vfs direct_vfs;
+    t.check(direct_vfs.mount_disk("bulk", direct, direct_options), "mount disk with direct I/O");
+    bool direct_reads = true;
+    for (size_t i = 0; i < direct_data.size(); ++i)
+    {
+        std::string name = "bulk/f" + std::to_string(direct_sizes[i]) + ".bin";
+        auto blob = direct_vfs.read_file(name);
+        direct_reads = direct_reads && blob && blob->to_string() == direct_data[i];
+        auto allocated = direct_vfs.read_file(name, allocator);
+        direct_reads = direct_reads && allocated && allocated->to_string() == direct_data[i];
+    }
+    t.check(direct_reads, "direct reads match file contents");
+    auto direct_file = direct_vfs.open("bulk/f3145851.bin");
+    std::string direct_slice(10000, '\0');
+    t.check(direct_file && direct_file->read_at(4093, direct_slice.data(), direct_slice.size()) == direct_slice.size() &&
+            direct_slice == direct_data.back().substr(4093, 10000),
+        "direct read_at at unaligned offset");
+    t.check(direct_file && direct_file->read_at(direct_data.back().size() - 5, direct_slice.data(), 100) == 5 &&
+            direct_slice.compare(0, 5, direct_data.back(), direct_data.back().size() - 5, 5) == 0,
+        "direct read_at stops at end of file");
+    tinyvfs::DiskBackend direct_backend(direct_options);
+    t.check(direct_backend.prefetch((direct / "f4096.bin").generic_string()) &&
+            !direct_backend.prefetch((direct / "missing.bin").generic_string()),
+        "direct prefetch skips the OS cache");
+
+    const fs::path snap_base = root / "snap_base";
+    const fs::path snap_top = root / "snap_top";
+    t.check(write_text_file(snap_base / "maps" / "a.map", "base a") && write_text_file(snap_base / "maps" / "b.map", "base b") &&
+            write_text_file(snap_top / "maps" / "a.map", "top a"),
+        "write snapshot layers");
+    // Older directory mtimes, so later additions change them even on coarse clocks.
+    const auto snap_old = fs::file_time_type::clock::now() - std::chrono::hours(1);
+    std::error_code snap_ec;
+    for (const fs::path& dir : {snap_base, snap_base / "maps", snap_top, snap_top / "maps"})
+        fs::last_write_time(dir, snap_old, snap_ec);
+    const fs::path snap_file = root / "index.tvfsidx";
+    auto snap_mount = [&](tinyvfs::Vfs& target)
+    {
+        return target.mount_disk("snap", snap_base) && target.mount_disk("snap", snap_top);
+    };
+    tinyvfs::Vfs snap_source;
+    t.check(snap_mount(snap_source) && snap_source.save_index(snap_file) == tinyvfs::Result::not_found,
+        "save_index needs an index");
+    t.check(snap_source.build_index() && snap_source.save_index(snap_file, "build-7") == tinyvfs::Result::ok,
+        "save_index");
+    tinyvfs::Vfs snap_vfs;
+    t.check(snap_mount(snap_vfs), "mount snapshot layers");
+    t.check(!snap_vfs.load_index(snap_file, tinyvfs::IndexCheck::directories, "build-8") && !snap_vfs.has_index(),
+        "load_index rejects another stamp");
+    t.check(snap_vfs.load_index(snap_file, tinyvfs::IndexCheck::files, "build-7") && snap_vfs.has_index(), "load_index");
+    t.check(snap_vfs.read_text("snap/maps/a.map").value_or("") == "top a" &&
+            snap_vfs.read_text("snap/maps/b.map").value_or("") == "base b" && !snap_vfs.exists_file("snap/maps/c.map"),
+        "loaded index resolves winning mounts");
+    tinyvfs::Vfs snap_other;
+    t.check(snap_other.mount_disk("snap", snap_base) && !snap_other.load_index(snap_file, tinyvfs::IndexCheck::none, "build-7"),
+        "load_index rejects other mount roots");
+    t.check(snap_vfs.write_file("snap/maps/c.map", "written", 7) == tinyvfs::Result::ok &&
+            snap_vfs.read_text("snap/maps/c.map").value_or("") == "written",
+        "write through loaded index");
+    // Another file: Windows cannot replace one that is still mapped.
+    const fs::path snap_resaved = root / "resaved.tvfsidx";
+    t.check(snap_vfs.save_index(snap_resaved, "build-7") == tinyvfs::Result::ok, "save loaded index");
+    tinyvfs::Vfs snap_again;
+    t.check(snap_mount(snap_again) && snap_again.load_index(snap_resaved, tinyvfs::IndexCheck::directories, "build-7") &&
+            snap_again.read_text("snap/maps/c.map").value_or("") == "written",
+        "resaved index keeps written files");
+    t.check(write_text_file(snap_base / "maps" / "d.map", "behind"), "add file behind the snapshot");
+    tinyvfs::Vfs snap_stale;
+    t.check(snap_mount(snap_stale) && !snap_stale.load_index(snap_file, tinyvfs::IndexCheck::directories, "build-7") &&
+            snap_stale.load_index(snap_file, tinyvfs::IndexCheck::none, "build-7"),
+        "directory check catches added files");
+    fs::last_write_time(snap_top / "maps" / "a.map", snap_old, snap_ec);
+    t.check(!snap_stale.load_index(snap_file, tinyvfs::IndexCheck::files, "build-7"), "file check catches edits");
+    // A copy, since the loaded index keeps the original mapped.
+    const fs::path snap_truncated = root / "truncated.tvfsidx";
+    fs::copy_file(snap_file, snap_truncated, snap_ec);
+    fs::resize_file(snap_truncated, fs::file_size(snap_file) - 1, snap_ec);
+    t.check(!snap_ec && !snap_stale.load_index(snap_truncated, tinyvfs::IndexCheck::none, "build-7"),
+        "load_index rejects truncated snapshot");
+
+    auto static_memory = std::make_shared<tinyvfs::MemoryBackend>();
+    static_memory->write_file("notes.txt", "in memory", 9);
+    const tinyvfs::StaticVfs static_vfs(
+        tinyvfs::static_disk("static", content),
+        tinyvfs::static_disk("static", overlay),
+        tinyvfs::static_mount("static/mem", static_memory));
+    t.check(static_vfs.valid(), "static vfs layers are valid");
+    t.check(static_vfs.read_text("static/hello.txt").value_or("") == "hello from overlay" &&
+            static_vfs.read_text("/static/./textures//albedo.txt").value_or("") == "albedo",
+        "static vfs reads newest layer first");
+    t.check(static_vfs.exists_file("static/overlay.txt") && !static_vfs.exists_file("static/missing.txt") &&
+            !static_vfs.exists_file("other/hello.txt") && !static_vfs.exists_file("../static/hello.txt"),
+        "static vfs exists_file");
+    t.check(static_vfs.exists_dir("") && static_vfs.exists_dir("static/mem") && static_vfs.exists_dir("static/textures") &&
+            !static_vfs.exists_dir("static/hello.txt"),
+        "static vfs exists_dir");
+    auto static_stat = static_vfs.stat("static/mem/notes.txt");
+    t.check(static_stat && static_stat->size == 9, "static vfs stat through smart pointer layer");
+    auto static_file = static_vfs.open("static/textures/albedo.txt");
+    t.check(static_file && static_file->size() == 6, "static vfs open");
+    auto static_view = static_vfs.map_file("static/hello.txt");
+    t.check(static_view && static_view->size() == 18, "static vfs map_file");
+    t.check(static_vfs.write_file("static/mem/new.txt", "new", 3) == tinyvfs::Result::ok &&
+            static_memory->exists_file("new.txt") && static_vfs.write_file("nowhere/x.txt", "x", 1) == tinyvfs::Result::not_found,
+        "static vfs writes to the newest matching layer");
+    tinyvfs::Vfs dynamic_vfs;
+    t.check(dynamic_vfs.mount_disk("static", content) && dynamic_vfs.mount_disk("static", overlay) &&
+            dynamic_vfs.mount("static/mem", static_memory),
+        "mount dynamic twin of static vfs");
+    auto same_listing = [&](auto&& list)
+    {
+        std::vector<std::string> from_static;
+        std::vector<std::string> from_dynamic;
+        tinyvfs::Result static_result = list(static_vfs, from_static);
+        tinyvfs::Result dynamic_result = list(dynamic_vfs, from_dynamic);
+        std::sort(from_static.begin(), from_static.end());
+        std::sort(from_dynamic.begin(), from_dynamic.end());
+        return static_result == dynamic_result && from_static == from_dynamic && !from_static.empty();
+    };
+    t.check(same_listing([](const auto& v, std::vector<std::string>& out)
+            {
+                return v.list_files("static", {}, [&](std::string_view name) { out.emplace_back(name); });
+            }),
+        "static vfs list_files dedups layers like vfs");
+    t.check(same_listing([](const auto& v, std::vector<std::string>& out)
+            {
+                return v.list_dirs("static", [&](std::string_view name) { out.emplace_back(name); });
+            }) &&
+            same_listing([](const auto& v, std::vector<std::string>& out)
+            {
+                return v.list_dirs("", [&](std::string_view name) { out.emplace_back(name); });
+            }),
+        "static vfs list_dirs includes layer roots");
+    t.check(same_listing([](const auto& v, std::vector<std::string>& out)
+            {
+                return v.walk("", {"txt"}, [&](std::string_view name) { out.emplace_back(name); });
+            }) &&
+            same_listing([](const auto& v, std::vector<std::string>& out)
+            {
+                return v.walk("static/mem", {}, [&](std::string_view name) { out.emplace_back(name); });
+            }),
+        "static vfs walk matches vfs");
+    t.check(static_vfs.list_files("nowhere", {}, [](std::string_view) {}) == tinyvfs::Result::not_found &&
+            static_vfs.walk("../x", {}, [](std::string_view) {}) == tinyvfs::Result::invalid_path,
+        "static vfs listing misses");
+    const tinyvfs::StaticVfs static_bad(tinyvfs::static_mount("../up", std::shared_ptr<tinyvfs::MemoryBackend>()));
+    t.check(!static_bad.valid() && !static_bad.exists_file("../up/x"), "static vfs rejects bad layers");
+
+#if TINYVFS_ENABLE_STATS
+    tinyvfs::Vfs traced_vfs;
+    t.check(traced_vfs.mount_disk("layered", content) && traced_vfs.mount_disk("layered", shaders), "mount traced layers");
+    size_t trace_begins = 0;
+    std::vector<tinyvfs::TraceEvent> trace_ends;
+    std::vector<std::string> trace_paths;
+    tinyvfs::TraceHooks hooks;
+    hooks.begin = [&](tinyvfs::TraceOp, std::string_view) { ++trace_begins; };
+    hooks.end = [&](const tinyvfs::TraceEvent& event)
+    {
+        trace_ends.push_back(event);
+        trace_paths.emplace_back(event.path);
+    };
+    traced_vfs.set_trace_hooks(std::move(hooks));
+    t.check(traced_vfs.read_text("layered/hello.txt").value_or("") == "hello from disk", "traced read");
+    t.check(!traced_vfs.exists_file("layered/missing.txt"), "traced miss");
+    t.check(traced_vfs.read_text("layered/basic.hlsl").has_value(), "traced top layer read");
+    t.check(trace_begins == 3 && trace_ends.size() == 3, "trace hooks bracket each operation");
+    t.check(trace_ends.size() == 3 && trace_ends[0].op == tinyvfs::TraceOp::read_file && trace_ends[0].found &&
+            trace_ends[0].bytes == 15 && trace_ends[0].probes == 2 && trace_paths[0] == "layered/hello.txt",
+        "trace event for a read through two layers");
+    t.check(trace_ends.size() == 3 && trace_ends[1].op == tinyvfs::TraceOp::exists_file && !trace_ends[1].found &&
+            trace_ends[1].probes == 2,
+        "trace event for a miss");
+
+    tinyvfs::VfsStats io = traced_vfs.io_stats();
+    t.check(io[tinyvfs::TraceOp::read_file].count == 2 && io[tinyvfs::TraceOp::exists_file].count == 1,
+        "latency histograms count operations");
+    t.check(io[tinyvfs::TraceOp::read_file].percentile_ns(0.5) <= io[tinyvfs::TraceOp::read_file].max_ns,
+        "percentile bounded by max");
+    t.check(io.probes[0] == 1 && io.probes[1] == 1, "probe depth of resolved lookups");
+    t.check(io.mounts.size() == 2 && io.mounts[0].mount == "layered" && io.mounts[0].hits == 1 &&
+            io.mounts[0].misses == 1 && io.mounts[0].bytes_read == 15,
+        "bottom layer counters");
+    t.check(io.mounts.size() == 2 && io.mounts[1].hits == 1 && io.mounts[1].misses == 2, "top layer counters");
+    t.check(traced_vfs.mount_disk("other", content) && traced_vfs.io_stats().mounts[0].hits == 1,
+        "mount counters survive remounting");
+    traced_vfs.set_trace_hooks(tinyvfs::TraceHooks());
+    traced_vfs.exists_file("layered/hello.txt");
+    t.check(trace_ends.size() == 3, "empty hooks stop tracing");
+    traced_vfs.reset_io_stats();
+    io = traced_vfs.io_stats();
+    t.check(io[tinyvfs::TraceOp::exists_file].count == 0 && io.mounts[1].misses == 0, "reset_io_stats");
+#endif
+
     std::error_code ec;
     fs::remove_all(root, ec);
 
@@ -3,7 +3,17 @@
 
 #pragma once
 
+// Define TINYVFS_ENABLE_STATS to 1 before including this header to collect Vfs I/O
+// statistics and call trace hooks. By default both compile out entirely.
+#if !defined(TINYVFS_ENABLE_STATS)
+#define TINYVFS_ENABLE_STATS 0
+#endif
+
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
 #include <cstddef>
 #include <cstring>
 #if defined(__has_include)
@@ -20,14 +30,56 @@
 #include <filesystem>
 #define TINYVFS_HAS_STD_FS 1
 #endif
+#if defined(_WIN32)
+#if !defined(WIN32_LEAN_AND_MEAN)
+#define WIN32_LEAN_AND_MEAN
+#define TINYVFS_DEFINED_LEAN_AND_MEAN
+#endif
+#if !defined(NOMINMAX)
+#define NOMINMAX
+#define TINYVFS_DEFINED_NOMINMAX
+#endif
+#include <windows.h>
+#if defined(TINYVFS_DEFINED_LEAN_AND_MEAN)
+#undef WIN32_LEAN_AND_MEAN
+#undef TINYVFS_DEFINED_LEAN_AND_MEAN
+#endif
+#if defined(TINYVFS_DEFINED_NOMINMAX)
+#undef NOMINMAX
+#undef TINYVFS_DEFINED_NOMINMAX
+#endif
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
 #include <fstream>
 #include <functional>
+#include <future>
 #include <initializer_list>
+#include <list>
+#include <map>
 #include <memory>
+#include <new>
+#include <mutex>
 #include <optional>
+#include <set>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
 #include <unordered_set>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -45,493 +97,8450 @@ namespace tinyvfs
         not_found,
         io_error,
         not_supported,
-        invalid_path
+        invalid_path,
+        buffer_too_small,
+        cancelled
+    };
+
+    // Storage hook for Blob contents, e.g. an arena, a frame allocator or an upload heap.
+    // Blobs keep a raw pointer to it for deallocate(), so the allocator must outlive
+    // every Blob it backs, copies included.
+    class BlobAllocator
+    {
+    public:
+        virtual ~BlobAllocator() = default;
+
+        virtual void* allocate(size_t size, size_t alignment) = 0;
+        virtual void deallocate(void* ptr, size_t size, size_t alignment) noexcept = 0;
     };
 
-    struct Blob
+    // File contents. Copies share one immutable buffer; the owner keeps it alive.
+    class Blob
     {
-        std::vector<std::byte> bytes;
+    public:
+        Blob() = default;
+
+        // Wraps storage held by `owner`, such as a file mapping or a cached buffer.
+        Blob(const std::byte* data, size_t size, std::shared_ptr<const void> owner)
+            : data_(data)
+            , size_(size)
+            , owner_(std::move(owner))
+        {
+        }
+
+        // Returns uninitialised storage for a backend to fill through mutable_data()
+        // before handing the blob out. A null allocator uses the global heap; any other
+        // must outlive the blob and all its copies.
+        static Blob allocate(size_t size,
+            BlobAllocator* allocator = nullptr,
+            size_t alignment = alignof(std::max_align_t))
+        {
+            if (size == 0)
+                return Blob();
+
+            void* ptr = nullptr;
+            std::shared_ptr<const void> owner;
+            if (allocator)
+            {
+                ptr = allocator->allocate(size, alignment);
+                if (!ptr)
+                    return Blob();
+                owner = std::shared_ptr<const void>(ptr, [allocator, size, alignment](const void* p)
+                {
+                    allocator->deallocate(const_cast<void*>(p), size, alignment);
+                });
+            }
+            else
+            {
+                ptr = ::operator new(size, std::align_val_t(alignment));
+                owner = std::shared_ptr<const void>(ptr, [alignment](const void* p)
+                {
+                    ::operator delete(const_cast<void*>(p), std::align_val_t(alignment));
+                });
+            }
+
+            return Blob(static_cast<const std::byte*>(ptr), size, std::move(owner));
+        }
+
+        static Blob copy(const void* data, size_t size, BlobAllocator* allocator = nullptr)
+        {
+            Blob blob = allocate(size, allocator);
+            if (size > 0 && blob.size() == size)
+                std::memcpy(blob.mutable_data(), data, size);
+            return blob;
+        }
+
+        bool empty() const noexcept { return size_ == 0; }
+        size_t size() const noexcept { return size_; }
+        const std::byte* data() const noexcept { return data_; }
+        const std::shared_ptr<const void>& owner() const noexcept { return owner_; }
 
-        bool empty() const noexcept { return bytes.empty(); }
-        size_t size() const noexcept { return bytes.size(); }
-        const std::byte* data() const noexcept { return bytes.data(); }
+        // Only valid on blobs from allocate() that have not been shared yet.
+        std::byte* mutable_data() noexcept { return const_cast<std::byte*>(data_); }
 
         std::string_view as_string_view() const
         {
-            return std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+            return std::string_view(reinterpret_cast<const char*>(data_), size_);
         }
 
         std::string to_string(bool append_null = false) const
         {
             std::string text;
-            text.resize(bytes.size() + (append_null ? 1 : 0));
-            if (!bytes.empty())
-                std::memcpy(text.data(), bytes.data(), bytes.size());
+            text.resize(size_ + (append_null ? 1 : 0));
+            if (size_ > 0)
+                std::memcpy(text.data(), data_, size_);
             if (append_null)
                 text.back() = '\0';
             return text;
         }
-    };
-
-    using EnumerateFn = std::function<void(std::string_view)>;
-
-    class Backend
-    {
-    public:
-        virtual ~Backend() = default;
 
-        virtual bool exists_file(std::string_view path) = 0;
-        virtual bool exists_dir(std::string_view path) = 0;
-        virtual std::optional<Blob> read_file(std::string_view path) = 0;
-        virtual Result write_file(std::string_view path, const void* data, size_t size) = 0;
-        virtual Result list_files(std::string_view path,
-            const std::vector<std::string_view>& extensions,
-            const EnumerateFn& callback,
-            bool allow_duplicates = false) = 0;
-        virtual Result list_dirs(std::string_view path,
-            const EnumerateFn& callback,
-            bool allow_duplicates = false) = 0;
+    private:
+        const std::byte* data_ = nullptr;
+        size_t size_ = 0;
+        std::shared_ptr<const void> owner_;
     };
 
-    namespace detail
+    // Read-only view of file contents. The owner keeps the backing storage (a file
+    // mapping or a heap buffer) alive for as long as any copy of the view exists.
+    class FileView
     {
-        inline bool normalize_virtual_path(std::string_view input, std::string& out)
+    public:
+        FileView() = default;
+        FileView(const std::byte* data, size_t size, std::shared_ptr<const void> owner)
+            : data_(data)
+            , size_(size)
+            , owner_(std::move(owner))
         {
-            fs::path p(input);
-            if (p.has_root_name())
-                return false;
+        }
 
-            p = p.lexically_normal();
+        bool empty() const noexcept { return size_ == 0; }
+        size_t size() const noexcept { return size_; }
+        const std::byte* data() const noexcept { return data_; }
+        const std::shared_ptr<const void>& owner() const noexcept { return owner_; }
 
-            for (const auto& part : p)
-            {
-                if (part == "..")
-                    return false;
-            }
+        std::string_view as_string_view() const
+        {
+            return std::string_view(reinterpret_cast<const char*>(data_), size_);
+        }
 
-            std::string s = p.generic_string();
-            if (s == "." || s == "/")
-            {
-                out.clear();
-                return true;
-            }
+    private:
+        const std::byte* data_ = nullptr;
+        size_t size_ = 0;
+        std::shared_ptr<const void> owner_;
+    };
 
-            while (!s.empty() && s.front() == '/')
-                s.erase(s.begin());
-            while (!s.empty() && s.back() == '/')
-                s.pop_back();
+    // Random-access reader returned by Backend::open_file. read_at does not move a shared
+    // cursor, so a handle can serve reads from several threads.
+    class FileHandle
+    {
+    public:
+        virtual ~FileHandle() = default;
 
-            if (s == ".")
-                s.clear();
+        virtual std::uint64_t size() const = 0;
+        // Returns the number of bytes copied; short only at end of file or on error.
+        virtual size_t read_at(std::uint64_t offset, void* dst, size_t size) = 0;
 
-            out = s;
-            return true;
-        }
+        // Non-zero for unbuffered handles: reads into buffers aligned to this, at offsets
+        // that are multiples of it, skip the handle's internal bounce buffer.
+        virtual size_t direct_alignment() const { return 0; }
+    };
 
-        inline bool relative_to_mount(std::string_view full,
-            std::string_view mount,
-            std::string& out)
+    // Handle over bytes that are already in memory or mapped.
+    class ViewFileHandle final : public FileHandle
+    {
+    public:
+        explicit ViewFileHandle(FileView view)
+            : view_(std::move(view))
         {
-            if (mount.empty())
-            {
-                out.assign(full);
-                return true;
-            }
-
-            if (full == mount)
-            {
-                out.clear();
-                return true;
-            }
+        }
 
-            if (full.size() > mount.size() &&
-                full.compare(0, mount.size(), mount) == 0 &&
-                full[mount.size()] == '/')
-            {
-                out.assign(full.substr(mount.size() + 1));
-                return true;
-            }
+        std::uint64_t size() const override { return view_.size(); }
 
-            return false;
+        size_t read_at(std::uint64_t offset, void* dst, size_t size) override
+        {
+            if (offset >= view_.size())
+                return 0;
+            size_t count = std::min(size, view_.size() - static_cast<size_t>(offset));
+            std::memcpy(dst, view_.data() + offset, count);
+            return count;
         }
 
-        inline bool child_mount_name(std::string_view parent,
-            std::string_view mount,
-            std::string& out)
-        {
-            if (mount.empty())
-                return false;
+    private:
+        FileView view_;
+    };
 
-            if (parent.empty())
-            {
-                size_t split = mount.find('/');
-                out.assign(mount.substr(0, split));
-                return true;
-            }
+    // Streaming file opened through Vfs::open: a FileHandle plus a read cursor.
+    class File
+    {
+    public:
+        explicit File(std::unique_ptr<FileHandle> handle)
+            : handle_(std::move(handle))
+        {
+        }
 
-            if (mount.size() <= parent.size())
-                return false;
+        std::uint64_t size() const { return handle_->size(); }
+        std::uint64_t tell() const noexcept { return position_; }
+        bool eof() const { return position_ >= handle_->size(); }
 
-            if (mount.compare(0, parent.size(), parent) != 0 || mount[parent.size()] != '/')
+        // Positions past the end are rejected; seeking to size() is allowed.
+        bool seek(std::uint64_t offset)
+        {
+            if (offset > handle_->size())
                 return false;
-
-            std::string_view rest = mount.substr(parent.size() + 1);
-            size_t split = rest.find('/');
-            out.assign(rest.substr(0, split));
+            position_ = offset;
             return true;
         }
 
-        inline fs::path to_os_path(std::string_view path)
+        size_t read(void* dst, size_t size)
         {
-            fs::path p(path);
-            return p.make_preferred();
+            size_t count = handle_->read_at(position_, dst, size);
+            position_ += count;
+            return count;
         }
 
-        inline bool extension_matches(std::string_view ext,
-            const std::vector<std::string_view>& extensions)
+        size_t read_at(std::uint64_t offset, void* dst, size_t size) const
         {
-            if (extensions.empty())
-                return true;
+            return handle_->read_at(offset, dst, size);
+        }
 
-            for (std::string_view entry : extensions)
-            {
-                if (entry.empty())
-                    continue;
+        FileHandle& handle() const noexcept { return *handle_; }
 
-                if (entry.front() == '.')
-                {
-                    if (ext == entry)
-                        return true;
-                }
-                else
-                {
-                    if (ext.size() == entry.size() + 1 &&
-                        ext.front() == '.' &&
-                        ext.substr(1) == entry)
-                    {
-                        return true;
-                    }
-                }
-            }
+    private:
+        std::unique_ptr<FileHandle> handle_;
+        std::uint64_t position_ = 0;
+    };
 
-            return false;
-        }
-    }
+    enum class FileType
+    {
+        file,
+        directory
+    };
 
-    class DiskBackend final : public Backend
+    // Metadata from a single backend query. mtime_ns counts nanoseconds since the Unix
+    // epoch and is 0 when the backend has no timestamps; size is 0 for directories.
+    struct FileStat
+    {
+        FileType type = FileType::file;
+        std::uint64_t size = 0;
+        std::int64_t mtime_ns = 0;
+    };
+
+    // One piece of a gathered write; pieces are written back to back.
+    struct WriteChunk
+    {
+        const void* data = nullptr;
+        size_t size = 0;
+    };
+
+    struct WriteOptions
+    {
+        // Write to a temporary file, flush it and rename it over the target, so readers
+        // and crashes see either the old or the new contents, never a partial file.
+        bool atomic = false;
+        // Reserve the final size up front; a hint that reduces fragmentation.
+        bool preallocate = false;
+        // Create missing parent directories first. Backends without real directories
+        // already do; otherwise a missing parent is Result::not_found.
+        bool create_parents = false;
+    };
+
+    template <typename Signature>
+    class FunctionRef;
+
+    // Non-owning reference to a callable, for callbacks that only run during the call.
+    // Unlike std::function it never allocates; the target must outlive the reference.
+    template <typename R, typename... Args>
+    class FunctionRef<R(Args...)>
     {
     public:
-        bool exists_file(std::string_view path) override
+        template <typename F,
+            typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, FunctionRef> &&
+                !std::is_function_v<std::remove_reference_t<F>> &&
+                std::is_invocable_r_v<R, F&, Args...>>>
+        FunctionRef(F&& target) noexcept
+            : invoke_([](Target bound, Args... args) -> R
+            {
+                return (*static_cast<std::remove_reference_t<F>*>(bound.object))(std::forward<Args>(args)...);
+            })
         {
-            std::error_code ec;
-            return fs::is_regular_file(detail::to_os_path(path), ec);
+            target_.object = const_cast<void*>(static_cast<const void*>(std::addressof(target)));
         }
 
-        bool exists_dir(std::string_view path) override
+        FunctionRef(R (*function)(Args...)) noexcept
+            : invoke_([](Target bound, Args... args) -> R
+            {
+                return bound.function(std::forward<Args>(args)...);
+            })
         {
-            std::error_code ec;
-            return fs::is_directory(detail::to_os_path(path), ec);
+            target_.function = function;
         }
 
-        std::optional<Blob> read_file(std::string_view path) override
+        R operator()(Args... args) const
         {
-            std::ifstream file(detail::to_os_path(path), std::ios::binary | std::ios::ate);
-            if (!file)
-                return std::nullopt;
-
-            std::streamsize size = file.tellg();
-            if (size < 0)
-                return std::nullopt;
-
-            Blob blob;
-            if (size > 0)
-            {
-                blob.bytes.resize(static_cast<size_t>(size));
-                file.seekg(0, std::ios::beg);
-                if (!file.read(reinterpret_cast<char*>(blob.bytes.data()), size))
-                    return std::nullopt;
-            }
-
-            return blob;
+            return invoke_(target_, std::forward<Args>(args)...);
         }
 
-        Result write_file(std::string_view path, const void* data, size_t size) override
+    private:
+        union Target
         {
-            fs::path os_path = detail::to_os_path(path);
-            fs::path parent = os_path.parent_path();
-
-            if (!parent.empty())
-            {
-                std::error_code ec;
-                if (!fs::exists(parent, ec))
-                    return Result::not_found;
-            }
+            void* object;
+            R (*function)(Args...);
+        };
 
-            std::ofstream file(os_path, std::ios::binary | std::ios::trunc);
-            if (!file)
-                return Result::io_error;
+        Target target_;
+        R (*invoke_)(Target, Args...);
+    };
 
-            if (size > 0)
-            {
-                file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
-                if (!file.good())
-                    return Result::io_error;
-            }
+    // Names are only valid during the call; copy them to keep them.
+    using EnumerateFn = std::function<void(std::string_view)>;
+    // Receives up to a batch of names at once; the views are valid during the call.
+    using EnumerateBatchFn = std::function<void(const std::string_view* names, size_t count)>;
+    // What enumeration calls take: a lambda, function or EnumerateFn is referenced,
+    // not copied, so passing one never allocates.
+    using EnumerateRef = FunctionRef<void(std::string_view)>;
+    using EnumerateBatchRef = FunctionRef<void(const std::string_view* names, size_t count)>;
+    // Receives the position of the path in the request and its contents, or nullopt.
+    using BatchReadFn = std::function<void(size_t index, std::optional<Blob> blob)>;
 
-            return Result::ok;
-        }
+    enum class ChangeKind
+    {
+        added,
+        modified,
+        removed
+    };
 
-        Result list_files(std::string_view path,
-            const std::vector<std::string_view>& extensions,
-            const EnumerateFn& callback,
-            bool allow_duplicates) override
-        {
-            fs::path dir = detail::to_os_path(path);
-            std::error_code ec;
+    // Receives one change; the path view is valid during the call.
+    using ChangeFn = FunctionRef<void(ChangeKind kind, std::string_view path)>;
 
-            if (!fs::exists(dir, ec) || !fs::is_directory(dir, ec))
-                return Result::not_found;
+    // Change notifications for one directory tree, created by Backend::watch. Polled
+    // from one thread at a time.
+    class BackendWatch
+    {
+    public:
+        virtual ~BackendWatch() = default;
 
-            std::unordered_set<std::string> seen;
+        // Reports changes since the previous call without blocking; paths are relative
+        // to the watched directory. Returns false when notifications were lost (queue
+        // overflow, a directory renamed away) and anything below the watch may differ.
+        virtual bool poll(const ChangeFn& callback) = 0;
+    };
 
-            for (fs::directory_iterator it(dir, ec), end; it != end; it.increment(ec))
-            {
-                if (ec)
-                    return Result::io_error;
+    // Vfs calls backends from whichever threads use it, so implementations mounted in a
+    // shared Vfs must tolerate concurrent calls.
+    class Backend
+    {
+    public:
+        virtual ~Backend() = default;
 
-                const fs::directory_entry& entry = *it;
-                if (!entry.is_regular_file(ec))
-                {
-                    if (ec)
-                        return Result::io_error;
-                    continue;
-                }
+        virtual bool exists_file(std::string_view path) = 0;
+        virtual bool exists_dir(std::string_view path) = 0;
+        virtual std::optional<Blob> read_file(std::string_view path) = 0;
+        virtual Result write_file(std::string_view path, const void* data, size_t size) = 0;
 
-                std::string name = entry.path().filename().generic_string();
-                std::string ext = entry.path().extension().generic_string();
-                if (!detail::extension_matches(ext, extensions))
-                    continue;
+        // Writes the chunks as one file. Backends without a native version concatenate
+        // them into write_file and ignore options they cannot honour.
+        virtual Result write_file_gather(std::string_view path,
+            const WriteChunk* chunks,
+            size_t count,
+            const WriteOptions& options)
+        {
+            (void)options;
+            if (count == 1)
+                return write_file(path, chunks[0].data, chunks[0].size);
 
-                if (!allow_duplicates && !seen.insert(name).second)
-                    continue;
+            size_t total = 0;
+            for (size_t i = 0; i < count; ++i)
+                total += chunks[i].size;
 
-                callback(name);
+            Blob joined = Blob::allocate(total);
+            size_t offset = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (chunks[i].size > 0)
+                    std::memcpy(joined.mutable_data() + offset, chunks[i].data, chunks[i].size);
+                offset += chunks[i].size;
             }
-
-            return Result::ok;
+            return write_file(path, joined.data(), total);
         }
 
-        Result list_dirs(std::string_view path,
-            const EnumerateFn& callback,
-            bool allow_duplicates) override
-        {
-            fs::path dir = detail::to_os_path(path);
-            std::error_code ec;
+        virtual Result list_files(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateRef& callback,
+            bool allow_duplicates = false) = 0;
+        virtual Result list_dirs(std::string_view path,
+            const EnumerateRef& callback,
+            bool allow_duplicates = false) = 0;
 
-            if (!fs::exists(dir, ec) || !fs::is_directory(dir, ec))
+        // Recursively enumerates files below `path`; names are relative to it. `threads`
+        // is a hint for backends that can walk directories in parallel.
+        virtual Result walk(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateRef& callback,
+            size_t threads = 1)
+        {
+            (void)threads;
+            if (!exists_dir(path))
                 return Result::not_found;
 
-            std::unordered_set<std::string> seen;
-
-            for (fs::directory_iterator it(dir, ec), end; it != end; it.increment(ec))
+            std::vector<std::string> pending{std::string()};
+            std::string dir;
+            std::string child;
+            while (!pending.empty())
             {
-                if (ec)
-                    return Result::io_error;
+                std::string relative = std::move(pending.back());
+                pending.pop_back();
 
-                const fs::directory_entry& entry = *it;
-                if (!entry.is_directory(ec))
+                dir.assign(path);
+                if (!dir.empty() && !relative.empty())
+                    dir.push_back('/');
+                dir += relative;
+
+                auto emit = [&](std::string_view name)
                 {
-                    if (ec)
-                        return Result::io_error;
-                    continue;
-                }
+                    child = relative;
+                    if (!child.empty())
+                        child.push_back('/');
+                    child.append(name);
+                };
 
-                std::string name = entry.path().filename().generic_string();
-                if (!allow_duplicates && !seen.insert(name).second)
-                    continue;
+                Result result = list_files(dir, extensions, [&](std::string_view name)
+                {
+                    emit(name);
+                    callback(child);
+                }, true);
+                if (result == Result::io_error)
+                    return result;
 
-                callback(name);
+                result = list_dirs(dir, [&](std::string_view name)
+                {
+                    emit(name);
+                    pending.push_back(child);
+                }, true);
+                if (result == Result::io_error)
+                    return result;
             }
 
             return Result::ok;
         }
-    };
 
-    class SubtreeBackend final : public Backend
-    {
-    public:
-        SubtreeBackend(std::shared_ptr<Backend> backend, fs::path base)
-            : backend_(std::move(backend))
-            , base_(std::move(base).lexically_normal())
+        // Backends that cannot map files fall back to reading them into memory.
+        virtual std::optional<FileView> map_file(std::string_view path)
         {
+            auto blob = read_file(path);
+            if (!blob)
+                return std::nullopt;
+            return FileView(blob->data(), blob->size(), blob->owner());
         }
 
-        bool exists_file(std::string_view path) override
+        // Backends without native handles serve ranges from a mapped or fully read file.
+        virtual std::unique_ptr<FileHandle> open_file(std::string_view path)
         {
-            return backend_->exists_file(map(path));
+            auto view = map_file(path);
+            if (!view)
+                return nullptr;
+            return std::make_unique<ViewFileHandle>(std::move(*view));
         }
 
-        bool exists_dir(std::string_view path) override
+        // Reads several files in one call. Backends may reorder the reads (for example
+        // by physical offset); every index is reported exactly once.
+        virtual void read_files(const std::vector<std::string_view>& paths, const BatchReadFn& callback)
         {
-            return backend_->exists_dir(map(path));
+            for (size_t i = 0; i < paths.size(); ++i)
+                callback(i, read_file(paths[i]));
         }
 
-        std::optional<Blob> read_file(std::string_view path) override
+        // Hints that `path` will be read soon so the data can be brought in ahead of time.
+        // May block briefly; Vfs::prefetch calls it from a worker. Returns false when the
+        // file is not served by this backend.
+        virtual bool prefetch(std::string_view path)
         {
-            return backend_->read_file(map(path));
+            return exists_file(path);
         }
 
-        Result write_file(std::string_view path, const void* data, size_t size) override
+        // Identifies the file's bytes without reading them, when the backend knows it.
+        // Equal hashes mean equal contents, which lets caches share one buffer.
+        virtual std::optional<std::uint64_t> content_hash(std::string_view path)
         {
-            return backend_->write_file(map(path), data, size);
+            (void)path;
+            return std::nullopt;
         }
 
-        Result list_files(std::string_view path,
+        // Watches the directory tree at `path` for changes made by anyone, or returns
+        // null when the backend cannot. The watch must not outlive the backend.
+        virtual std::unique_ptr<BackendWatch> watch(std::string_view path)
+        {
+            (void)path;
+            return nullptr;
+        }
+
+        // Type, size and mtime in one query. The default costs several calls and reports
+        // no timestamp; backends with native metadata should override it.
+        virtual std::optional<FileStat> stat(std::string_view path)
+        {
+            if (exists_file(path))
+            {
+                auto handle = open_file(path);
+                if (!handle)
+                    return std::nullopt;
+
+                FileStat result;
+                result.size = handle->size();
+                return result;
+            }
+
+            if (exists_dir(path))
+            {
+                FileStat result;
+                result.type = FileType::directory;
+                return result;
+            }
+
+            return std::nullopt;
+        }
+    };
+
+    namespace detail
+    {
+        // Path text that lives inline for typical lengths and spills to the heap only for
+        // long paths. It may also just view caller memory when nothing needed rewriting.
+        // Not copyable: the view can point into the object itself.
+        class PathBuffer
+        {
+        public:
+            PathBuffer() = default;
+            PathBuffer(const PathBuffer&) = delete;
+            PathBuffer& operator=(const PathBuffer&) = delete;
+
+            std::string_view view() const noexcept { return std::string_view(data_, size_); }
+            bool empty() const noexcept { return size_ == 0; }
+            size_t size() const noexcept { return size_; }
+
+            void clear() noexcept
+            {
+                data_ = inline_;
+                size_ = 0;
+            }
+
+            // Points at `text` without copying; it must outlive the buffer's use.
+            void assign_view(std::string_view text) noexcept
+            {
+                data_ = text.data();
+                size_ = text.size();
+            }
+
+            void append(std::string_view text)
+            {
+                if (data_ != inline_ && data_ != heap_.data())
+                {
+                    std::string_view current = view();
+                    clear();
+                    append(current);
+                }
+
+                if (data_ == inline_ && size_ + text.size() <= sizeof(inline_))
+                {
+                    std::memcpy(inline_ + size_, text.data(), text.size());
+                    size_ += text.size();
+                    return;
+                }
+
+                if (data_ == inline_)
+                    heap_.assign(inline_, size_);
+                heap_.append(text);
+                data_ = heap_.data();
+                size_ = heap_.size();
+            }
+
+            void push_back(char c) { append(std::string_view(&c, 1)); }
+
+            void truncate(size_t size) noexcept
+            {
+                if (size >= size_)
+                    return;
+                size_ = size;
+                if (data_ == heap_.data())
+                    heap_.resize(size);
+            }
+
+        private:
+            char inline_[256];
+            std::string heap_;
+            const char* data_ = inline_;
+            size_t size_ = 0;
+        };
+
+        inline bool is_separator(char c) noexcept
+        {
+#if defined(_WIN32)
+            return c == '/' || c == '\\';
+#else
+            return c == '/';
+#endif
+        }
+
+        // Drive letters and UNC prefixes are rejected the way fs::path::has_root_name() would.
+        inline bool has_root_name(std::string_view input) noexcept
+        {
+#if defined(_WIN32)
+            if (input.size() >= 2 && input[1] == ':')
+                return true;
+            if (input.size() >= 3 && is_separator(input[0]) && is_separator(input[1]) && !is_separator(input[2]))
+                return true;
+#else
+            (void)input;
+#endif
+            return false;
+        }
+
+        // True when the path is already in normalized form: relative, '/'-separated, with no
+        // empty, "." or ".." components. Most lookups pass this check and skip rewriting.
+        inline bool is_canonical_virtual_path(std::string_view input) noexcept
+        {
+            if (input.empty())
+                return true;
+
+            size_t start = 0;
+            for (size_t i = 0; i <= input.size(); ++i)
+            {
+                if (i < input.size())
+                {
+                    char c = input[i];
+#if defined(_WIN32)
+                    if (c == '\\' || c == ':')
+                        return false;
+#endif
+                    if (c != '/')
+                        continue;
+                }
+
+                size_t length = i - start;
+                if (length == 0)
+                    return false;
+                if (input[start] == '.' && (length == 1 || (length == 2 && input[start + 1] == '.')))
+                    return false;
+                start = i + 1;
+            }
+
+            return true;
+        }
+
+        // Single pass over the input: collapses separators, drops ".", resolves ".." against
+        // earlier components and rejects relative paths that climb above their start.
+        inline bool normalize_virtual_path(std::string_view input, PathBuffer& out)
+        {
+            if (is_canonical_virtual_path(input))
+            {
+                out.assign_view(input);
+                return true;
+            }
+
+            if (has_root_name(input))
+                return false;
+
+            // Like lexically_normal(), ".." directly below a root separator is dropped.
+            const bool rooted = !input.empty() && is_separator(input[0]);
+            out.clear();
+            size_t i = 0;
+            while (i < input.size())
+            {
+                while (i < input.size() && is_separator(input[i]))
+                    ++i;
+                size_t start = i;
+                while (i < input.size() && !is_separator(input[i]))
+                    ++i;
+
+                std::string_view part = input.substr(start, i - start);
+                if (part.empty() || part == ".")
+                    continue;
+
+                if (part == "..")
+                {
+                    if (out.empty())
+                    {
+                        if (rooted)
+                            continue;
+                        return false;
+                    }
+                    std::string_view current = out.view();
+                    size_t slash = current.rfind('/');
+                    out.truncate(slash == std::string_view::npos ? 0 : slash);
+                    continue;
+                }
+
+                if (!out.empty())
+                    out.push_back('/');
+                out.append(part);
+            }
+
+            return true;
+        }
+
+        inline bool normalize_virtual_path(std::string_view input, std::string& out)
+        {
+            PathBuffer buffer;
+            if (!normalize_virtual_path(input, buffer))
+                return false;
+            out.assign(buffer.view());
+            return true;
+        }
+
+        inline fs::path to_os_path(std::string_view path)
+        {
+            fs::path p(path);
+            return p.make_preferred();
+        }
+
+        // One stat()/GetFileAttributesExW call. Anything other than a regular file or a
+        // directory is reported as missing, matching exists_file/exists_dir.
+        inline std::optional<FileStat> stat_os_path(const fs::path& os_path)
+        {
+            FileStat result;
+#if defined(_WIN32)
+            WIN32_FILE_ATTRIBUTE_DATA data;
+            if (!GetFileAttributesExW(os_path.c_str(), GetFileExInfoStandard, &data))
+                return std::nullopt;
+
+            if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                result.type = FileType::directory;
+            else
+                result.size = (static_cast<std::uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+
+            // FILETIME counts 100ns ticks since 1601-01-01.
+            std::uint64_t ticks = (static_cast<std::uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) |
+                data.ftLastWriteTime.dwLowDateTime;
+            result.mtime_ns = (static_cast<std::int64_t>(ticks) - 116444736000000000LL) * 100;
+#else
+            struct stat info;
+            if (::stat(os_path.c_str(), &info) != 0)
+                return std::nullopt;
+
+            if (S_ISDIR(info.st_mode))
+                result.type = FileType::directory;
+            else if (S_ISREG(info.st_mode))
+                result.size = static_cast<std::uint64_t>(info.st_size);
+            else
+                return std::nullopt;
+
+#if defined(__APPLE__)
+            const struct timespec& mtime = info.st_mtimespec;
+#else
+            const struct timespec& mtime = info.st_mtim;
+#endif
+            result.mtime_ns = static_cast<std::int64_t>(mtime.tv_sec) * 1000000000 + mtime.tv_nsec;
+#endif
+            return result;
+        }
+
+#if !defined(_WIN32)
+        inline bool write_all(int fd, const WriteChunk* chunks, size_t count)
+        {
+            constexpr int max_vectors = 64;
+            size_t index = 0;
+            size_t offset = 0;
+            while (index < count)
+            {
+                iovec vectors[max_vectors];
+                int used = 0;
+                for (size_t i = index; i < count && used < max_vectors; ++i)
+                {
+                    size_t skip = i == index ? offset : 0;
+                    if (chunks[i].size == skip)
+                        continue;
+                    vectors[used].iov_base = const_cast<std::byte*>(static_cast<const std::byte*>(chunks[i].data) + skip);
+                    vectors[used].iov_len = chunks[i].size - skip;
+                    ++used;
+                }
+                if (used == 0)
+                    return true;
+
+                ssize_t written = ::writev(fd, vectors, used);
+                if (written < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    return false;
+                }
+
+                // Short writes resume mid-chunk on the next pass.
+                size_t left = static_cast<size_t>(written);
+                while (index < count)
+                {
+                    size_t remaining = chunks[index].size - offset;
+                    if (left < remaining)
+                    {
+                        offset += left;
+                        break;
+                    }
+                    left -= remaining;
+                    ++index;
+                    offset = 0;
+                }
+            }
+            return true;
+        }
+#endif
+
+        // Writes chunks with one gathered write per batch of buffers. A missing parent
+        // directory reports not_found; atomic writes never leave a partial target behind.
+#if !defined(_WIN32)
+        // Makes a rename into the file's directory durable. File systems that cannot
+        // sync a directory report EINVAL and are taken at their word.
+        inline bool sync_parent_directory(const fs::path& os_path)
+        {
+            const fs::path parent = os_path.parent_path();
+            int fd = ::open(parent.empty() ? "." : parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (fd < 0)
+                return false;
+            const bool ok = ::fsync(fd) == 0 || errno == EINVAL;
+            ::close(fd);
+            return ok;
+        }
+#endif
+
+        inline Result write_os_file(const fs::path& os_path,
+            const WriteChunk* chunks,
+            size_t count,
+            const WriteOptions& options)
+        {
+            static std::atomic<std::uint32_t> temp_counter{0};
+
+            std::uint64_t total = 0;
+            for (size_t i = 0; i < count; ++i)
+                total += chunks[i].size;
+
+#if defined(_WIN32)
+            fs::path temp = os_path;
+            if (options.atomic)
+            {
+                temp += L".tmp" + std::to_wstring(GetCurrentProcessId()) + L"." +
+                    std::to_wstring(temp_counter.fetch_add(1, std::memory_order_relaxed));
+            }
+
+            HANDLE file = CreateFileW(temp.c_str(), GENERIC_WRITE, 0, nullptr,
+                options.atomic ? CREATE_NEW : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+                return GetLastError() == ERROR_PATH_NOT_FOUND ? Result::not_found : Result::io_error;
+
+            if (options.preallocate && total > 0)
+            {
+                FILE_ALLOCATION_INFO allocation{};
+                allocation.AllocationSize.QuadPart = static_cast<LONGLONG>(total);
+                SetFileInformationByHandle(file, FileAllocationInfo, &allocation, sizeof(allocation));
+            }
+
+            // WriteFileGather needs unbuffered, page-aligned buffers, so caller chunks are
+            // written one at a time instead.
+            bool ok = true;
+            for (size_t i = 0; ok && i < count; ++i)
+            {
+                const std::byte* data = static_cast<const std::byte*>(chunks[i].data);
+                size_t left = chunks[i].size;
+                while (ok && left > 0)
+                {
+                    DWORD request = static_cast<DWORD>(std::min<size_t>(left, 1u << 30));
+                    DWORD written = 0;
+                    ok = WriteFile(file, data, request, &written, nullptr) && written == request;
+                    data += written;
+                    left -= written;
+                }
+            }
+            if (ok && options.atomic)
+                ok = FlushFileBuffers(file) != 0;
+            CloseHandle(file);
+
+            if (options.atomic)
+            {
+                if (ok)
+                    ok = MoveFileExW(temp.c_str(), os_path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+                if (!ok)
+                    DeleteFileW(temp.c_str());
+            }
+            return ok ? Result::ok : Result::io_error;
+#else
+            std::string temp = os_path.native();
+            if (options.atomic)
+            {
+                temp += ".tmp" + std::to_string(::getpid()) + "." +
+                    std::to_string(temp_counter.fetch_add(1, std::memory_order_relaxed));
+            }
+
+            int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (options.atomic ? O_EXCL : O_TRUNC);
+            int fd = ::open(temp.c_str(), flags, 0666);
+            if (fd < 0)
+                return (errno == ENOENT || errno == ENOTDIR) ? Result::not_found : Result::io_error;
+
+            bool ok = true;
+#if defined(__linux__)
+            // Only a file system without preallocation support (EOPNOTSUPP, or EINVAL on
+            // some) may skip the hint; running out of space is reported before writing.
+            if (options.preallocate && total > 0)
+            {
+                const int error = ::posix_fallocate(fd, 0, static_cast<off_t>(total));
+                ok = error == 0 || error == EOPNOTSUPP || error == EINVAL;
+            }
+#endif
+
+            ok = ok && write_all(fd, chunks, count);
+            if (ok && options.atomic)
+                ok = ::fsync(fd) == 0;
+            if (::close(fd) != 0)
+                ok = false;
+
+            if (options.atomic)
+            {
+                if (ok)
+                    ok = ::rename(temp.c_str(), os_path.c_str()) == 0;
+                if (!ok)
+                    ::unlink(temp.c_str());
+                else
+                    ok = sync_parent_directory(os_path);
+            }
+            return ok ? Result::ok : Result::io_error;
+#endif
+        }
+
+        // Asks the OS to start paging in a mapped range in the background.
+        inline void advise_will_need(const void* data, size_t size) noexcept
+        {
+            if (size == 0)
+                return;
+#if defined(_WIN32)
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0602
+            WIN32_MEMORY_RANGE_ENTRY range{const_cast<void*>(data), size};
+            PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+            (void)data;
+#endif
+#else
+            const std::uintptr_t page = static_cast<std::uintptr_t>(::sysconf(_SC_PAGESIZE));
+            const std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(data);
+            const std::uintptr_t start = begin & ~(page - 1);
+            ::madvise(reinterpret_cast<void*>(start), begin + size - start, MADV_WILLNEED);
+#endif
+        }
+
+        // Maps a regular file read-only. Empty files yield an empty view since
+        // zero-length mappings are rejected by both mmap and MapViewOfFile.
+        inline std::optional<FileView> map_os_file(const fs::path& os_path)
+        {
+#if defined(_WIN32)
+            HANDLE file = CreateFileW(os_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+                return std::nullopt;
+
+            LARGE_INTEGER size{};
+            if (!GetFileSizeEx(file, &size) ||
+                static_cast<unsigned long long>(size.QuadPart) > static_cast<unsigned long long>(SIZE_MAX))
+            {
+                CloseHandle(file);
+                return std::nullopt;
+            }
+
+            if (size.QuadPart == 0)
+            {
+                CloseHandle(file);
+                return FileView();
+            }
+
+            HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            CloseHandle(file);
+            if (!mapping)
+                return std::nullopt;
+
+            const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+            if (!view)
+                return std::nullopt;
+
+            std::shared_ptr<const void> owner(view, [](const void* p)
+            {
+                UnmapViewOfFile(p);
+            });
+            return FileView(static_cast<const std::byte*>(view), static_cast<size_t>(size.QuadPart), std::move(owner));
+#else
+            int fd = ::open(os_path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                return std::nullopt;
+
+            struct stat st{};
+            if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+                static_cast<unsigned long long>(st.st_size) > static_cast<unsigned long long>(SIZE_MAX))
+            {
+                ::close(fd);
+                return std::nullopt;
+            }
+
+            size_t size = static_cast<size_t>(st.st_size);
+            if (size == 0)
+            {
+                ::close(fd);
+                return FileView();
+            }
+
+            void* view = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (view == MAP_FAILED)
+                return std::nullopt;
+
+            std::shared_ptr<const void> owner(view, [size](const void* p)
+            {
+                ::munmap(const_cast<void*>(p), size);
+            });
+            return FileView(static_cast<const std::byte*>(view), size, std::move(owner));
+#endif
+        }
+
+        // Starts readahead of a whole file into the OS cache without waiting for it.
+        inline bool prefetch_os_file(const fs::path& os_path)
+        {
+#if defined(_WIN32)
+            // No handle-level readahead hint exists; prefetching a transient mapping fills
+            // the file cache, which outlives the view.
+            auto view = map_os_file(os_path);
+            if (!view)
+                return false;
+            advise_will_need(view->data(), view->size());
+            return true;
+#else
+            int fd = ::open(os_path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0)
+                return false;
+
+            struct stat info{};
+            bool regular = ::fstat(fd, &info) == 0 && S_ISREG(info.st_mode);
+            if (regular && info.st_size > 0)
+            {
+#if defined(__APPLE__)
+                radvisory advice{};
+                advice.ra_count = static_cast<int>(std::min<off_t>(info.st_size, INT32_MAX));
+                ::fcntl(fd, F_RDADVISE, &advice);
+#elif defined(POSIX_FADV_WILLNEED)
+                ::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+            }
+            ::close(fd);
+            return regular;
+#endif
+        }
+
+        // With `fold`, letters compare regardless of ASCII case.
+        inline bool same_name(std::string_view a, std::string_view b, bool fold) noexcept
+        {
+            if (!fold || a.size() != b.size())
+                return a == b;
+            for (size_t i = 0; i < a.size(); ++i)
+            {
+                char x = a[i] >= 'A' && a[i] <= 'Z' ? static_cast<char>(a[i] - 'A' + 'a') : a[i];
+                char y = b[i] >= 'A' && b[i] <= 'Z' ? static_cast<char>(b[i] - 'A' + 'a') : b[i];
+                if (x != y)
+                    return false;
+            }
+            return true;
+        }
+
+        inline bool extension_matches(std::string_view ext,
+            const std::vector<std::string_view>& extensions,
+            bool fold = false)
+        {
+            if (extensions.empty())
+                return true;
+
+            for (std::string_view entry : extensions)
+            {
+                if (entry.empty())
+                    continue;
+
+                if (entry.front() == '.')
+                {
+                    if (same_name(ext, entry, fold))
+                        return true;
+                }
+                else
+                {
+                    if (ext.size() == entry.size() + 1 &&
+                        ext.front() == '.' &&
+                        same_name(ext.substr(1), entry, fold))
+                    {
+                        return true;
+                    }
+                }
+            }
+
+            return false;
+        }
+
+        class DiskFileHandle final : public FileHandle
+        {
+        public:
+#if defined(_WIN32)
+            using NativeHandle = HANDLE;
+#else
+            using NativeHandle = int;
+#endif
+
+            DiskFileHandle(NativeHandle handle, std::uint64_t size, size_t alignment = 0)
+                : handle_(handle)
+                , size_(size)
+                , alignment_(alignment)
+            {
+            }
+
+            DiskFileHandle(const DiskFileHandle&) = delete;
+            DiskFileHandle& operator=(const DiskFileHandle&) = delete;
+
+            ~DiskFileHandle() override
+            {
+#if defined(_WIN32)
+                CloseHandle(handle_);
+#else
+                ::close(handle_);
+#endif
+            }
+
+            // Files of at least `direct_threshold` bytes (0 = never) bypass the OS cache
+            // where the file system allows it and stay buffered where it does not.
+            static std::unique_ptr<DiskFileHandle> open(const fs::path& os_path, std::uint64_t direct_threshold = 0)
+            {
+#if defined(_WIN32)
+                HANDLE file = CreateFileW(os_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+                if (file == INVALID_HANDLE_VALUE)
+                    return nullptr;
+
+                LARGE_INTEGER size{};
+                if (!GetFileSizeEx(file, &size))
+                {
+                    CloseHandle(file);
+                    return nullptr;
+                }
+
+                size_t alignment = 0;
+                if (direct_threshold != 0 && static_cast<std::uint64_t>(size.QuadPart) >= direct_threshold)
+                {
+                    HANDLE direct = ReOpenFile(file, GENERIC_READ, FILE_SHARE_READ, FILE_FLAG_NO_BUFFERING);
+                    if (direct != INVALID_HANDLE_VALUE)
+                    {
+                        CloseHandle(file);
+                        file = direct;
+                        alignment = direct_io_alignment;
+                    }
+                }
+                return std::make_unique<DiskFileHandle>(file, static_cast<std::uint64_t>(size.QuadPart), alignment);
+#else
+                int fd = ::open(os_path.c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd < 0)
+                    return nullptr;
+
+                struct stat st{};
+                if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+                {
+                    ::close(fd);
+                    return nullptr;
+                }
+
+                size_t alignment = 0;
+                if (direct_threshold != 0 && static_cast<std::uint64_t>(st.st_size) >= direct_threshold)
+                {
+#if defined(O_DIRECT)
+                    // File systems without direct I/O (older tmpfs, some FUSE) refuse the flag.
+                    int flags = ::fcntl(fd, F_GETFL);
+                    if (flags >= 0 && ::fcntl(fd, F_SETFL, flags | O_DIRECT) == 0)
+                        alignment = direct_io_alignment;
+#elif defined(__APPLE__)
+                    // F_NOCACHE has no alignment rules, so reads need no bounce buffer.
+                    ::fcntl(fd, F_NOCACHE, 1);
+#endif
+                }
+                return std::make_unique<DiskFileHandle>(fd, static_cast<std::uint64_t>(st.st_size), alignment);
+#endif
+            }
+
+            std::uint64_t size() const override { return size_; }
+
+            size_t direct_alignment() const override { return alignment_.load(std::memory_order_relaxed); }
+
+            // Unbuffered handles read the aligned middle of the request straight into `dst`
+            // when it is aligned and stage the rest through an aligned bounce buffer.
+            size_t read_at(std::uint64_t offset, void* dst, size_t size) override
+            {
+                const size_t alignment = direct_alignment();
+                if (alignment == 0)
+                    return read_raw(offset, dst, size);
+
+                std::byte* out = static_cast<std::byte*>(dst);
+                const std::uint64_t mask = alignment - 1;
+                size_t total = 0;
+                if ((offset & mask) == 0 && (reinterpret_cast<std::uintptr_t>(out) & mask) == 0)
+                {
+                    size_t body = size & ~static_cast<size_t>(mask);
+                    if (body > 0)
+                    {
+                        total = read_raw(offset, out, body);
+                        if (total < body)
+                            return total;
+                    }
+                }
+                if (total == size)
+                    return total;
+
+                const size_t capacity = std::min<size_t>(bounce_size, (size - total + 2 * alignment) & ~static_cast<size_t>(mask));
+                std::unique_ptr<std::byte, AlignedDelete> bounce(
+                    static_cast<std::byte*>(::operator new(capacity, std::align_val_t(alignment))), AlignedDelete{alignment});
+                while (total < size)
+                {
+                    std::uint64_t at = offset + total;
+                    std::uint64_t start = at & ~mask;
+                    size_t skip = static_cast<size_t>(at - start);
+                    size_t want = std::min<size_t>(capacity, (skip + size - total + mask) & ~static_cast<size_t>(mask));
+                    size_t got = read_raw(start, bounce.get(), want);
+                    if (got <= skip)
+                        break;
+                    size_t count = std::min(got - skip, size - total);
+                    std::memcpy(out + total, bounce.get() + skip, count);
+                    total += count;
+                    if (got < want)
+                        break;
+                }
+                return total;
+            }
+
+        private:
+            // Covers the logical sector size of current disks, which unbuffered I/O requires.
+            static constexpr size_t direct_io_alignment = 4096;
+            static constexpr size_t bounce_size = 1u << 20;
+
+            struct AlignedDelete
+            {
+                size_t alignment;
+                void operator()(std::byte* ptr) const noexcept { ::operator delete(ptr, std::align_val_t(alignment)); }
+            };
+
+            size_t read_raw(std::uint64_t offset, void* dst, size_t size)
+            {
+                std::byte* out = static_cast<std::byte*>(dst);
+                size_t total = 0;
+                while (total < size)
+                {
+#if defined(_WIN32)
+                    std::uint64_t at = offset + total;
+                    OVERLAPPED overlapped{};
+                    overlapped.Offset = static_cast<DWORD>(at & 0xffffffffu);
+                    overlapped.OffsetHigh = static_cast<DWORD>(at >> 32);
+                    DWORD chunk = static_cast<DWORD>(std::min<size_t>(size - total, 1u << 30));
+                    DWORD got = 0;
+                    if (!ReadFile(handle_, out + total, chunk, &got, &overlapped) || got == 0)
+                        break;
+#else
+                    ssize_t got = ::pread(handle_, out + total, size - total, static_cast<off_t>(offset + total));
+                    if (got < 0 && errno == EINTR)
+                        continue;
+#if defined(O_DIRECT)
+                    // Some file systems accept O_DIRECT at open and reject the reads; drop
+                    // back to buffered reads for the rest of the handle's life.
+                    if (got < 0 && errno == EINVAL && alignment_.exchange(0, std::memory_order_relaxed) != 0)
+                    {
+                        int flags = ::fcntl(handle_, F_GETFL);
+                        if (flags >= 0)
+                            ::fcntl(handle_, F_SETFL, flags & ~O_DIRECT);
+                        continue;
+                    }
+#endif
+                    if (got <= 0)
+                        break;
+#endif
+                    total += static_cast<size_t>(got);
+                    // An unbuffered read reaching end of file stops short of a sector boundary.
+                    size_t alignment = direct_alignment();
+                    if (alignment != 0 && (static_cast<size_t>(got) & (alignment - 1)) != 0)
+                        break;
+                }
+                return total;
+            }
+
+            NativeHandle handle_;
+            std::uint64_t size_;
+            std::atomic<size_t> alignment_;
+        };
+
+        // Matches fs::path::extension(): a leading dot starts a hidden name, not an extension.
+        inline std::string_view extension_of(std::string_view filename)
+        {
+            if (filename == "." || filename == "..")
+                return {};
+            size_t dot = filename.rfind('.');
+            if (dot == std::string_view::npos || dot == 0)
+                return {};
+            return filename.substr(dot);
+        }
+
+        // Copies enumerated names into chunks so batch callbacks see contiguous arrays.
+        // Storage is reused between chunks, so steady-state batching does not allocate.
+        class NameBatcher
+        {
+        public:
+            NameBatcher(const EnumerateBatchRef& callback, size_t batch_size)
+                : callback_(callback)
+                , batch_size_(batch_size == 0 ? 1 : batch_size)
+            {
+            }
+
+            void add(std::string_view name)
+            {
+                starts_.push_back(text_.size());
+                text_.append(name);
+                if (starts_.size() >= batch_size_)
+                    flush();
+            }
+
+            void flush()
+            {
+                if (starts_.empty())
+                    return;
+
+                views_.clear();
+                for (size_t i = 0; i < starts_.size(); ++i)
+                {
+                    size_t end = i + 1 < starts_.size() ? starts_[i + 1] : text_.size();
+                    views_.emplace_back(text_.data() + starts_[i], end - starts_[i]);
+                }
+                callback_(views_.data(), views_.size());
+
+                text_.clear();
+                starts_.clear();
+            }
+
+        private:
+            const EnumerateBatchRef& callback_;
+            size_t batch_size_;
+            std::string text_;
+            std::vector<size_t> starts_;
+            std::vector<std::string_view> views_;
+        };
+
+        enum class EntryType
+        {
+            file,
+            directory,
+            other
+        };
+
+        // Iterates one directory with the native listing call and takes entry types from
+        // the listing itself (d_type, find data attributes), so plain files and folders
+        // cost no extra stat. Names stay valid until the next call to next().
+        class DirectoryReader
+        {
+        public:
+            explicit DirectoryReader(const fs::path& dir)
+            {
+#if defined(_WIN32)
+                fs::path pattern = dir / L"*";
+                find_ = FindFirstFileExW(pattern.c_str(), FindExInfoBasic, &data_, FindExSearchNameMatch,
+                    nullptr, FIND_FIRST_EX_LARGE_FETCH);
+                if (find_ == INVALID_HANDLE_VALUE)
+                {
+                    DWORD error = GetLastError();
+                    failed_ = error != ERROR_FILE_NOT_FOUND && error != ERROR_PATH_NOT_FOUND &&
+                        error != ERROR_DIRECTORY && error != ERROR_INVALID_NAME;
+                    return;
+                }
+                pending_ = true;
+#else
+                dir_ = ::opendir(dir.c_str());
+                if (!dir_)
+                    failed_ = errno != ENOENT && errno != ENOTDIR;
+#endif
+            }
+
+            ~DirectoryReader()
+            {
+#if defined(_WIN32)
+                if (find_ != INVALID_HANDLE_VALUE)
+                    FindClose(find_);
+#else
+                if (dir_)
+                    ::closedir(dir_);
+#endif
+            }
+
+            DirectoryReader(const DirectoryReader&) = delete;
+            DirectoryReader& operator=(const DirectoryReader&) = delete;
+
+            // False when the directory does not exist or could not be opened.
+            bool is_open() const noexcept
+            {
+#if defined(_WIN32)
+                return find_ != INVALID_HANDLE_VALUE;
+#else
+                return dir_ != nullptr;
+#endif
+            }
+
+            // Distinguishes an I/O error from a missing directory or the end of the listing.
+            bool failed() const noexcept { return failed_; }
+
+            // Skips "." and "..". `type` follows symlinks; `symlink` reports the link itself.
+            bool next(std::string_view& name, EntryType& type, bool& symlink)
+            {
+                if (!is_open())
+                    return false;
+
+#if defined(_WIN32)
+                for (;;)
+                {
+                    if (!pending_ && !FindNextFileW(find_, &data_))
+                    {
+                        failed_ = GetLastError() != ERROR_NO_MORE_FILES;
+                        return false;
+                    }
+                    pending_ = false;
+
+                    const wchar_t* raw = data_.cFileName;
+                    if (raw[0] == L'.' && (raw[1] == 0 || (raw[1] == L'.' && raw[2] == 0)))
+                        continue;
+
+                    // The active code page, matching how to_os_path() reads virtual paths.
+                    int length = WideCharToMultiByte(CP_ACP, 0, raw, -1, nullptr, 0, nullptr, nullptr);
+                    if (length <= 0)
+                    {
+                        failed_ = true;
+                        return false;
+                    }
+                    name_.resize(static_cast<size_t>(length));
+                    WideCharToMultiByte(CP_ACP, 0, raw, -1, name_.data(), length, nullptr, nullptr);
+                    name = std::string_view(name_.data(), static_cast<size_t>(length - 1));
+
+                    symlink = (data_.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0;
+                    type = (data_.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? EntryType::directory : EntryType::file;
+                    return true;
+                }
+#else
+                for (;;)
+                {
+                    errno = 0;
+                    dirent* entry = ::readdir(dir_);
+                    if (!entry)
+                    {
+                        failed_ = errno != 0;
+                        return false;
+                    }
+
+                    const char* raw = entry->d_name;
+                    if (raw[0] == '.' && (raw[1] == 0 || (raw[1] == '.' && raw[2] == 0)))
+                        continue;
+
+                    name = std::string_view(raw);
+                    symlink = false;
+#if defined(DT_UNKNOWN)
+                    if (entry->d_type == DT_REG)
+                    {
+                        type = EntryType::file;
+                        return true;
+                    }
+                    if (entry->d_type == DT_DIR)
+                    {
+                        type = EntryType::directory;
+                        return true;
+                    }
+                    if (entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN)
+                    {
+                        type = EntryType::other;
+                        return true;
+                    }
+#endif
+                    // Links and filesystems without d_type need a stat of their own.
+                    struct stat info;
+                    if (::fstatat(::dirfd(dir_), raw, &info, AT_SYMLINK_NOFOLLOW) != 0)
+                    {
+                        type = EntryType::other;
+                        return true;
+                    }
+                    if (S_ISLNK(info.st_mode))
+                    {
+                        symlink = true;
+                        if (::fstatat(::dirfd(dir_), raw, &info, 0) != 0)
+                        {
+                            type = EntryType::other;
+                            return true;
+                        }
+                    }
+
+                    if (S_ISREG(info.st_mode))
+                        type = EntryType::file;
+                    else if (S_ISDIR(info.st_mode))
+                        type = EntryType::directory;
+                    else
+                        type = EntryType::other;
+                    return true;
+                }
+#endif
+            }
+
+        private:
+#if defined(_WIN32)
+            HANDLE find_ = INVALID_HANDLE_VALUE;
+            WIN32_FIND_DATAW data_{};
+            bool pending_ = false;
+            std::string name_;
+#else
+            DIR* dir_ = nullptr;
+#endif
+            bool failed_ = false;
+        };
+
+        // Folds the changes seen in one poll by comparing before and after, so a file
+        // that appeared and vanished again (a temp file renamed into place) is dropped
+        // and a file replaced by a rename is reported as modified.
+        class ChangeBatch
+        {
+        public:
+            void add(ChangeKind kind, std::string_view path)
+            {
+                auto [slot, inserted] = slots_.emplace(std::string(path), changes_.size());
+                if (inserted)
+                {
+                    changes_.push_back(Change{slot->first, kind != ChangeKind::added, kind != ChangeKind::removed});
+                    return;
+                }
+                changes_[slot->second].exists_after = kind != ChangeKind::removed;
+            }
+
+            void flush(const ChangeFn& callback)
+            {
+                for (const Change& change : changes_)
+                {
+                    if (change.existed_before && change.exists_after)
+                        callback(ChangeKind::modified, change.path);
+                    else if (change.exists_after)
+                        callback(ChangeKind::added, change.path);
+                    else if (change.existed_before)
+                        callback(ChangeKind::removed, change.path);
+                }
+                changes_.clear();
+                slots_.clear();
+            }
+
+        private:
+            struct Change
+            {
+                std::string_view path;
+                bool existed_before;
+                bool exists_after;
+            };
+
+            // Node-based, so the keys the changes view never move.
+            std::unordered_map<std::string, size_t> slots_;
+            std::vector<Change> changes_;
+        };
+
+        // Calls `on_file` and `on_dir` with paths relative to `root` for everything below
+        // `relative`, without following directory symlinks.
+        template <typename FileFn, typename DirFn>
+        void scan_tree(const fs::path& root, const std::string& relative, FileFn&& on_file, DirFn&& on_dir)
+        {
+            std::vector<std::string> pending{relative};
+            std::string child;
+            while (!pending.empty())
+            {
+                std::string dir = std::move(pending.back());
+                pending.pop_back();
+
+                DirectoryReader reader(dir.empty() ? root : root / to_os_path(dir));
+                std::string_view name;
+                EntryType type;
+                bool symlink = false;
+                while (reader.next(name, type, symlink))
+                {
+                    child = dir;
+                    if (!child.empty())
+                        child.push_back('/');
+                    child.append(name);
+                    if (type == EntryType::directory && !symlink)
+                    {
+                        on_dir(child);
+                        pending.push_back(child);
+                    }
+                    else if (type == EntryType::file)
+                    {
+                        on_file(child);
+                    }
+                }
+            }
+        }
+
+#if defined(__linux__)
+        // inotify has no recursive mode, so each directory gets its own watch and new
+        // directories are added as their creation events arrive; their contents are
+        // scanned so files made before the watch existed are still reported. Files are
+        // reported modified when closed after writing, not on every write.
+        class DirectoryWatch final : public BackendWatch
+        {
+        public:
+            static std::unique_ptr<DirectoryWatch> open(const fs::path& root)
+            {
+                std::error_code ec;
+                if (!fs::is_directory(root, ec))
+                    return nullptr;
+
+                int fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+                if (fd < 0)
+                    return nullptr;
+
+                std::unique_ptr<DirectoryWatch> watch(new DirectoryWatch(fd, root));
+                if (!watch->add_dir(std::string()))
+                    return nullptr;
+                scan_tree(root, std::string(), [](const std::string&) {}, [&](const std::string& dir)
+                {
+                    watch->add_dir(dir);
+                });
+                return watch;
+            }
+
+            ~DirectoryWatch() override
+            {
+                ::close(fd_);
+            }
+
+            DirectoryWatch(const DirectoryWatch&) = delete;
+            DirectoryWatch& operator=(const DirectoryWatch&) = delete;
+
+            bool poll(const ChangeFn& callback) override
+            {
+                complete_ = true;
+                alignas(inotify_event) char buffer[16384];
+                for (;;)
+                {
+                    ssize_t length = ::read(fd_, buffer, sizeof(buffer));
+                    if (length < 0 && errno == EINTR)
+                        continue;
+                    if (length <= 0)
+                    {
+                        if (length < 0 && errno != EAGAIN)
+                            complete_ = false;
+                        break;
+                    }
+
+                    for (ssize_t offset = 0; offset < length;)
+                    {
+                        const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                        offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+                        handle(*event);
+                    }
+                }
+
+                batch_.flush(callback);
+                const bool complete = complete_ && !unwatched_;
+                unwatched_ = false;
+                return complete;
+            }
+
+        private:
+            static constexpr std::uint32_t dir_mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+            DirectoryWatch(int fd, fs::path root)
+                : fd_(fd)
+                , root_(std::move(root))
+            {
+            }
+
+            bool add_dir(const std::string& relative)
+            {
+                const fs::path os_path = relative.empty() ? root_ : root_ / to_os_path(relative);
+                // The root may be a symlink; directories below it are never followed.
+                int wd = ::inotify_add_watch(fd_, os_path.c_str(), relative.empty() ? dir_mask : dir_mask | IN_DONT_FOLLOW);
+                if (wd < 0)
+                {
+                    // Out of watches (fs.inotify.max_user_watches): changes below go unseen,
+                    // which the next poll reports once.
+                    unwatched_ = true;
+                    return false;
+                }
+                dirs_[wd] = relative;
+                return true;
+            }
+
+            // Drops the watches of a directory that left the tree, and of everything below it.
+            void remove_tree(const std::string& relative)
+            {
+                for (auto it = dirs_.begin(); it != dirs_.end();)
+                {
+                    const std::string& dir = it->second;
+                    bool below = dir.size() > relative.size() && dir.compare(0, relative.size(), relative) == 0 &&
+                        dir[relative.size()] == '/';
+                    if (dir == relative || below)
+                    {
+                        ::inotify_rm_watch(fd_, it->first);
+                        it = dirs_.erase(it);
+                    }
+                    else
+                    {
+                        ++it;
+                    }
+                }
+            }
+
+            void handle(const inotify_event& event)
+            {
+                if (event.mask & IN_Q_OVERFLOW)
+                {
+                    complete_ = false;
+                    return;
+                }
+
+                auto dir = dirs_.find(event.wd);
+                if (dir == dirs_.end())
+                    return;
+                if (event.mask & IN_IGNORED)
+                {
+                    dirs_.erase(dir);
+                    return;
+                }
+                // Subdirectories are handled through their parent's events.
+                if (event.mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+                {
+                    if (dir->second.empty())
+                        complete_ = false;
+                    return;
+                }
+                if (event.len == 0)
+                    return;
+
+                path_ = dir->second;
+                if (!path_.empty())
+                    path_.push_back('/');
+                path_.append(event.name);
+
+                if (event.mask & IN_ISDIR)
+                {
+                    if (event.mask & (IN_CREATE | IN_MOVED_TO))
+                    {
+                        const std::string added = path_;
+                        add_dir(added);
+                        scan_tree(root_, added, [&](const std::string& file)
+                        {
+                            batch_.add(ChangeKind::added, file);
+                        }, [&](const std::string& child)
+                        {
+                            add_dir(child);
+                        });
+                    }
+                    else if (event.mask & IN_MOVED_FROM)
+                    {
+                        // Its files left with it, without events of their own.
+                        remove_tree(path_);
+                        complete_ = false;
+                    }
+                    return;
+                }
+
+                if (event.mask & (IN_CREATE | IN_MOVED_TO))
+                    batch_.add(ChangeKind::added, path_);
+                else if (event.mask & (IN_DELETE | IN_MOVED_FROM))
+                    batch_.add(ChangeKind::removed, path_);
+                else if (event.mask & (IN_CLOSE_WRITE | IN_ATTRIB))
+                    batch_.add(ChangeKind::modified, path_);
+            }
+
+            int fd_;
+            fs::path root_;
+            std::unordered_map<int, std::string> dirs_;
+            ChangeBatch batch_;
+            std::string path_;
+            bool complete_ = true;
+            bool unwatched_ = false;
+        };
+#elif defined(_WIN32)
+        // One recursive ReadDirectoryChangesW request kept in flight on an overlapped
+        // handle; poll() collects finished results and issues the next request. The
+        // notifications do not say whether a removed name was a directory, so the
+        // watch keeps the set of directories it has seen.
+        class DirectoryWatch final : public BackendWatch
+        {
+        public:
+            static std::unique_ptr<DirectoryWatch> open(const fs::path& root)
+            {
+                HANDLE handle = CreateFileW(root.c_str(),
+                    FILE_LIST_DIRECTORY,
+                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                    nullptr,
+                    OPEN_EXISTING,
+                    FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+                    nullptr);
+                if (handle == INVALID_HANDLE_VALUE)
+                    return nullptr;
+
+                HANDLE event = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+                if (!event)
+                {
+                    CloseHandle(handle);
+                    return nullptr;
+                }
+
+                std::unique_ptr<DirectoryWatch> watch(new DirectoryWatch(handle, event, root));
+                scan_tree(root, std::string(), [](const std::string&) {}, [&](const std::string& dir)
+                {
+                    watch->dirs_.insert(dir);
+                });
+                if (!watch->issue())
+                    return nullptr;
+                return watch;
+            }
+
+            ~DirectoryWatch() override
+            {
+                CancelIoEx(handle_, &overlapped_);
+                DWORD bytes = 0;
+                GetOverlappedResult(handle_, &overlapped_, &bytes, TRUE);
+                CloseHandle(event_);
+                CloseHandle(handle_);
+            }
+
+            DirectoryWatch(const DirectoryWatch&) = delete;
+            DirectoryWatch& operator=(const DirectoryWatch&) = delete;
+
+            bool poll(const ChangeFn& callback) override
+            {
+                bool complete = true;
+                for (;;)
+                {
+                    DWORD bytes = 0;
+                    if (!GetOverlappedResult(handle_, &overlapped_, &bytes, FALSE))
+                    {
+                        if (GetLastError() == ERROR_IO_INCOMPLETE)
+                            break;
+                        complete = false;
+                    }
+                    else if (bytes == 0)
+                    {
+                        // The system buffer overflowed.
+                        complete = false;
+                    }
+                    else
+                    {
+                        complete = parse(static_cast<size_t>(bytes)) && complete;
+                    }
+
+                    if (!issue())
+                    {
+                        complete = false;
+                        break;
+                    }
+                }
+
+                batch_.flush(callback);
+                return complete;
+            }
+
+        private:
+            DirectoryWatch(HANDLE handle, HANDLE event, fs::path root)
+                : handle_(handle)
+                , event_(event)
+                , root_(std::move(root))
+            {
+                overlapped_.hEvent = event_;
+            }
+
+            bool issue()
+            {
+                ResetEvent(event_);
+                return ReadDirectoryChangesW(handle_,
+                    buffer_,
+                    sizeof(buffer_),
+                    TRUE,
+                    FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE |
+                        FILE_NOTIFY_CHANGE_SIZE,
+                    nullptr,
+                    &overlapped_,
+                    nullptr) != 0;
+            }
+
+            bool is_dir_below(const std::string& dir, const std::string& relative) const
+            {
+                return dir == relative || (dir.size() > relative.size() &&
+                    dir.compare(0, relative.size(), relative) == 0 && dir[relative.size()] == '/');
+            }
+
+            bool parse(size_t bytes)
+            {
+                bool complete = true;
+                for (size_t offset = 0; offset < bytes;)
+                {
+                    const auto* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(
+                        reinterpret_cast<const char*>(buffer_) + offset);
+                    const int wide_length = static_cast<int>(info->FileNameLength / sizeof(wchar_t));
+                    // The active code page, matching DirectoryReader and to_os_path().
+                    int length = WideCharToMultiByte(CP_ACP, 0, info->FileName, wide_length, nullptr, 0, nullptr, nullptr);
+                    path_.resize(static_cast<size_t>(length > 0 ? length : 0));
+                    if (length > 0)
+                        WideCharToMultiByte(CP_ACP, 0, info->FileName, wide_length, path_.data(), length, nullptr, nullptr);
+                    std::replace(path_.begin(), path_.end(), '\\', '/');
+
+                    switch (info->Action)
+                    {
+                    case FILE_ACTION_ADDED:
+                    case FILE_ACTION_RENAMED_NEW_NAME:
+                    {
+                        const DWORD attributes = GetFileAttributesW((root_ / to_os_path(path_)).c_str());
+                        if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY))
+                        {
+                            // A directory moved in brings files that get no events of their own.
+                            const std::string added = path_;
+                            dirs_.insert(added);
+                            scan_tree(root_, added, [&](const std::string& file)
+                            {
+                                batch_.add(ChangeKind::added, file);
+                            }, [&](const std::string& dir)
+                            {
+                                dirs_.insert(dir);
+                            });
+                        }
+                        else
+                        {
+                            batch_.add(ChangeKind::added, path_);
+                        }
+                        break;
+                    }
+                    case FILE_ACTION_REMOVED:
+                    case FILE_ACTION_RENAMED_OLD_NAME:
+                        if (dirs_.count(path_) != 0)
+                        {
+                            for (auto it = dirs_.begin(); it != dirs_.end();)
+                                it = is_dir_below(*it, path_) ? dirs_.erase(it) : std::next(it);
+                            complete = false;
+                        }
+                        else
+                        {
+                            batch_.add(ChangeKind::removed, path_);
+                        }
+                        break;
+                    case FILE_ACTION_MODIFIED:
+                        if (dirs_.count(path_) == 0)
+                            batch_.add(ChangeKind::modified, path_);
+                        break;
+                    default:
+                        break;
+                    }
+
+                    if (info->NextEntryOffset == 0)
+                        break;
+                    offset += info->NextEntryOffset;
+                }
+                return complete;
+            }
+
+            HANDLE handle_;
+            HANDLE event_;
+            OVERLAPPED overlapped_ = {};
+            fs::path root_;
+            // 64 KiB is the largest buffer network shares accept.
+            alignas(DWORD) std::byte buffer_[64 * 1024];
+            std::unordered_set<std::string> dirs_;
+            ChangeBatch batch_;
+            std::string path_;
+        };
+#endif
+
+        // FNV-1a; stable across platforms so hashes can be stored in pack files.
+        inline std::uint64_t hash_path(std::string_view path) noexcept
+        {
+            std::uint64_t hash = 14695981039346656037ull;
+            for (char c : path)
+            {
+                hash ^= static_cast<unsigned char>(c);
+                hash *= 1099511628211ull;
+            }
+            return hash;
+        }
+
+        inline void store_le32(std::byte* out, std::uint32_t value) noexcept
+        {
+            for (int i = 0; i < 4; ++i)
+                out[i] = static_cast<std::byte>((value >> (8 * i)) & 0xff);
+        }
+
+        inline void store_le64(std::byte* out, std::uint64_t value) noexcept
+        {
+            for (int i = 0; i < 8; ++i)
+                out[i] = static_cast<std::byte>((value >> (8 * i)) & 0xff);
+        }
+
+        inline std::uint32_t load_le32(const std::byte* in) noexcept
+        {
+            std::uint32_t value = 0;
+            for (int i = 0; i < 4; ++i)
+                value |= static_cast<std::uint32_t>(in[i]) << (8 * i);
+            return value;
+        }
+
+        inline std::uint64_t load_le64(const std::byte* in) noexcept
+        {
+            std::uint64_t value = 0;
+            for (int i = 0; i < 8; ++i)
+                value |= static_cast<std::uint64_t>(in[i]) << (8 * i);
+            return value;
+        }
+
+        // Streaming XXH64. Input can arrive in pieces of any size, so reads can be
+        // verified chunk by chunk as they land.
+        class Xxh64
+        {
+        public:
+            explicit Xxh64(std::uint64_t seed = 0) noexcept
+                : v_{seed + prime1 + prime2, seed + prime2, seed, seed - prime1}
+                , seed_(seed)
+            {
+            }
+
+            void update(const void* data, size_t size) noexcept
+            {
+                const std::byte* in = static_cast<const std::byte*>(data);
+                total_ += size;
+
+                if (buffered_ > 0)
+                {
+                    size_t take = std::min(size, sizeof(buffer_) - buffered_);
+                    std::memcpy(buffer_ + buffered_, in, take);
+                    buffered_ += take;
+                    in += take;
+                    size -= take;
+                    if (buffered_ < sizeof(buffer_))
+                        return;
+                    consume(buffer_);
+                    buffered_ = 0;
+                }
+
+                for (; size >= sizeof(buffer_); in += sizeof(buffer_), size -= sizeof(buffer_))
+                    consume(in);
+
+                std::memcpy(buffer_, in, size);
+                buffered_ = size;
+            }
+
+            std::uint64_t digest() const noexcept
+            {
+                std::uint64_t hash;
+                if (total_ >= sizeof(buffer_))
+                {
+                    hash = rotl(v_[0], 1) + rotl(v_[1], 7) + rotl(v_[2], 12) + rotl(v_[3], 18);
+                    for (std::uint64_t lane : v_)
+                        hash = (hash ^ round(0, lane)) * prime1 + prime4;
+                }
+                else
+                {
+                    hash = seed_ + prime5;
+                }
+                hash += total_;
+
+                const std::byte* in = buffer_;
+                size_t left = buffered_;
+                for (; left >= 8; in += 8, left -= 8)
+                    hash = rotl(hash ^ round(0, load_le64(in)), 27) * prime1 + prime4;
+                if (left >= 4)
+                {
+                    hash = rotl(hash ^ (static_cast<std::uint64_t>(load_le32(in)) * prime1), 23) * prime2 + prime3;
+                    in += 4;
+                    left -= 4;
+                }
+                for (; left > 0; ++in, --left)
+                    hash = rotl(hash ^ (static_cast<std::uint64_t>(*in) * prime5), 11) * prime1;
+
+                hash ^= hash >> 33;
+                hash *= prime2;
+                hash ^= hash >> 29;
+                hash *= prime3;
+                hash ^= hash >> 32;
+                return hash;
+            }
+
+            static std::uint64_t hash(const void* data, size_t size, std::uint64_t seed = 0) noexcept
+            {
+                Xxh64 state(seed);
+                state.update(data, size);
+                return state.digest();
+            }
+
+        private:
+            static constexpr std::uint64_t prime1 = 11400714785074694791ull;
+            static constexpr std::uint64_t prime2 = 14029467366897019727ull;
+            static constexpr std::uint64_t prime3 = 1609587929392839161ull;
+            static constexpr std::uint64_t prime4 = 9650029242287828579ull;
+            static constexpr std::uint64_t prime5 = 2870177450012600261ull;
+
+            static std::uint64_t rotl(std::uint64_t value, int bits) noexcept
+            {
+                return (value << bits) | (value >> (64 - bits));
+            }
+
+            static std::uint64_t round(std::uint64_t acc, std::uint64_t input) noexcept
+            {
+                return rotl(acc + input * prime2, 31) * prime1;
+            }
+
+            void consume(const std::byte* stripe) noexcept
+            {
+                for (int i = 0; i < 4; ++i)
+                    v_[i] = round(v_[i], load_le64(stripe + 8 * i));
+            }
+
+            std::uint64_t v_[4];
+            std::uint64_t seed_;
+            std::uint64_t total_ = 0;
+            std::byte buffer_[32] = {};
+            size_t buffered_ = 0;
+        };
+    }
+
+    // Fixed set of worker threads fed from a bounded FIFO. submit() blocks while the
+    // queue is full so producers cannot run arbitrarily far ahead of the I/O; tasks
+    // submitted from a worker thread run inline instead of waiting on themselves.
+    class IoPool
+    {
+    public:
+        explicit IoPool(size_t workers = 4, size_t max_queued = 256)
+            : max_queued_(std::max<size_t>(max_queued, 1))
+        {
+            workers = std::max<size_t>(workers, 1);
+            threads_.reserve(workers);
+            for (size_t i = 0; i < workers; ++i)
+                threads_.emplace_back([this] { run(); });
+        }
+
+        IoPool(const IoPool&) = delete;
+        IoPool& operator=(const IoPool&) = delete;
+
+        // Queued tasks still run before the workers exit.
+        ~IoPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            work_ready_.notify_all();
+            for (auto& thread : threads_)
+                thread.join();
+        }
+
+        void submit(std::function<void()> task)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (current_pool() == this && queue_.size() >= max_queued_)
+            {
+                lock.unlock();
+                task();
+                return;
+            }
+
+            space_ready_.wait(lock, [this] { return queue_.size() < max_queued_; });
+            queue_.push_back(std::move(task));
+            lock.unlock();
+            work_ready_.notify_one();
+        }
+
+        void wait_idle()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            idle_.wait(lock, [this] { return queue_.empty() && active_ == 0; });
+        }
+
+        bool idle() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return queue_.empty() && active_ == 0;
+        }
+
+        size_t worker_count() const noexcept { return threads_.size(); }
+
+        // The pool cannot be destroyed from here: its destructor joins every worker.
+        bool on_worker() const noexcept { return current_pool() == this; }
+
+    private:
+        mutable std::mutex mutex_;
+        std::condition_variable work_ready_;
+        std::condition_variable space_ready_;
+        std::condition_variable idle_;
+        std::deque<std::function<void()>> queue_;
+        std::vector<std::thread> threads_;
+        size_t max_queued_;
+        size_t active_ = 0;
+        bool stopping_ = false;
+
+        static const IoPool*& current_pool()
+        {
+            static thread_local const IoPool* pool = nullptr;
+            return pool;
+        }
+
+        void run()
+        {
+            current_pool() = this;
+            std::unique_lock<std::mutex> lock(mutex_);
+            for (;;)
+            {
+                work_ready_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+                if (queue_.empty())
+                    return;
+
+                std::function<void()> task = std::move(queue_.front());
+                queue_.pop_front();
+                ++active_;
+                lock.unlock();
+                space_ready_.notify_one();
+
+                task();
+
+                lock.lock();
+                --active_;
+                if (queue_.empty() && active_ == 0)
+                    idle_.notify_all();
+            }
+        }
+    };
+
+    struct DiskBackendOptions
+    {
+        // Matches names regardless of ASCII case, as Windows and default macOS volumes
+        // do. Exact spellings cost nothing extra on reads and listings and one stat on
+        // writes, which must find an existing file's spelling; a mismatched one costs a
+        // hash probe per path component once the directories involved have been listed.
+        // Windows already ignores case, so the flag has no effect there. Extension
+        // filters of list_files and walk ignore case too.
+        bool case_insensitive = false;
+
+        // Directory taken as spelled when folding: only components below it are matched
+        // regardless of case, so the directories above need not be readable. mount_disk
+        // and static_disk set it to the mounted directory.
+        fs::path fold_base{};
+
+        // read_file and open_file bypass the OS cache for files of at least this many
+        // bytes (O_DIRECT, FILE_FLAG_NO_BUFFERING, F_NOCACHE), so bulk streams do not
+        // evict small hot files. Falls back to buffered reads where the file system
+        // refuses. 0 keeps every read buffered.
+        std::uint64_t direct_io_threshold = 0;
+    };
+
+    namespace detail
+    {
+        inline void fold_case(std::string_view name, std::string& out)
+        {
+            out.assign(name.data(), name.size());
+            for (char& c : out)
+            {
+                if (c >= 'A' && c <= 'Z')
+                    c = static_cast<char>(c - 'A' + 'a');
+            }
+        }
+
+        // Per-directory tables of case-folded names, listed on first use and cached by
+        // directory. A lookup that misses rechecks the directory's mtime and relists it
+        // when it changed, so files created by other processes are still found.
+        class FoldedNames
+        {
+        public:
+            explicit FoldedNames(const fs::path& base)
+                : base_(base.lexically_normal().generic_string())
+            {
+                while (base_.size() > 1 && base_.back() == '/')
+                    base_.pop_back();
+            }
+
+            // Respells the '/'-separated OS path `path` into `out` using the names on
+            // disk. A leading base directory is kept as given. Where two names differ only
+            // by case, an exact match wins. With `missing_leaf`, a final component that
+            // does not exist is kept as given, which is what a write wants.
+            bool resolve(std::string_view path, std::string& out, bool missing_leaf)
+            {
+                out.clear();
+                size_t pos = 0;
+                if (!base_.empty() && path.substr(0, base_.size()) == base_ &&
+                    (path.size() == base_.size() || path[base_.size()] == '/' || base_.back() == '/'))
+                {
+                    out.assign(base_);
+                    pos = base_.size();
+                }
+                else if (!path.empty() && path.front() == '/')
+                {
+                    out.push_back('/');
+                    pos = 1;
+                }
+
+                std::string folded;
+                while (pos < path.size())
+                {
+                    size_t end = path.find('/', pos);
+                    if (end == std::string_view::npos)
+                        end = path.size();
+                    std::string_view name = path.substr(pos, end - pos);
+                    bool last = end == path.size();
+                    pos = end + 1;
+                    if (name.empty())
+                        continue;
+
+                    std::string_view actual = name;
+                    std::shared_ptr<const Table> table;
+                    if (name != "." && name != "..")
+                    {
+                        fold_case(name, folded);
+                        table = lookup(out.empty() ? std::string(".") : out, name, folded, actual);
+                        if (!table)
+                        {
+                            if (!(last && missing_leaf))
+                                return false;
+                            actual = name;
+                        }
+                    }
+
+                    if (!out.empty() && out.back() != '/')
+                        out.push_back('/');
+                    out.append(actual);
+                }
+                return true;
+            }
+
+            // Forgets the table for the directory holding `path`, after this process
+            // changed its entries.
+            void invalidate_parent(std::string_view path)
+            {
+                size_t slash = path.rfind('/');
+                std::string dir = slash == std::string_view::npos ? std::string(".") :
+                    std::string(path.substr(0, slash == 0 ? 1 : slash));
+                std::lock_guard<std::mutex> lock(mutex_);
+                tables_.erase(dir);
+            }
+
+            void clear()
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                tables_.clear();
+            }
+
+        private:
+            struct Table
+            {
+                std::int64_t mtime_ns = 0;
+                // Folded name to the spelling on disk.
+                std::unordered_map<std::string, std::string> spellings;
+                // Every spelling of names that fold together; usually empty.
+                std::unordered_set<std::string> collisions;
+
+                bool spell(std::string_view name, const std::string& folded, std::string_view& actual) const
+                {
+                    auto it = spellings.find(folded);
+                    if (it == spellings.end())
+                        return false;
+                    actual = it->second;
+                    if (!collisions.empty() && collisions.count(std::string(name)) != 0)
+                        actual = *collisions.find(std::string(name));
+                    return true;
+                }
+            };
+
+            // The table for `dir` when it can spell `name`, with the spelling in `actual`.
+            // The returned table keeps `actual` alive.
+            std::shared_ptr<const Table> lookup(const std::string& dir,
+                std::string_view name,
+                const std::string& folded,
+                std::string_view& actual)
+            {
+                std::shared_ptr<const Table> table;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    auto it = tables_.find(dir);
+                    if (it != tables_.end())
+                        table = it->second;
+                }
+
+                if (table)
+                {
+                    if (table->spell(name, folded, actual))
+                        return table;
+                    auto current = stat_os_path(to_os_path(dir));
+                    if (!current || current->mtime_ns == table->mtime_ns)
+                        return nullptr;
+                }
+
+                table = list(dir);
+                return table && table->spell(name, folded, actual) ? table : nullptr;
+            }
+
+            // A directory that cannot be read is cached as empty until its mtime changes,
+            // so its misses cost a stat rather than a failed listing each.
+            std::shared_ptr<const Table> list(const std::string& dir)
+            {
+                auto status = stat_os_path(to_os_path(dir));
+                if (!status || status->type != FileType::directory)
+                    return nullptr;
+
+                auto table = std::make_shared<Table>();
+                table->mtime_ns = status->mtime_ns;
+                DirectoryReader reader(to_os_path(dir));
+                std::string_view name;
+                EntryType type;
+                bool symlink = false;
+                std::string folded;
+                while (reader.next(name, type, symlink))
+                {
+                    fold_case(name, folded);
+                    auto [it, added] = table->spellings.emplace(folded, std::string(name));
+                    if (!added)
+                    {
+                        table->collisions.insert(it->second);
+                        table->collisions.emplace(name);
+                    }
+                }
+                if (!reader.is_open() || reader.failed())
+                {
+                    table->spellings.clear();
+                    table->collisions.clear();
+                }
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                tables_[dir] = table;
+                return table;
+            }
+
+            std::string base_;
+            std::mutex mutex_;
+            std::unordered_map<std::string, std::shared_ptr<const Table>> tables_;
+        };
+    }
+
+    // Every call opens its own handles, so concurrent calls are safe; the only state is
+    // the folded-name cache of a case-insensitive backend, which has its own lock.
+    // Concurrent writes to the same file race at the file system level.
+    class DiskBackend final : public Backend
+    {
+    public:
+        explicit DiskBackend(DiskBackendOptions options = DiskBackendOptions())
+            : direct_threshold_(options.direct_io_threshold)
+        {
+#if !defined(_WIN32)
+            if (options.case_insensitive)
+                folded_ = std::make_unique<detail::FoldedNames>(options.fold_base);
+#else
+            (void)options;
+#endif
+        }
+
+        bool exists_file(std::string_view path) override
+        {
+            return with_os_path(path, [](const fs::path& os_path)
+            {
+                std::error_code ec;
+                return fs::is_regular_file(os_path, ec);
+            });
+        }
+
+        bool exists_dir(std::string_view path) override
+        {
+            return with_os_path(path, [](const fs::path& os_path)
+            {
+                std::error_code ec;
+                return fs::is_directory(os_path, ec);
+            });
+        }
+
+        std::optional<FileStat> stat(std::string_view path) override
+        {
+            return with_os_path(path, [](const fs::path& os_path) { return detail::stat_os_path(os_path); });
+        }
+
+        // Files read unbuffered are not worth warming in the OS cache.
+        bool prefetch(std::string_view path) override
+        {
+            return with_os_path(path, [this](const fs::path& os_path)
+            {
+                if (direct_threshold_ != 0)
+                {
+                    auto status = detail::stat_os_path(os_path);
+                    if (status && status->type == FileType::file && status->size >= direct_threshold_)
+                        return true;
+                }
+                return detail::prefetch_os_file(os_path);
+            });
+        }
+
+        // inotify on Linux and ReadDirectoryChangesW on Windows; elsewhere null.
+        std::unique_ptr<BackendWatch> watch(std::string_view path) override
+        {
+#if defined(__linux__) || defined(_WIN32)
+            return with_os_path(path, [](const fs::path& os_path) -> std::unique_ptr<BackendWatch>
+            {
+                return detail::DirectoryWatch::open(os_path);
+            });
+#else
+            (void)path;
+            return nullptr;
+#endif
+        }
+
+        std::optional<Blob> read_file(std::string_view path) override
+        {
+            return with_os_path(path, [this](const fs::path& os_path) -> std::optional<Blob>
+            {
+                auto handle = detail::DiskFileHandle::open(os_path, direct_threshold_);
+                if (!handle || handle->size() > SIZE_MAX)
+                    return std::nullopt;
+
+                size_t size = static_cast<size_t>(handle->size());
+                Blob blob = Blob::allocate(size, nullptr, std::max(handle->direct_alignment(), alignof(std::max_align_t)));
+                if (size > 0 && handle->read_at(0, blob.mutable_data(), size) != size)
+                    return std::nullopt;
+
+                return blob;
+            });
+        }
+
+        std::optional<FileView> map_file(std::string_view path) override
+        {
+            return with_os_path(path, [](const fs::path& os_path) { return detail::map_os_file(os_path); });
+        }
+
+        std::unique_ptr<FileHandle> open_file(std::string_view path) override
+        {
+            return with_os_path(path, [this](const fs::path& os_path) -> std::unique_ptr<FileHandle>
+            {
+                return detail::DiskFileHandle::open(os_path, direct_threshold_);
+            });
+        }
+
+        // Forgets every folded directory listing; for changes made behind the backend's
+        // back on file systems with coarse timestamps.
+        void clear_name_cache()
+        {
+            if (folded_)
+                folded_->clear();
+        }
+
+        Result write_file(std::string_view path, const void* data, size_t size) override
+        {
+            WriteChunk chunk{data, size};
+            return write_file_gather(path, &chunk, 1, WriteOptions());
+        }
+
+        // Case-insensitively, an existing file is overwritten under its own spelling and a
+        // new one is created as spelled inside the matching directory.
+        Result write_file_gather(std::string_view path,
+            const WriteChunk* chunks,
+            size_t count,
+            const WriteOptions& options) override
+        {
+            std::string spelled;
+            std::string_view actual = respell(path, spelled, true);
+            const fs::path os_path = detail::to_os_path(actual);
+            if (options.create_parents && os_path.has_parent_path())
+            {
+                // A failure here surfaces from the write itself.
+                std::error_code ec;
+                fs::create_directories(os_path.parent_path(), ec);
+            }
+            Result result = detail::write_os_file(os_path, chunks, count, options);
+            if (folded_ && result == Result::ok)
+                folded_->invalidate_parent(actual);
+            return result;
+        }
+
+        // A directory never lists a name twice, so allow_duplicates needs no bookkeeping.
+        Result list_files(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateRef& callback,
+            bool allow_duplicates) override
+        {
+            (void)allow_duplicates;
+            std::optional<detail::DirectoryReader> opened;
+            open_dir(path, opened);
+            detail::DirectoryReader& reader = *opened;
+            if (!reader.is_open())
+                return reader.failed() ? Result::io_error : Result::not_found;
+
+            std::string_view name;
+            detail::EntryType type;
+            bool symlink = false;
+            while (reader.next(name, type, symlink))
+            {
+                if (type == detail::EntryType::file &&
+                    detail::extension_matches(detail::extension_of(name), extensions, folded_ != nullptr))
+                    callback(name);
+            }
+
+            return reader.failed() ? Result::io_error : Result::ok;
+        }
+
+        Result list_dirs(std::string_view path,
+            const EnumerateRef& callback,
+            bool allow_duplicates) override
+        {
+            (void)allow_duplicates;
+            std::optional<detail::DirectoryReader> opened;
+            open_dir(path, opened);
+            detail::DirectoryReader& reader = *opened;
+            if (!reader.is_open())
+                return reader.failed() ? Result::io_error : Result::not_found;
+
+            std::string_view name;
+            detail::EntryType type;
+            bool symlink = false;
+            while (reader.next(name, type, symlink))
+            {
+                if (type == detail::EntryType::directory)
+                    callback(name);
+            }
+
+            return reader.failed() ? Result::io_error : Result::ok;
+        }
+
+        // Directory symlinks are not followed, so cycles cannot loop the walk. With more
+        // than one thread, up to one per hardware thread iterate directories on a pool
+        // the backend keeps, while the caller's thread drains finished batches into the
+        // callback.
+        Result walk(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateRef& callback,
+            size_t threads) override
+        {
+            auto found = with_os_path(path, [](const fs::path& os_path) -> std::optional<fs::path>
+            {
+                std::error_code ec;
+                if (!fs::is_directory(os_path, ec))
+                    return std::nullopt;
+                return os_path;
+            });
+            if (!found)
+                return Result::not_found;
+            const fs::path root = std::move(*found);
+
+            // Lists one directory, handing matching file names to `on_file` and queueing
+            // subdirectories as paths relative to the walk root.
+            auto scan = [&](const std::string& relative, auto&& on_file, auto& dirs)
+            {
+                detail::DirectoryReader reader(relative.empty() ? root : root / detail::to_os_path(relative));
+                std::string_view name;
+                detail::EntryType type;
+                bool symlink = false;
+                while (reader.next(name, type, symlink))
+                {
+                    if (type == detail::EntryType::directory && !symlink)
+                    {
+                        std::string child = relative;
+                        if (!child.empty())
+                            child.push_back('/');
+                        child.append(name);
+                        dirs.push_back(std::move(child));
+                    }
+                    else if (type == detail::EntryType::file &&
+                        detail::extension_matches(detail::extension_of(name), extensions, folded_ != nullptr))
+                    {
+                        on_file(name);
+                    }
+                }
+                return reader.is_open() && !reader.failed();
+            };
+
+            threads = std::min<size_t>(threads, std::max(1u, std::thread::hardware_concurrency()));
+            if (threads <= 1)
+            {
+                std::vector<std::string> pending{std::string()};
+                std::string child;
+                while (!pending.empty())
+                {
+                    std::string relative = std::move(pending.back());
+                    pending.pop_back();
+                    bool ok = scan(relative, [&](std::string_view name)
+                    {
+                        child = relative;
+                        if (!child.empty())
+                            child.push_back('/');
+                        child.append(name);
+                        callback(child);
+                    }, pending);
+                    if (!ok)
+                        return Result::io_error;
+                }
+                return Result::ok;
+            }
+
+            std::mutex mutex;
+            std::condition_variable changed;
+            std::deque<std::string> pending{std::string()};
+            std::deque<std::vector<std::string>> batches;
+            size_t busy = 0;
+            size_t helpers = threads;
+            bool failed = false;
+
+            auto worker = [&]
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                for (;;)
+                {
+                    changed.wait(lock, [&] { return !pending.empty() || busy == 0 || failed; });
+                    if (pending.empty() || failed)
+                        return;
+
+                    std::string relative = std::move(pending.front());
+                    pending.pop_front();
+                    ++busy;
+                    lock.unlock();
+
+                    std::vector<std::string> files;
+                    std::vector<std::string> dirs;
+                    bool ok = scan(relative, [&](std::string_view name)
+                    {
+                        std::string& child = files.emplace_back(relative);
+                        if (!child.empty())
+                            child.push_back('/');
+                        child.append(name);
+                    }, dirs);
+
+                    lock.lock();
+                    --busy;
+                    if (!ok)
+                        failed = true;
+                    for (auto& dir : dirs)
+                        pending.push_back(std::move(dir));
+                    if (!files.empty())
+                        batches.push_back(std::move(files));
+                    changed.notify_all();
+                }
+            };
+
+            IoPool& pool = walk_pool();
+            for (size_t i = 0; i < threads; ++i)
+            {
+                pool.submit([&]
+                {
+                    worker();
+                    std::lock_guard<std::mutex> lock(mutex);
+                    --helpers;
+                    changed.notify_all();
+                });
+            }
+
+            // Helpers queued behind another walk start late and find nothing left, but
+            // they still touch this frame, so wait for each one to sign off.
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;)
+            {
+                changed.wait(lock, [&]
+                {
+                    return !batches.empty() || failed || (pending.empty() && busy == 0);
+                });
+                if (batches.empty())
+                    break;
+
+                std::vector<std::string> batch = std::move(batches.front());
+                batches.pop_front();
+                lock.unlock();
+                for (const auto& file : batch)
+                    callback(file);
+                lock.lock();
+            }
+            changed.wait(lock, [&] { return helpers == 0; });
+            return failed ? Result::io_error : Result::ok;
+        }
+
+    private:
+        // Runs `fn` on the OS path, retrying once with the spelling on disk when a
+        // case-insensitive backend finds nothing under the exact one.
+        template <typename Fn>
+        auto with_os_path(std::string_view path, Fn&& fn) -> decltype(fn(fs::path()))
+        {
+            auto result = fn(detail::to_os_path(path));
+            if (result || !folded_)
+                return result;
+
+            std::string spelled;
+            if (folded_->resolve(path, spelled, false) && spelled != path)
+                return fn(detail::to_os_path(spelled));
+            return result;
+        }
+
+        // Opens the directory, retrying with the spelling on disk only when nothing is
+        // there under the exact one.
+        void open_dir(std::string_view path, std::optional<detail::DirectoryReader>& reader) const
+        {
+            reader.emplace(detail::to_os_path(path));
+            if (reader->is_open() || reader->failed() || !folded_)
+                return;
+
+            std::string spelled;
+            if (folded_->resolve(path, spelled, false) && spelled != path)
+            {
+                reader.reset();
+                reader.emplace(detail::to_os_path(spelled));
+            }
+        }
+
+        // `path` as spelled on disk; unchanged when it exists as given or matches nothing.
+        // Costs a stat even for exact spellings, which only writes need.
+        std::string_view respell(std::string_view path, std::string& storage, bool missing_leaf = false) const
+        {
+            if (!folded_)
+                return path;
+            std::error_code ec;
+            if (fs::exists(detail::to_os_path(path), ec) || !folded_->resolve(path, storage, missing_leaf))
+                return path;
+            return storage;
+        }
+
+        // Held on the heap so the backend stays movable.
+        struct WalkPool
+        {
+            std::mutex mutex;
+            std::unique_ptr<IoPool> pool;
+        };
+
+        // Started on the first parallel walk, one worker per hardware thread.
+        IoPool& walk_pool()
+        {
+            std::lock_guard<std::mutex> lock(walk_pool_->mutex);
+            if (!walk_pool_->pool)
+                walk_pool_->pool = std::make_unique<IoPool>(std::max(1u, std::thread::hardware_concurrency()));
+            return *walk_pool_->pool;
+        }
+
+        std::uint64_t direct_threshold_;
+        std::unique_ptr<detail::FoldedNames> folded_;
+        std::unique_ptr<WalkPool> walk_pool_ = std::make_unique<WalkPool>();
+    };
+
+    namespace detail
+    {
+        // `path` rebased onto `base`. Canonical virtual paths are joined onto the base as
+        // text; anything else goes through fs::path lexical normalization.
+        inline std::string_view map_subtree(const fs::path& base,
+            std::string_view base_text,
+            std::string_view path,
+            PathBuffer& out)
+        {
+            if (!is_canonical_virtual_path(path))
+            {
+                out.clear();
+                if (base.empty())
+                    out.append(fs::path(path).lexically_normal().generic_string());
+                else
+                    out.append((base / fs::path(path)).lexically_normal().generic_string());
+                return out.view();
+            }
+
+            if (base_text.empty())
+            {
+                out.assign_view(path);
+                return out.view();
+            }
+
+            if (path.empty())
+            {
+                out.assign_view(base_text);
+                return out.view();
+            }
+
+            out.clear();
+            out.append(base_text);
+            if (base_text.back() != '/')
+                out.push_back('/');
+            out.append(path);
+            return out.view();
+        }
+    }
+
+    // Rebases paths onto a fixed base directory. The base never changes after
+    // construction, so it is as thread-safe as the backend it wraps.
+    class SubtreeBackend final : public Backend
+    {
+    public:
+        SubtreeBackend(std::shared_ptr<Backend> backend, fs::path base)
+            : backend_(std::move(backend))
+            , base_(std::move(base).lexically_normal())
+            , base_text_(base_.generic_string())
+        {
+        }
+
+        bool exists_file(std::string_view path) override
+        {
+            detail::PathBuffer buffer;
+            return backend_->exists_file(map(path, buffer));
+        }
+
+        bool exists_dir(std::string_view path) override
+        {
+            detail::PathBuffer buffer;
+            return backend_->exists_dir(map(path, buffer));
+        }
+
+        std::optional<FileStat> stat(std::string_view path) override
+        {
+            detail::PathBuffer buffer;
+            return backend_->stat(map(path, buffer));
+        }
+
+        std::optional<std::uint64_t> content_hash(std::string_view path) override
+        {
+            detail::PathBuffer buffer;
+            return backend_->content_hash(map(path, buffer));
+        }
+
+        bool prefetch(std::string_view path) override
+        {
+            detail::PathBuffer buffer;
+            return backend_->prefetch(map(path, buffer));
+        }
+
+        std::unique_ptr<BackendWatch> watch(std::string_view path) override
+        {
+            detail::PathBuffer buffer;
+            return backend_->watch(map(path, buffer));
+        }
+
+        std::optional<Blob> read_file(std::string_view path) override
+        {
+            detail::PathBuffer buffer;
+            return backend_->read_file(map(path, buffer));
+        }
+
+        std::optional<FileView> map_file(std::string_view path) override
+        {
+            detail::PathBuffer buffer;
+            return backend_->map_file(map(path, buffer));
+        }
+
+        std::unique_ptr<FileHandle> open_file(std::string_view path) override
+        {
+            detail::PathBuffer buffer;
+            return backend_->open_file(map(path, buffer));
+        }
+
+        void read_files(const std::vector<std::string_view>& paths, const BatchReadFn& callback) override
+        {
+            std::vector<std::string> mapped;
+            mapped.reserve(paths.size());
+            detail::PathBuffer buffer;
+            for (std::string_view path : paths)
+                mapped.emplace_back(map(path, buffer));
+
+            std::vector<std::string_view> views(mapped.begin(), mapped.end());
+            backend_->read_files(views, callback);
+        }
+
+        Result write_file(std::string_view path, const void* data, size_t size) override
+        {
+            detail::PathBuffer buffer;
+            return backend_->write_file(map(path, buffer), data, size);
+        }
+
+        Result write_file_gather(std::string_view path,
+            const WriteChunk* chunks,
+            size_t count,
+            const WriteOptions& options) override
+        {
+            detail::PathBuffer buffer;
+            return backend_->write_file_gather(map(path, buffer), chunks, count, options);
+        }
+
+        Result list_files(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateRef& callback,
+            bool allow_duplicates) override
+        {
+            detail::PathBuffer buffer;
+            return backend_->list_files(map(path, buffer), extensions, callback, allow_duplicates);
+        }
+
+        Result list_dirs(std::string_view path,
+            const EnumerateRef& callback,
+            bool allow_duplicates) override
+        {
+            detail::PathBuffer buffer;
+            return backend_->list_dirs(map(path, buffer), callback, allow_duplicates);
+        }
+
+        Result walk(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateRef& callback,
+            size_t threads) override
+        {
+            detail::PathBuffer buffer;
+            return backend_->walk(map(path, buffer), extensions, callback, threads);
+        }
+
+    private:
+        std::shared_ptr<Backend> backend_;
+        fs::path base_;
+        std::string base_text_;
+
+        std::string_view map(std::string_view path, detail::PathBuffer& out) const
+        {
+            return detail::map_subtree(base_, base_text_, path, out);
+        }
+    };
+
+    // Decorator that keeps recently read files in a byte-budgeted LRU. Hits hand out a
+    // Blob sharing the cached buffer, so repeated reads neither touch the wrapped backend
+    // nor copy. Writes made through this backend drop the cached entry. Safe to use from
+    // several threads.
+    class CachingBackend final : public Backend
+    {
+    public:
+        CachingBackend(std::shared_ptr<Backend> backend, size_t budget_bytes)
+            : backend_(std::move(backend))
+            , budget_(budget_bytes)
+        {
+        }
+
+        size_t budget() const noexcept { return budget_; }
+
+        size_t cached_bytes() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return cached_bytes_;
+        }
+
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++generation_;
+            lookup_.clear();
+            lru_.clear();
+            cached_bytes_ = 0;
+        }
+
+        void invalidate(std::string_view path)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++generation_;
+            erase_locked(path);
+        }
+
+        bool exists_file(std::string_view path) override
+        {
+            if (find(path))
+                return true;
+            return backend_->exists_file(path);
+        }
+
+        bool exists_dir(std::string_view path) override
+        {
+            return backend_->exists_dir(path);
+        }
+
+        std::optional<FileStat> stat(std::string_view path) override
+        {
+            return backend_->stat(path);
+        }
+
+        std::optional<std::uint64_t> content_hash(std::string_view path) override
+        {
+            return backend_->content_hash(path);
+        }
+
+        // Loads the file into the cache, so the later read is served from memory.
+        bool prefetch(std::string_view path) override
+        {
+            return read_file(path).has_value();
+        }
+
+        // Changed files are dropped from the cache as the watch reports them, and the
+        // whole cache when notifications were lost.
+        std::unique_ptr<BackendWatch> watch(std::string_view path) override
+        {
+            auto inner = backend_->watch(path);
+            if (!inner)
+                return nullptr;
+            return std::make_unique<Watch>(*this, path, std::move(inner));
+        }
+
+        std::optional<Blob> read_file(std::string_view path) override
+        {
+            KeyBuffer key_buffer;
+            std::string_view key = cache_key(path, key_buffer);
+            if (auto cached = find(key))
+                return cached;
+
+            std::uint64_t generation = current_generation();
+            auto blob = backend_->read_file(path);
+            if (blob)
+                insert(key, *blob, generation);
+            return blob;
+        }
+
+        std::optional<FileView> map_file(std::string_view path) override
+        {
+            KeyBuffer key_buffer;
+            if (auto cached = find(cache_key(path, key_buffer)))
+                return FileView(cached->data(), cached->size(), cached->owner());
+            return backend_->map_file(path);
+        }
+
+        std::unique_ptr<FileHandle> open_file(std::string_view path) override
+        {
+            KeyBuffer key_buffer;
+            if (auto cached = find(cache_key(path, key_buffer)))
+                return std::make_unique<ViewFileHandle>(FileView(cached->data(), cached->size(), cached->owner()));
+            return backend_->open_file(path);
+        }
+
+        void read_files(const std::vector<std::string_view>& paths, const BatchReadFn& callback) override
+        {
+            std::vector<KeyBuffer> key_buffers(paths.size());
+            std::vector<std::string_view> misses;
+            std::vector<std::string_view> keys;
+            std::vector<size_t> requests;
+            for (size_t i = 0; i < paths.size(); ++i)
+            {
+                std::string_view key = cache_key(paths[i], key_buffers[i]);
+                if (auto cached = find(key))
+                {
+                    callback(i, std::move(cached));
+                    continue;
+                }
+                misses.push_back(paths[i]);
+                keys.push_back(key);
+                requests.push_back(i);
+            }
+
+            if (misses.empty())
+                return;
+
+            std::uint64_t generation = current_generation();
+            backend_->read_files(misses, [&](size_t index, std::optional<Blob> blob)
+            {
+                if (blob)
+                    insert(keys[index], *blob, generation);
+                callback(requests[index], std::move(blob));
+            });
+        }
+
+        Result write_file(std::string_view path, const void* data, size_t size) override
+        {
+            invalidate(path);
+            Result result = backend_->write_file(path, data, size);
+            invalidate(path);
+            return result;
+        }
+
+        Result write_file_gather(std::string_view path,
+            const WriteChunk* chunks,
+            size_t count,
+            const WriteOptions& options) override
+        {
+            invalidate(path);
+            Result result = backend_->write_file_gather(path, chunks, count, options);
+            invalidate(path);
+            return result;
+        }
+
+        Result list_files(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateRef& callback,
+            bool allow_duplicates) override
+        {
+            return backend_->list_files(path, extensions, callback, allow_duplicates);
+        }
+
+        Result list_dirs(std::string_view path,
+            const EnumerateRef& callback,
+            bool allow_duplicates) override
+        {
+            return backend_->list_dirs(path, callback, allow_duplicates);
+        }
+
+        Result walk(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateRef& callback,
+            size_t threads) override
+        {
+            return backend_->walk(path, extensions, callback, threads);
+        }
+
+    private:
+        class Watch final : public BackendWatch
+        {
+        public:
+            Watch(CachingBackend& owner, std::string_view root, std::unique_ptr<BackendWatch> inner)
+                : owner_(owner)
+                , root_(root)
+                , inner_(std::move(inner))
+            {
+            }
+
+            bool poll(const ChangeFn& callback) override
+            {
+                std::string path;
+                bool complete = inner_->poll([&](ChangeKind kind, std::string_view relative)
+                {
+                    path = root_;
+                    if (!path.empty())
+                        path.push_back('/');
+                    path.append(relative);
+                    owner_.invalidate(path);
+                    callback(kind, relative);
+                });
+                if (!complete)
+                    owner_.clear();
+                return complete;
+            }
+
+        private:
+            CachingBackend& owner_;
+            std::string root_;
+            std::unique_ptr<BackendWatch> inner_;
+        };
+
+        // Entries are keyed by path, or by content hash when the wrapped backend reports
+        // one, so identical files share a single cached buffer.
+        struct Entry
+        {
+            std::string path;
+            Blob blob;
+        };
+
+        // A NUL byte followed by the hash in hex; normalized paths never start with NUL.
+        using KeyBuffer = std::array<char, 17>;
+
+        std::string_view cache_key(std::string_view path, KeyBuffer& buffer)
+        {
+            auto hash = backend_->content_hash(path);
+            if (!hash)
+                return path;
+
+            buffer[0] = '\0';
+            for (int i = 0; i < 16; ++i)
+                buffer[1 + i] = "0123456789abcdef"[(*hash >> (60 - 4 * i)) & 0xf];
+            return std::string_view(buffer.data(), buffer.size());
+        }
+
+        std::shared_ptr<Backend> backend_;
+        size_t budget_;
+        mutable std::mutex mutex_;
+        std::list<Entry> lru_;
+        // Keys view the path stored in the list node, which never moves.
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> lookup_;
+        size_t cached_bytes_ = 0;
+        // Bumped by every invalidation so reads that raced a write do not repopulate.
+        std::uint64_t generation_ = 0;
+
+        std::uint64_t current_generation() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return generation_;
+        }
+
+        std::optional<Blob> find(std::string_view path)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto found = lookup_.find(path);
+            if (found == lookup_.end())
+                return std::nullopt;
+
+            lru_.splice(lru_.begin(), lru_, found->second);
+            return found->second->blob;
+        }
+
+        void insert(std::string_view path, const Blob& blob, std::uint64_t generation)
+        {
+            if (blob.size() > budget_)
+                return;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (generation != generation_)
+                return;
+
+            erase_locked(path);
+            lru_.push_front(Entry{std::string(path), blob});
+            lookup_.emplace(lru_.front().path, lru_.begin());
+            cached_bytes_ += blob.size();
+
+            while (cached_bytes_ > budget_)
+            {
+                Entry& victim = lru_.back();
+                cached_bytes_ -= victim.blob.size();
+                lookup_.erase(victim.path);
+                lru_.pop_back();
+            }
+        }
+
+        void erase_locked(std::string_view path)
+        {
+            auto found = lookup_.find(path);
+            if (found == lookup_.end())
+                return;
+
+            cached_bytes_ -= found->second->blob.size();
+            auto entry = found->second;
+            lookup_.erase(found);
+            lru_.erase(entry);
+        }
+    };
+
+    // Compressed file layout (little-endian):
+    //   header: "TVFSBLK1", u32 version, u32 block size, u64 raw size, u32 block count, u32 reserved
+    //   table:  per block u32 stored size, with raw_flag set for blocks kept uncompressed
+    //   blocks: stored block bytes, in order
+    namespace blocks
+    {
+        constexpr char magic[8] = {'T', 'V', 'F', 'S', 'B', 'L', 'K', '1'};
+        constexpr std::uint32_t version = 1;
+        constexpr size_t header_size = 32;
+        // Set in a block's stored size when the block did not shrink and is kept raw.
+        constexpr std::uint32_t raw_flag = 0x80000000u;
+        constexpr size_t default_block_size = 64 * 1024;
+    }
+
+    namespace detail
+    {
+        // LZ4 block format (no frame): sequences of a token, literals, a 16-bit offset and
+        // a match length. Greedy single-probe matching keeps the encoder small; output is
+        // readable by any LZ4 block decoder.
+        inline size_t lz4_bound(size_t size) noexcept
+        {
+            return size + size / 255 + 16;
+        }
+
+        inline std::byte* lz4_write_length(std::byte* out, size_t length) noexcept
+        {
+            for (; length >= 255; length -= 255)
+                *out++ = std::byte{255};
+            *out++ = static_cast<std::byte>(length);
+            return out;
+        }
+
+        // Returns the compressed size, or 0 when the output does not fit in `capacity`.
+        inline size_t lz4_compress(const std::byte* src, size_t size, std::byte* dst, size_t capacity)
+        {
+            constexpr size_t min_match = 4;
+            constexpr size_t last_literals = 5;
+            constexpr size_t match_find_limit = 12;
+            constexpr int hash_bits = 12;
+
+            std::byte* out = dst;
+            std::byte* const out_end = dst + capacity;
+            size_t anchor = 0;
+
+            auto emit = [&](size_t literal, size_t offset, size_t match) -> bool
+            {
+                size_t needed = 1 + literal / 255 + 1 + literal + 2 + match / 255 + 1;
+                if (needed > static_cast<size_t>(out_end - out))
+                    return false;
+
+                std::byte* token = out++;
+                *token = static_cast<std::byte>(std::min<size_t>(literal, 15) << 4);
+                if (literal >= 15)
+                    out = lz4_write_length(out, literal - 15);
+                std::memcpy(out, src + anchor, literal);
+                out += literal;
+
+                if (offset == 0)
+                    return true;
+
+                *out++ = static_cast<std::byte>(offset & 0xff);
+                *out++ = static_cast<std::byte>(offset >> 8);
+                size_t extra = match - min_match;
+                *token |= static_cast<std::byte>(std::min<size_t>(extra, 15));
+                if (extra >= 15)
+                    out = lz4_write_length(out, extra - 15);
+                return true;
+            };
+
+            if (size >= match_find_limit)
+            {
+                std::uint32_t table[1u << hash_bits] = {};
+                const size_t match_limit = size - last_literals;
+                const size_t scan_limit = size - match_find_limit;
+                auto load32 = [&](size_t at)
+                {
+                    std::uint32_t value;
+                    std::memcpy(&value, src + at, sizeof(value));
+                    return value;
+                };
+
+                size_t pos = 0;
+                while (pos <= scan_limit)
+                {
+                    std::uint32_t sequence = load32(pos);
+                    std::uint32_t hash = (sequence * 2654435761u) >> (32 - hash_bits);
+                    size_t candidate = table[hash];
+                    table[hash] = static_cast<std::uint32_t>(pos);
+
+                    if (candidate < pos && pos - candidate <= 0xffff && load32(candidate) == sequence)
+                    {
+                        size_t length = min_match;
+                        while (pos + length < match_limit && src[candidate + length] == src[pos + length])
+                            ++length;
+
+                        if (!emit(pos - anchor, pos - candidate, length))
+                            return 0;
+                        pos += length;
+                        anchor = pos;
+                        continue;
+                    }
+                    ++pos;
+                }
+            }
+
+            if (!emit(size - anchor, 0, 0))
+                return 0;
+            return static_cast<size_t>(out - dst);
+        }
+
+        // Fails on any malformed input rather than reading or writing out of bounds; the
+        // output must be filled exactly.
+        inline bool lz4_decompress(const std::byte* src, size_t size, std::byte* dst, size_t raw_size) noexcept
+        {
+            const std::byte* in = src;
+            const std::byte* const in_end = src + size;
+            std::byte* out = dst;
+            std::byte* const out_end = dst + raw_size;
+
+            auto read_length = [&](size_t& length) -> bool
+            {
+                std::uint8_t byte;
+                do
+                {
+                    if (in >= in_end)
+                        return false;
+                    byte = static_cast<std::uint8_t>(*in++);
+                    length += byte;
+                } while (byte == 255);
+                return true;
+            };
+
+            for (;;)
+            {
+                if (in >= in_end)
+                    return false;
+                std::uint8_t token = static_cast<std::uint8_t>(*in++);
+
+                size_t literal = token >> 4;
+                if (literal == 15 && !read_length(literal))
+                    return false;
+                if (literal > static_cast<size_t>(in_end - in) || literal > static_cast<size_t>(out_end - out))
+                    return false;
+                std::memcpy(out, in, literal);
+                in += literal;
+                out += literal;
+
+                if (in == in_end)
+                    return out == out_end;
+
+                if (in_end - in < 2)
+                    return false;
+                size_t offset = static_cast<size_t>(in[0]) | (static_cast<size_t>(in[1]) << 8);
+                in += 2;
+                if (offset == 0 || offset > static_cast<size_t>(out - dst))
+                    return false;
+
+                size_t match = token & 15;
+                if (match == 15 && !read_length(match))
+                    return false;
+                match += 4;
+                if (match > static_cast<size_t>(out_end - out))
+                    return false;
+
+                const std::byte* from = out - offset;
+                if (offset >= match)
+                {
+                    std::memcpy(out, from, match);
+                    out += match;
+                }
+                else
+                {
+                    // Overlapping copies repeat the last `offset` bytes.
+                    for (size_t i = 0; i < match; ++i)
+                        *out++ = from[i];
+                }
+            }
+        }
+
+        // Parsed block header of a compressed file; offsets are relative to the file start.
+        struct BlockLayout
+        {
+            std::uint64_t raw_size = 0;
+            size_t block_size = 0;
+            std::vector<std::uint32_t> stored;
+            std::vector<std::uint64_t> offsets;
+
+            size_t block_count() const noexcept { return stored.size(); }
+
+            size_t raw_length(size_t block) const noexcept
+            {
+                std::uint64_t start = static_cast<std::uint64_t>(block) * block_size;
+                return static_cast<size_t>(std::min<std::uint64_t>(block_size, raw_size - start));
+            }
+
+            static bool has_header(const std::byte* data, size_t size) noexcept
+            {
+                return size >= blocks::header_size && std::memcmp(data, blocks::magic, sizeof(blocks::magic)) == 0;
+            }
+
+            bool parse(const std::byte* data, size_t size)
+            {
+                if (!has_header(data, size) || load_le32(data + 8) != blocks::version)
+                    return false;
+
+                block_size = load_le32(data + 12);
+                raw_size = load_le64(data + 16);
+                std::uint64_t count = load_le32(data + 24);
+                if (block_size == 0 || raw_size > SIZE_MAX ||
+                    count != (raw_size + block_size - 1) / block_size ||
+                    count > (size - blocks::header_size) / 4)
+                {
+                    return false;
+                }
+
+                stored.resize(static_cast<size_t>(count));
+                offsets.resize(static_cast<size_t>(count) + 1);
+                std::uint64_t offset = blocks::header_size + count * 4;
+                for (size_t i = 0; i < count; ++i)
+                {
+                    stored[i] = load_le32(data + blocks::header_size + i * 4);
+                    offsets[i] = offset;
+                    std::uint32_t length = stored[i] & ~blocks::raw_flag;
+                    if ((stored[i] & blocks::raw_flag) && length != raw_length(i))
+                        return false;
+                    offset += length;
+                }
+                offsets[static_cast<size_t>(count)] = offset;
+                return offset <= size;
+            }
+
+            bool decode(const std::byte* data, size_t block, std::byte* dst) const noexcept
+            {
+                const std::byte* in = data + offsets[block];
+                size_t length = stored[block] & ~blocks::raw_flag;
+                if (stored[block] & blocks::raw_flag)
+                {
+                    std::memcpy(dst, in, length);
+                    return true;
+                }
+                return lz4_decompress(in, length, dst, raw_length(block));
+            }
+        };
+
+        // Range reads over a block-compressed view, decompressing only the touched blocks.
+        // The last partially read block is kept, under a lock, so sequential reads decode
+        // each block once; whole blocks decode straight into the caller's buffer.
+        class BlockFileHandle final : public FileHandle
+        {
+        public:
+            BlockFileHandle(FileView view, BlockLayout layout)
+                : view_(std::move(view))
+                , layout_(std::move(layout))
+            {
+            }
+
+            std::uint64_t size() const override { return layout_.raw_size; }
+
+            size_t read_at(std::uint64_t offset, void* dst, size_t size) override
+            {
+                if (offset >= layout_.raw_size)
+                    return 0;
+                size = static_cast<size_t>(std::min<std::uint64_t>(size, layout_.raw_size - offset));
+
+                std::byte* out = static_cast<std::byte*>(dst);
+                size_t done = 0;
+                while (done < size)
+                {
+                    std::uint64_t position = offset + done;
+                    size_t block = static_cast<size_t>(position / layout_.block_size);
+                    size_t within = static_cast<size_t>(position % layout_.block_size);
+                    size_t length = layout_.raw_length(block);
+                    size_t count = std::min(length - within, size - done);
+
+                    if (within == 0 && count == length)
+                    {
+                        if (!layout_.decode(view_.data(), block, out + done))
+                            return done;
+                    }
+                    else
+                    {
+                        std::lock_guard<std::mutex> lock(cache_mutex_);
+                        if (block != cached_block_)
+                        {
+                            cached_.resize(layout_.block_size);
+                            cached_block_ = npos;
+                            if (!layout_.decode(view_.data(), block, cached_.data()))
+                                return done;
+                            cached_block_ = block;
+                        }
+                        std::memcpy(out + done, cached_.data() + within, count);
+                    }
+                    done += count;
+                }
+                return done;
+            }
+
+        private:
+            static constexpr size_t npos = static_cast<size_t>(-1);
+
+            FileView view_;
+            BlockLayout layout_;
+            std::mutex cache_mutex_;
+            std::vector<std::byte> cached_;
+            size_t cached_block_ = npos;
+        };
+    }
+
+    // Decorator for files stored as independently LZ4-compressed blocks (see encode()).
+    // Whole-file reads decompress blocks on the calling thread plus up to `threads - 1`
+    // workers of a pool the backend keeps; open_file()
+    // decompresses only the blocks a range touches. Writes are compressed on the way
+    // down, and files without the block header pass through untouched, so compressed
+    // and plain files can share a tree.
+    class CompressedBackend final : public Backend
+    {
+    public:
+        explicit CompressedBackend(std::shared_ptr<Backend> backend,
+            size_t threads = 1,
+            size_t block_size = blocks::default_block_size)
+            : backend_(std::move(backend))
+            , threads_(threads == 0 ? 1 : threads)
+            , block_size_(valid_block_size(block_size))
+            , pool_(threads_ > 1 ? std::make_unique<IoPool>(threads_ - 1) : nullptr)
+        {
+        }
+
+        // Produces the stored form of `data`: a header, a table of block sizes and the
+        // blocks. Blocks that do not shrink are kept raw.
+        static Blob encode(const void* data, size_t size, size_t block_size = blocks::default_block_size)
+        {
+            block_size = valid_block_size(block_size);
+            const std::byte* src = static_cast<const std::byte*>(data);
+            const size_t count = (size + block_size - 1) / block_size;
+            const size_t table_end = blocks::header_size + count * 4;
+
+            std::vector<std::byte> out(table_end);
+            std::memcpy(out.data(), blocks::magic, sizeof(blocks::magic));
+            detail::store_le32(out.data() + 8, blocks::version);
+            detail::store_le32(out.data() + 12, static_cast<std::uint32_t>(block_size));
+            detail::store_le64(out.data() + 16, size);
+            detail::store_le32(out.data() + 24, static_cast<std::uint32_t>(count));
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                size_t length = std::min(block_size, size - i * block_size);
+                size_t start = out.size();
+                out.resize(start + detail::lz4_bound(length));
+                size_t packed = detail::lz4_compress(src + i * block_size, length, out.data() + start, length - 1);
+
+                std::uint32_t stored = static_cast<std::uint32_t>(packed);
+                if (packed == 0)
+                {
+                    std::memcpy(out.data() + start, src + i * block_size, length);
+                    packed = length;
+                    stored = static_cast<std::uint32_t>(length) | blocks::raw_flag;
+                }
+                out.resize(start + packed);
+                detail::store_le32(out.data() + blocks::header_size + i * 4, stored);
+            }
+
+            return Blob::copy(out.data(), out.size());
+        }
+
+        bool exists_file(std::string_view path) override
+        {
+            return backend_->exists_file(path);
+        }
+
+        bool exists_dir(std::string_view path) override
+        {
+            return backend_->exists_dir(path);
+        }
+
+        // The encoder is deterministic, so the stored bytes identify the decoded bytes.
+        std::optional<std::uint64_t> content_hash(std::string_view path) override
+        {
+            return backend_->content_hash(path);
+        }
+
+        bool prefetch(std::string_view path) override
+        {
+            return backend_->prefetch(path);
+        }
+
+        std::unique_ptr<BackendWatch> watch(std::string_view path) override
+        {
+            return backend_->watch(path);
+        }
+
+        // Reports the uncompressed size; only the header is read.
+        std::optional<FileStat> stat(std::string_view path) override
+        {
+            auto result = backend_->stat(path);
+            if (!result || result->type != FileType::file || result->size < blocks::header_size)
+                return result;
+
+            auto handle = backend_->open_file(path);
+            std::byte header[blocks::header_size];
+            if (handle && handle->read_at(0, header, sizeof(header)) == sizeof(header) &&
+                detail::BlockLayout::has_header(header, sizeof(header)))
+            {
+                result->size = detail::load_le64(header + 16);
+            }
+            return result;
+        }
+
+        std::optional<Blob> read_file(std::string_view path) override
+        {
+            auto view = backend_->map_file(path);
+            if (!view)
+                return std::nullopt;
+
+            detail::BlockLayout layout;
+            if (!detail::BlockLayout::has_header(view->data(), view->size()))
+                return Blob(view->data(), view->size(), view->owner());
+            if (!layout.parse(view->data(), view->size()))
+                return std::nullopt;
+
+            Blob blob = Blob::allocate(static_cast<size_t>(layout.raw_size));
+            const size_t count = layout.block_count();
+            auto decode = [&](size_t block)
+            {
+                return layout.decode(view->data(), block, blob.mutable_data() + block * layout.block_size);
+            };
+
+            const size_t workers = std::min(threads_, count);
+            if (workers <= 1)
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    if (!decode(i))
+                        return std::nullopt;
+                }
+                return blob;
+            }
+
+            std::atomic<size_t> next{0};
+            std::atomic<bool> failed{false};
+            auto work = [&]
+            {
+                for (size_t i = next.fetch_add(1); i < count && !failed.load(std::memory_order_relaxed);
+                     i = next.fetch_add(1))
+                {
+                    if (!decode(i))
+                        failed.store(true, std::memory_order_relaxed);
+                }
+            };
+
+            // This thread decodes too; the helpers only signal once they are done with
+            // the locals, under the lock, so the wait below can return safely.
+            std::mutex done_mutex;
+            std::condition_variable done;
+            size_t helpers = workers - 1;
+            for (size_t i = 1; i < workers; ++i)
+            {
+                pool_->submit([&]
+                {
+                    work();
+                    std::lock_guard<std::mutex> lock(done_mutex);
+                    if (--helpers == 0)
+                        done.notify_one();
+                });
+            }
+            work();
+            {
+                std::unique_lock<std::mutex> lock(done_mutex);
+                done.wait(lock, [&] { return helpers == 0; });
+            }
+
+            if (failed.load())
+                return std::nullopt;
+            return blob;
+        }
+
+        std::unique_ptr<FileHandle> open_file(std::string_view path) override
+        {
+            auto view = backend_->map_file(path);
+            if (!view)
+                return nullptr;
+            if (!detail::BlockLayout::has_header(view->data(), view->size()))
+                return std::make_unique<ViewFileHandle>(std::move(*view));
+
+            detail::BlockLayout layout;
+            if (!layout.parse(view->data(), view->size()))
+                return nullptr;
+            return std::make_unique<detail::BlockFileHandle>(std::move(*view), std::move(layout));
+        }
+
+        Result write_file(std::string_view path, const void* data, size_t size) override
+        {
+            Blob encoded = encode(data, size, block_size_);
+            return backend_->write_file(path, encoded.data(), encoded.size());
+        }
+
+        // Blocks span chunk boundaries, so the chunks are joined before compressing.
+        Result write_file_gather(std::string_view path,
+            const WriteChunk* chunks,
+            size_t count,
+            const WriteOptions& options) override
+        {
+            std::vector<std::byte> joined;
+            for (size_t i = 0; i < count; ++i)
+            {
+                const std::byte* data = static_cast<const std::byte*>(chunks[i].data);
+                joined.insert(joined.end(), data, data + chunks[i].size);
+            }
+
+            Blob encoded = encode(joined.data(), joined.size(), block_size_);
+            WriteChunk chunk{encoded.data(), encoded.size()};
+            return backend_->write_file_gather(path, &chunk, 1, options);
+        }
+
+        Result list_files(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateRef& callback,
+            bool allow_duplicates) override
+        {
+            return backend_->list_files(path, extensions, callback, allow_duplicates);
+        }
+
+        Result list_dirs(std::string_view path,
+            const EnumerateRef& callback,
+            bool allow_duplicates) override
+        {
+            return backend_->list_dirs(path, callback, allow_duplicates);
+        }
+
+        Result walk(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateRef& callback,
+            size_t threads) override
+        {
+            return backend_->walk(path, extensions, callback, threads);
+        }
+
+    private:
+        static size_t valid_block_size(size_t block_size) noexcept
+        {
+            if (block_size == 0 || block_size >= blocks::raw_flag)
+                return blocks::default_block_size;
+            return block_size;
+        }
+
+        std::shared_ptr<Backend> backend_;
+        size_t threads_;
+        size_t block_size_;
+        std::unique_ptr<IoPool> pool_;
+    };
+
+    // Content-addressed storage on top of another backend. A manifest maps virtual paths
+    // to XXH64 hashes of their contents and each distinct content is stored once, as
+    // objects/<hash> next to the manifest. Whole-file reads are verified against the hash
+    // chunk by chunk as they are read; open_file() ranges are served unverified. Objects
+    // that lose their last reference are left in place.
+    class ContentStoreBackend final : public Backend
+    {
+    public:
+        static constexpr std::string_view manifest_name = "manifest.tvfs";
+
+        // Loads the manifest from `store`; a store without one starts empty, and the first
+        // write creates its directories. Returns null when the manifest exists but cannot
+        // be parsed.
+        static std::shared_ptr<ContentStoreBackend> open(std::shared_ptr<Backend> store, bool verify = true)
+        {
+            auto backend = std::shared_ptr<ContentStoreBackend>(new ContentStoreBackend(std::move(store), verify));
+            if (auto manifest = backend->store_->read_file(manifest_name))
+            {
+                if (!backend->load_manifest(manifest->as_string_view()))
+                    return nullptr;
+            }
+            return backend;
+        }
+
+        // Number of manifest entries and of distinct stored contents.
+        size_t file_count() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return entries_.size();
+        }
+
+        size_t object_count() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::unordered_set<std::uint64_t> objects;
+            for (const auto& entry : entries_)
+                objects.insert(entry.second.hash);
+            return objects.size();
+        }
+
+        bool exists_file(std::string_view path) override
+        {
+            Entry entry;
+            return find(path, entry);
+        }
+
+        bool exists_dir(std::string_view path) override
+        {
+            if (path.empty())
+                return true;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = lower_bound_dir(path);
+            return it != entries_.end() && in_dir(it->first, path);
+        }
+
+        std::optional<FileStat> stat(std::string_view path) override
+        {
+            FileStat result;
+            Entry entry;
+            if (find(path, entry))
+            {
+                result.size = entry.size;
+                return result;
+            }
+
+            if (!exists_dir(path))
+                return std::nullopt;
+            result.type = FileType::directory;
+            return result;
+        }
+
+        std::optional<std::uint64_t> content_hash(std::string_view path) override
+        {
+            Entry entry;
+            if (!find(path, entry))
+                return std::nullopt;
+            return entry.hash;
+        }
+
+        bool prefetch(std::string_view path) override
+        {
+            Entry entry;
+            return find(path, entry) && store_->prefetch(object_path(entry.hash));
+        }
+
+        std::optional<Blob> read_file(std::string_view path) override
+        {
+            Entry entry;
+            if (!find(path, entry) || entry.size > SIZE_MAX)
+                return std::nullopt;
+
+            std::string object = object_path(entry.hash);
+            auto handle = store_->open_file(object);
+            if (!handle || handle->size() != entry.size)
+                return std::nullopt;
+
+            constexpr size_t chunk_size = 1u << 20;
+            const size_t size = static_cast<size_t>(entry.size);
+            Blob blob = Blob::allocate(size);
+            detail::Xxh64 hasher;
+            for (size_t offset = 0; offset < size;)
+            {
+                size_t count = std::min(chunk_size, size - offset);
+                if (handle->read_at(offset, blob.mutable_data() + offset, count) != count)
+                    return std::nullopt;
+                if (verify_)
+                    hasher.update(blob.data() + offset, count);
+                offset += count;
+            }
+
+            if (verify_ && hasher.digest() != entry.hash)
+                return std::nullopt;
+            return blob;
+        }
+
+        std::optional<FileView> map_file(std::string_view path) override
+        {
+            Entry entry;
+            if (!find(path, entry))
+                return std::nullopt;
+
+            auto view = store_->map_file(object_path(entry.hash));
+            if (!view || view->size() != entry.size)
+                return std::nullopt;
+            if (verify_ && detail::Xxh64::hash(view->data(), view->size()) != entry.hash)
+                return std::nullopt;
+            return view;
+        }
+
+        std::unique_ptr<FileHandle> open_file(std::string_view path) override
+        {
+            Entry entry;
+            if (!find(path, entry))
+                return nullptr;
+            return store_->open_file(object_path(entry.hash));
+        }
+
+        Result write_file(std::string_view path, const void* data, size_t size) override
+        {
+            WriteChunk chunk{data, size};
+            return write_file_gather(path, &chunk, 1, WriteOptions());
+        }
+
+        // Contents already in the store are not written again; only the manifest changes.
+        // The manifest itself is always replaced atomically.
+        Result write_file_gather(std::string_view path,
+            const WriteChunk* chunks,
+            size_t count,
+            const WriteOptions& options) override
+        {
+            if (path.empty() || path.find('\n') != std::string_view::npos)
+                return Result::invalid_path;
+
+            detail::Xxh64 hasher;
+            std::uint64_t size = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                hasher.update(chunks[i].data, chunks[i].size);
+                size += chunks[i].size;
+            }
+            const Entry entry{hasher.digest(), size};
+
+            std::string object = object_path(entry.hash);
+            if (!store_->exists_file(object))
+            {
+                WriteOptions object_options = options;
+                object_options.atomic = true;
+                object_options.create_parents = true;
+                Result result = store_->write_file_gather(object, chunks, count, object_options);
+                if (result != Result::ok)
+                    return result;
+            }
+
+            // The new manifest is published only once it is saved, so a failed save
+            // leaves the entries matching the store. Writers hold save_mutex_, so no
+            // other change lands between the copy and the swap.
+            std::lock_guard<std::mutex> save_lock(save_mutex_);
+            EntryMap next;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                next = entries_;
+            }
+            next.insert_or_assign(std::string(path), entry);
+            const std::string manifest = serialize(next);
+
+            WriteOptions manifest_options;
+            manifest_options.atomic = true;
+            manifest_options.create_parents = true;
+            WriteChunk chunk{manifest.data(), manifest.size()};
+            Result result = store_->write_file_gather(manifest_name, &chunk, 1, manifest_options);
+            if (result == Result::ok)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                entries_.swap(next);
+            }
+            return result;
+        }
+
+        Result list_files(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateRef& callback,
+            bool allow_duplicates) override
+        {
+            (void)allow_duplicates;
+            std::vector<std::string> names;
+            if (!collect(path, [&](std::string_view rest)
+                {
+                    if (rest.find('/') == std::string_view::npos &&
+                        detail::extension_matches(detail::extension_of(rest), extensions))
+                    {
+                        names.emplace_back(rest);
+                    }
+                }))
+            {
+                return Result::not_found;
+            }
+
+            for (const auto& name : names)
+                callback(name);
+            return Result::ok;
+        }
+
+        Result list_dirs(std::string_view path,
+            const EnumerateRef& callback,
+            bool allow_duplicates) override
+        {
+            (void)allow_duplicates;
+            std::vector<std::string> names;
+            if (!collect(path, [&](std::string_view rest)
+                {
+                    size_t split = rest.find('/');
+                    if (split == std::string_view::npos)
+                        return;
+                    // Entries are sorted, so a directory's files are contiguous.
+                    std::string_view dir = rest.substr(0, split);
+                    if (names.empty() || names.back() != dir)
+                        names.emplace_back(dir);
+                }))
+            {
+                return Result::not_found;
+            }
+
+            for (const auto& name : names)
+                callback(name);
+            return Result::ok;
+        }
+
+        Result walk(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateRef& callback,
+            size_t threads) override
+        {
+            (void)threads;
+            std::vector<std::string> names;
+            if (!collect(path, [&](std::string_view rest)
+                {
+                    std::string_view file = rest.substr(rest.rfind('/') + 1);
+                    if (detail::extension_matches(detail::extension_of(file), extensions))
+                        names.emplace_back(rest);
+                }))
+            {
+                return Result::not_found;
+            }
+
+            for (const auto& name : names)
+                callback(name);
+            return Result::ok;
+        }
+
+    private:
+        struct Entry
+        {
+            std::uint64_t hash = 0;
+            std::uint64_t size = 0;
+        };
+
+        using EntryMap = std::map<std::string, Entry, std::less<>>;
+
+        ContentStoreBackend(std::shared_ptr<Backend> store, bool verify)
+            : store_(std::move(store))
+            , verify_(verify)
+        {
+        }
+
+        static std::string hex(std::uint64_t value)
+        {
+            std::string text(16, '0');
+            for (int i = 0; i < 16; ++i)
+                text[i] = "0123456789abcdef"[(value >> (60 - 4 * i)) & 0xf];
+            return text;
+        }
+
+        static bool parse_hex(std::string_view text, std::uint64_t& value)
+        {
+            if (text.empty() || text.size() > 16)
+                return false;
+            value = 0;
+            for (char c : text)
+            {
+                int digit;
+                if (c >= '0' && c <= '9')
+                    digit = c - '0';
+                else if (c >= 'a' && c <= 'f')
+                    digit = c - 'a' + 10;
+                else
+                    return false;
+                value = (value << 4) | static_cast<std::uint64_t>(digit);
+            }
+            return true;
+        }
+
+        static std::string object_path(std::uint64_t hash)
+        {
+            return "objects/" + hex(hash);
+        }
+
+        static bool in_dir(std::string_view path, std::string_view dir)
+        {
+            return dir.empty() ||
+                (path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 && path[dir.size()] == '/');
+        }
+
+        EntryMap::const_iterator lower_bound_dir(std::string_view dir) const
+        {
+            if (dir.empty())
+                return entries_.begin();
+            std::string prefix(dir);
+            prefix.push_back('/');
+            return entries_.lower_bound(prefix);
+        }
+
+        bool find(std::string_view path, Entry& out) const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = entries_.find(path);
+            if (it == entries_.end())
+                return false;
+            out = it->second;
+            return true;
+        }
+
+        // Hands each entry below `dir` to `fn` as its path relative to `dir`. Returns
+        // false when `dir` names no directory.
+        template <typename Fn>
+        bool collect(std::string_view dir, Fn&& fn) const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = lower_bound_dir(dir);
+            if (!dir.empty() && (it == entries_.end() || !in_dir(it->first, dir)))
+                return false;
+
+            const size_t skip = dir.empty() ? 0 : dir.size() + 1;
+            for (; it != entries_.end() && in_dir(it->first, dir); ++it)
+                fn(std::string_view(it->first).substr(skip));
+            return true;
+        }
+
+        // One "<hash> <size> <path>" line per file after a version line.
+        static std::string serialize(const EntryMap& entries)
+        {
+            std::string text = "tvfs-manifest 1\n";
+            for (const auto& [path, entry] : entries)
+            {
+                text += hex(entry.hash);
+                text.push_back(' ');
+                text += std::to_string(entry.size);
+                text.push_back(' ');
+                text += path;
+                text.push_back('\n');
+            }
+            return text;
+        }
+
+        bool load_manifest(std::string_view text)
+        {
+            constexpr std::string_view header = "tvfs-manifest 1\n";
+            if (text.substr(0, header.size()) != header)
+                return false;
+            text.remove_prefix(header.size());
+
+            while (!text.empty())
+            {
+                size_t end = text.find('\n');
+                if (end == std::string_view::npos)
+                    return false;
+                std::string_view line = text.substr(0, end);
+                text.remove_prefix(end + 1);
+
+                size_t first = line.find(' ');
+                size_t second = first == std::string_view::npos ? first : line.find(' ', first + 1);
+                if (second == std::string_view::npos || second + 1 >= line.size())
+                    return false;
+
+                Entry entry;
+                std::string_view size_text = line.substr(first + 1, second - first - 1);
+                if (!parse_hex(line.substr(0, first), entry.hash) || size_text.empty())
+                    return false;
+                for (char c : size_text)
+                {
+                    if (c < '0' || c > '9')
+                        return false;
+                    entry.size = entry.size * 10 + static_cast<std::uint64_t>(c - '0');
+                }
+                entries_.insert_or_assign(std::string(line.substr(second + 1)), entry);
+            }
+            return true;
+        }
+
+        std::shared_ptr<Backend> store_;
+        bool verify_;
+        mutable std::mutex mutex_;
+        // Serializes manifest rewrites so an older snapshot never replaces a newer one.
+        std::mutex save_mutex_;
+        EntryMap entries_;
+    };
+
+    // Files held in memory under a directory tree, for generated content and tests.
+    // Contents live in arena blocks: small files are packed back to back, and a block is
+    // freed once every file in it has been replaced or removed and no Blob handed out
+    // still points into it. Reads and mappings alias the stored bytes without copying.
+    // Writes create missing parent directories. Safe to use from several threads.
+    class MemoryBackend final : public Backend
+    {
+    public:
+        explicit MemoryBackend(size_t block_size = 1u << 20)
+            : block_size_(std::max<size_t>(block_size, 4096))
+        {
+            nodes_.emplace_back();
+            nodes_[0].directory = true;
+        }
+
+        // Adopts `contents` without copying; the Blob's owner keeps the bytes alive.
+        Result write_blob(std::string_view path, Blob contents)
+        {
+            detail::PathBuffer buffer;
+            std::string_view normalized;
+            if (!normalize(path, buffer, normalized) || normalized.empty())
+                return Result::invalid_path;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            return store_locked(normalized, std::move(contents));
+        }
+
+        // Removes a file, or a directory with everything below it.
+        bool remove(std::string_view path)
+        {
+            detail::PathBuffer buffer;
+            std::string_view normalized;
+            if (!normalize(path, buffer, normalized) || normalized.empty())
+                return false;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            size_t slash = normalized.rfind('/');
+            size_t parent = slash == std::string_view::npos ? 0 : find_locked(normalized.substr(0, slash));
+            if (parent == no_node || !nodes_[parent].directory)
+                return false;
+
+            auto& siblings = nodes_[parent].children;
+            auto child = siblings.find(slash == std::string_view::npos ? normalized : normalized.substr(slash + 1));
+            if (child == siblings.end())
+                return false;
+            release_locked(child->second);
+            siblings.erase(child);
+            return true;
+        }
+
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            nodes_.assign(1, Node());
+            nodes_[0].directory = true;
+            free_.clear();
+            block_.reset();
+            block_used_ = 0;
+            file_count_ = 0;
+            stored_bytes_ = 0;
+        }
+
+        size_t file_count() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return file_count_;
+        }
+
+        // Bytes of file contents currently stored, excluding arena slack.
+        size_t stored_bytes() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return stored_bytes_;
+        }
+
+        bool exists_file(std::string_view path) override
+        {
+            return lookup(path, [](const Node& node) { return !node.directory; });
+        }
+
+        bool exists_dir(std::string_view path) override
+        {
+            return lookup(path, [](const Node& node) { return node.directory; });
+        }
+
+        std::optional<FileStat> stat(std::string_view path) override
+        {
+            std::optional<FileStat> result;
+            lookup(path, [&](const Node& node)
+            {
+                FileStat info;
+                info.type = node.directory ? FileType::directory : FileType::file;
+                info.size = node.contents.size();
+                info.mtime_ns = node.mtime_ns;
+                result = info;
+                return true;
+            });
+            return result;
+        }
+
+        std::optional<Blob> read_file(std::string_view path) override
+        {
+            std::optional<Blob> result;
+            lookup(path, [&](const Node& node)
+            {
+                if (!node.directory)
+                    result = node.contents;
+                return !node.directory;
+            });
+            return result;
+        }
+
+        std::optional<FileView> map_file(std::string_view path) override
+        {
+            auto blob = read_file(path);
+            if (!blob)
+                return std::nullopt;
+            return FileView(blob->data(), blob->size(), blob->owner());
+        }
+
+        Result write_file(std::string_view path, const void* data, size_t size) override
+        {
+            WriteChunk chunk{data, size};
+            return write_file_gather(path, &chunk, 1, WriteOptions());
+        }
+
+        // Every write replaces the file in one step, so `atomic` holds without extra work.
+        Result write_file_gather(std::string_view path,
+            const WriteChunk* chunks,
+            size_t count,
+            const WriteOptions& options) override
+        {
+            (void)options;
+            detail::PathBuffer buffer;
+            std::string_view normalized;
+            if (!normalize(path, buffer, normalized) || normalized.empty())
+                return Result::invalid_path;
+
+            size_t total = 0;
+            for (size_t i = 0; i < count; ++i)
+                total += chunks[i].size;
+
+            Blob contents;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                contents = allocate_locked(total);
+            }
+
+            // The new space is not reachable by readers yet, so it is filled unlocked.
+            size_t offset = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (chunks[i].size > 0)
+                    std::memcpy(contents.mutable_data() + offset, chunks[i].data, chunks[i].size);
+                offset += chunks[i].size;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            return store_locked(normalized, std::move(contents));
+        }
+
+        // Names are collected under the lock and handed out after it, so callbacks may
+        // call back into the backend.
+        Result list_files(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateRef& callback,
+            bool allow_duplicates) override
+        {
+            (void)allow_duplicates;
+            std::vector<std::string> names;
+            bool found = lookup(path, [&](const Node& node)
+            {
+                if (!node.directory)
+                    return false;
+                for (const auto& [name, child] : node.children)
+                {
+                    if (!nodes_[child].directory && detail::extension_matches(detail::extension_of(name), extensions))
+                        names.push_back(name);
+                }
+                return true;
+            });
+            if (!found)
+                return Result::not_found;
+
+            for (const auto& name : names)
+                callback(name);
+            return Result::ok;
+        }
+
+        Result list_dirs(std::string_view path,
+            const EnumerateRef& callback,
+            bool allow_duplicates) override
+        {
+            (void)allow_duplicates;
+            std::vector<std::string> names;
+            bool found = lookup(path, [&](const Node& node)
+            {
+                if (!node.directory)
+                    return false;
+                for (const auto& [name, child] : node.children)
+                {
+                    if (nodes_[child].directory)
+                        names.push_back(name);
+                }
+                return true;
+            });
+            if (!found)
+                return Result::not_found;
+
+            for (const auto& name : names)
+                callback(name);
+            return Result::ok;
+        }
+
+        Result walk(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateRef& callback,
+            size_t threads) override
+        {
+            (void)threads;
+            std::vector<std::string> names;
+            bool found = lookup(path, [&](const Node& root)
+            {
+                if (!root.directory)
+                    return false;
+
+                std::vector<std::pair<const Node*, std::string>> pending{{&root, std::string()}};
+                while (!pending.empty())
+                {
+                    auto [node, prefix] = std::move(pending.back());
+                    pending.pop_back();
+                    for (const auto& [name, index] : node->children)
+                    {
+                        std::string child = prefix.empty() ? name : prefix + '/' + name;
+                        if (nodes_[index].directory)
+                            pending.emplace_back(&nodes_[index], std::move(child));
+                        else if (detail::extension_matches(detail::extension_of(name), extensions))
+                            names.push_back(std::move(child));
+                    }
+                }
+                return true;
+            });
+            if (!found)
+                return Result::not_found;
+
+            for (const auto& name : names)
+                callback(name);
+            return Result::ok;
+        }
+
+    private:
+        static constexpr size_t no_node = static_cast<size_t>(-1);
+        static constexpr size_t alignment = alignof(std::max_align_t);
+
+        // Nodes live in one vector and name their children by index; removed nodes are
+        // recycled through free_. Child maps are ordered, so listings come out sorted.
+        struct Node
+        {
+            std::map<std::string, size_t, std::less<>> children;
+            Blob contents;
+            std::int64_t mtime_ns = 0;
+            bool directory = false;
+        };
+
+        struct Block
+        {
+            std::unique_ptr<std::byte[]> data;
+        };
+
+        static bool normalize(std::string_view path, detail::PathBuffer& buffer, std::string_view& out)
+        {
+            if (detail::is_canonical_virtual_path(path))
+            {
+                out = path;
+                return true;
+            }
+            if (!detail::normalize_virtual_path(path, buffer))
+                return false;
+            out = buffer.view();
+            return true;
+        }
+
+        template <typename Fn>
+        bool lookup(std::string_view path, Fn&& fn) const
+        {
+            detail::PathBuffer buffer;
+            std::string_view normalized;
+            if (!normalize(path, buffer, normalized))
+                return false;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            size_t node = find_locked(normalized);
+            return node != no_node && fn(nodes_[node]);
+        }
+
+        size_t find_locked(std::string_view path) const
+        {
+            size_t node = 0;
+            while (!path.empty())
+            {
+                if (!nodes_[node].directory)
+                    return no_node;
+                size_t split = path.find('/');
+                const auto& children = nodes_[node].children;
+                auto found = children.find(path.substr(0, split));
+                if (found == children.end())
+                    return no_node;
+                node = found->second;
+                path = split == std::string_view::npos ? std::string_view() : path.substr(split + 1);
+            }
+            return node;
+        }
+
+        size_t new_node_locked(bool directory)
+        {
+            size_t index;
+            if (!free_.empty())
+            {
+                index = free_.back();
+                free_.pop_back();
+                nodes_[index] = Node();
+            }
+            else
+            {
+                index = nodes_.size();
+                nodes_.emplace_back();
+            }
+            nodes_[index].directory = directory;
+            return index;
+        }
+
+        void release_locked(size_t index)
+        {
+            std::vector<size_t> pending{index};
+            while (!pending.empty())
+            {
+                Node& node = nodes_[pending.back()];
+                free_.push_back(pending.back());
+                pending.pop_back();
+                for (const auto& child : node.children)
+                    pending.push_back(child.second);
+                if (!node.directory)
+                {
+                    --file_count_;
+                    stored_bytes_ -= node.contents.size();
+                }
+                node = Node();
+            }
+        }
+
+        Result store_locked(std::string_view path, Blob contents)
+        {
+            size_t node = 0;
+            for (;;)
+            {
+                size_t split = path.find('/');
+                std::string_view name = path.substr(0, split);
+                auto& children = nodes_[node].children;
+                auto found = children.find(name);
+
+                if (split == std::string_view::npos)
+                {
+                    size_t file;
+                    if (found == children.end())
+                    {
+                        file = new_node_locked(false);
+                        // new_node_locked may grow nodes_, so look the parent up again.
+                        nodes_[node].children.emplace(std::string(name), file);
+                        ++file_count_;
+                    }
+                    else
+                    {
+                        file = found->second;
+                        if (nodes_[file].directory)
+                            return Result::io_error;
+                        stored_bytes_ -= nodes_[file].contents.size();
+                    }
+
+                    stored_bytes_ += contents.size();
+                    nodes_[file].contents = std::move(contents);
+                    nodes_[file].mtime_ns = static_cast<std::int64_t>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::system_clock::now().time_since_epoch()).count());
+                    return Result::ok;
+                }
+
+                if (found == children.end())
+                {
+                    size_t dir = new_node_locked(true);
+                    nodes_[node].children.emplace(std::string(name), dir);
+                    node = dir;
+                }
+                else if (!nodes_[found->second].directory)
+                {
+                    return Result::io_error;
+                }
+                else
+                {
+                    node = found->second;
+                }
+                path.remove_prefix(split + 1);
+            }
+        }
+
+        // Small files are carved from the shared block; files over a quarter of a block
+        // get a block of their own so they do not strand the rest of one.
+        Blob allocate_locked(size_t size)
+        {
+            if (size == 0)
+                return Blob();
+
+            const size_t padded = (size + alignment - 1) & ~(alignment - 1);
+            if (padded > block_size_ / 4)
+            {
+                auto block = std::make_shared<Block>();
+                block->data.reset(new std::byte[size]);
+                std::byte* data = block->data.get();
+                return Blob(data, size, std::shared_ptr<const void>(std::move(block)));
+            }
+
+            if (!block_ || block_size_ - block_used_ < padded)
+            {
+                block_ = std::make_shared<Block>();
+                block_->data.reset(new std::byte[block_size_]);
+                block_used_ = 0;
+            }
+
+            std::byte* data = block_->data.get() + block_used_;
+            block_used_ += padded;
+            return Blob(data, size, block_);
+        }
+
+        const size_t block_size_;
+        mutable std::mutex mutex_;
+        std::vector<Node> nodes_;
+        std::vector<size_t> free_;
+        std::shared_ptr<Block> block_;
+        size_t block_used_ = 0;
+        size_t file_count_ = 0;
+        size_t stored_bytes_ = 0;
+    };
+
+    // Pack file layout (little-endian):
+    //   header: "TVFSPAK1", u32 version, u32 entry count, u64 toc offset, u64 names size
+    //   data:   file contents, in the order they were added
+    //   toc:    per entry u64 path hash, u64 offset, u64 size, u32 name offset, u32 name length,
+    //           sorted by hash, followed by the concatenated entry paths
+    namespace pack
+    {
+        constexpr char magic[8] = {'T', 'V', 'F', 'S', 'P', 'A', 'K', '1'};
+        constexpr std::uint32_t version = 1;
+        constexpr size_t header_size = 32;
+        constexpr size_t entry_size = 32;
+    }
+
+    // Layout of Vfs::save_index snapshots, little-endian like packs: header, mount roots,
+    // file records sorted by (hash, path), scanned directories, then the strings.
+    namespace index_snapshot
+    {
+        constexpr char magic[8] = {'T', 'V', 'F', 'S', 'I', 'D', 'X', '1'};
+        constexpr std::uint32_t version = 1;
+        constexpr size_t header_size = 48;
+        constexpr size_t mount_size = 8;
+        constexpr size_t entry_size = 40;
+        constexpr size_t dir_size = 24;
+    }
+
+    // How much Vfs::load_index checks before trusting a snapshot.
+    enum class IndexCheck
+    {
+        // The stamp alone, e.g. a build id for a read-only install.
+        none,
+        // Every directory scanned by build_index must keep its mtime; adding, removing
+        // or renaming a file changes its directory's.
+        directories,
+        // Also every file's size and mtime, catching edits in place.
+        files
+    };
+
+    // Read-only backend over a single pack file. The pack is mapped once and its table
+    // of contents is kept as flat arrays, so lookups are a binary search over hashes and
+    // reads are served straight from the mapping.
+    class PackBackend final : public Backend
+    {
+    public:
+        static std::shared_ptr<PackBackend> open(const fs::path& pack_path)
+        {
+            auto view = detail::map_os_file(pack_path);
+            if (!view)
+                return nullptr;
+
+            auto backend = std::shared_ptr<PackBackend>(new PackBackend(std::move(*view)));
+            if (!backend->load_toc())
+                return nullptr;
+            return backend;
+        }
+
+        size_t entry_count() const noexcept { return hashes_.size(); }
+
+        bool exists_file(std::string_view path) override
+        {
+            return find(path) != npos;
+        }
+
+        bool exists_dir(std::string_view path) override
+        {
+            if (path.empty())
+                return true;
+            auto [first, last] = dir_range(path);
+            return first != last;
+        }
+
+        // Entries carry no timestamps, so mtime_ns is always 0.
+        std::optional<FileStat> stat(std::string_view path) override
+        {
+            FileStat result;
+            size_t index = find(path);
+            if (index != npos)
+            {
+                result.size = sizes_[index];
+                return result;
+            }
+
+            if (!exists_dir(path))
+                return std::nullopt;
+            result.type = FileType::directory;
+            return result;
+        }
+
+        bool prefetch(std::string_view path) override
+        {
+            size_t index = find(path);
+            if (index == npos)
+                return false;
+            detail::advise_will_need(view_.data() + offsets_[index], static_cast<size_t>(sizes_[index]));
+            return true;
+        }
+
+        std::optional<Blob> read_file(std::string_view path) override
+        {
+            size_t index = find(path);
+            if (index == npos)
+                return std::nullopt;
+
+            return Blob(view_.data() + offsets_[index], static_cast<size_t>(sizes_[index]), view_.owner());
+        }
+
+        std::optional<FileView> map_file(std::string_view path) override
+        {
+            size_t index = find(path);
+            if (index == npos)
+                return std::nullopt;
+            return FileView(view_.data() + offsets_[index], static_cast<size_t>(sizes_[index]), view_.owner());
+        }
+
+        std::unique_ptr<FileHandle> open_file(std::string_view path) override
+        {
+            auto view = map_file(path);
+            if (!view)
+                return nullptr;
+            return std::make_unique<ViewFileHandle>(std::move(*view));
+        }
+
+        // Serves the batch in pack order so the mapping is touched front to back.
+        void read_files(const std::vector<std::string_view>& paths, const BatchReadFn& callback) override
+        {
+            std::vector<std::pair<size_t, size_t>> order;
+            order.reserve(paths.size());
+            for (size_t i = 0; i < paths.size(); ++i)
+            {
+                size_t index = find(paths[i]);
+                if (index == npos)
+                    callback(i, std::nullopt);
+                else
+                    order.emplace_back(index, i);
+            }
+
+            std::sort(order.begin(), order.end(), [this](const auto& a, const auto& b)
+            {
+                return offsets_[a.first] < offsets_[b.first];
+            });
+
+            for (const auto& [index, request] : order)
+            {
+                callback(request, Blob(view_.data() + offsets_[index], static_cast<size_t>(sizes_[index]), view_.owner()));
+            }
+        }
+
+        Result write_file(std::string_view, const void*, size_t) override
+        {
+            return Result::not_supported;
+        }
+
+        Result write_file_gather(std::string_view, const WriteChunk*, size_t, const WriteOptions&) override
+        {
+            return Result::not_supported;
+        }
+
+        // Subdirectories are stepped over with one binary search each, so a listing
+        // costs its children rather than the whole subtree.
+        Result list_files(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateRef& callback,
+            bool) override
+        {
+            auto [first, last] = dir_range(path);
+            if (first == last && !path.empty())
+                return Result::not_found;
+
+            const size_t skip = path.empty() ? 0 : path.size() + 1;
+            for (size_t i = first; i < last;)
+            {
+                std::string_view entry = name(by_name_[i]);
+                std::string_view child = entry.substr(skip);
+                size_t split = child.find('/');
+                if (split != std::string_view::npos)
+                {
+                    i = skip_dir(entry.substr(0, skip + split + 1), i, last);
+                    continue;
+                }
+                if (detail::extension_matches(detail::extension_of(child), extensions))
+                    callback(child);
+                ++i;
+            }
+
+            return Result::ok;
+        }
+
+        Result list_dirs(std::string_view path,
+            const EnumerateRef& callback,
+            bool) override
+        {
+            auto [first, last] = dir_range(path);
+            if (first == last && !path.empty())
+                return Result::not_found;
+
+            const size_t skip = path.empty() ? 0 : path.size() + 1;
+            for (size_t i = first; i < last;)
+            {
+                std::string_view entry = name(by_name_[i]);
+                std::string_view child = entry.substr(skip);
+                size_t split = child.find('/');
+                if (split == std::string_view::npos)
+                {
+                    ++i;
+                    continue;
+                }
+                callback(child.substr(0, split));
+                i = skip_dir(entry.substr(0, skip + split + 1), i, last);
+            }
+
+            return Result::ok;
+        }
+
+        // The subtree is one contiguous run of the path-ordered table of contents.
+        Result walk(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateRef& callback,
+            size_t) override
+        {
+            auto [first, last] = dir_range(path);
+            if (first == last && !path.empty())
+                return Result::not_found;
+
+            const size_t skip = path.empty() ? 0 : path.size() + 1;
+            for (size_t i = first; i < last; ++i)
+            {
+                std::string_view child = name(by_name_[i]).substr(skip);
+                size_t slash = child.rfind('/');
+                std::string_view file = slash == std::string_view::npos ? child : child.substr(slash + 1);
+                if (detail::extension_matches(detail::extension_of(file), extensions))
+                    callback(child);
+            }
+
+            return Result::ok;
+        }
+
+    private:
+        static constexpr size_t npos = static_cast<size_t>(-1);
+
+        FileView view_;
+        std::string_view names_;
+        std::vector<std::uint64_t> hashes_;
+        std::vector<std::uint64_t> offsets_;
+        std::vector<std::uint64_t> sizes_;
+        std::vector<std::uint32_t> name_offsets_;
+        std::vector<std::uint32_t> name_lengths_;
+        // Entry indices in path order, so every directory's entries form one run.
+        std::vector<std::uint32_t> by_name_;
+
+        explicit PackBackend(FileView view)
+            : view_(std::move(view))
+        {
+        }
+
+        std::string_view name(size_t index) const
+        {
+            return names_.substr(name_offsets_[index], name_lengths_[index]);
+        }
+
+        size_t find(std::string_view path) const
+        {
+            std::uint64_t hash = detail::hash_path(path);
+            auto it = std::lower_bound(hashes_.begin(), hashes_.end(), hash);
+            for (; it != hashes_.end() && *it == hash; ++it)
+            {
+                size_t index = static_cast<size_t>(it - hashes_.begin());
+                if (name(index) == path)
+                    return index;
+            }
+            return npos;
+        }
+
+        // Positions in by_name_ of the entries below `dir`; everything for the root.
+        std::pair<size_t, size_t> dir_range(std::string_view dir) const
+        {
+            if (dir.empty())
+                return {0, by_name_.size()};
+
+            auto first = std::lower_bound(by_name_.begin(), by_name_.end(), dir, [&](std::uint32_t index, std::string_view key)
+            {
+                return before_dir(name(index), key);
+            });
+            auto last = std::partition_point(first, by_name_.end(), [&](std::uint32_t index)
+            {
+                return in_dir(name(index), dir);
+            });
+            return {static_cast<size_t>(first - by_name_.begin()), static_cast<size_t>(last - by_name_.begin())};
+        }
+
+        // Past the run of entries starting with `prefix`, which begins at `first`.
+        size_t skip_dir(std::string_view prefix, size_t first, size_t last) const
+        {
+            auto end = std::partition_point(by_name_.begin() + static_cast<std::ptrdiff_t>(first),
+                by_name_.begin() + static_cast<std::ptrdiff_t>(last),
+                [&](std::uint32_t index) { return name(index).substr(0, prefix.size()) == prefix; });
+            return static_cast<size_t>(end - by_name_.begin());
+        }
+
+        static bool in_dir(std::string_view entry, std::string_view dir) noexcept
+        {
+            return entry.size() > dir.size() && entry[dir.size()] == '/' && entry.compare(0, dir.size(), dir) == 0;
+        }
+
+        // Whether `entry` sorts before every path below `dir`, i.e. before "dir/".
+        static bool before_dir(std::string_view entry, std::string_view dir) noexcept
+        {
+            int order = entry.substr(0, dir.size()).compare(dir);
+            if (order != 0)
+                return order < 0;
+            return entry.size() == dir.size() || entry[dir.size()] < '/';
+        }
+
+        bool load_toc()
+        {
+            const std::byte* base = view_.data();
+            const std::uint64_t file_size = view_.size();
+            if (file_size < pack::header_size || std::memcmp(base, pack::magic, sizeof(pack::magic)) != 0)
+                return false;
+            if (detail::load_le32(base + 8) != pack::version)
+                return false;
+
+            const size_t count = detail::load_le32(base + 12);
+            const std::uint64_t toc_offset = detail::load_le64(base + 16);
+            const std::uint64_t names_size = detail::load_le64(base + 24);
+            const std::uint64_t toc_size = static_cast<std::uint64_t>(count) * pack::entry_size;
+            if (toc_offset > file_size || toc_size > file_size - toc_offset ||
+                names_size > file_size - toc_offset - toc_size)
+            {
+                return false;
+            }
+
+            names_ = std::string_view(reinterpret_cast<const char*>(base + toc_offset + toc_size),
+                static_cast<size_t>(names_size));
+
+            hashes_.resize(count);
+            offsets_.resize(count);
+            sizes_.resize(count);
+            name_offsets_.resize(count);
+            name_lengths_.resize(count);
+
+            const std::byte* entry = base + toc_offset;
+            for (size_t i = 0; i < count; ++i, entry += pack::entry_size)
+            {
+                hashes_[i] = detail::load_le64(entry);
+                offsets_[i] = detail::load_le64(entry + 8);
+                sizes_[i] = detail::load_le64(entry + 16);
+                name_offsets_[i] = detail::load_le32(entry + 24);
+                name_lengths_[i] = detail::load_le32(entry + 28);
+
+                if (offsets_[i] > file_size || sizes_[i] > file_size - offsets_[i] ||
+                    name_offsets_[i] > names_size || name_lengths_[i] > names_size - name_offsets_[i])
+                {
+                    return false;
+                }
+                if (i > 0 && hashes_[i] < hashes_[i - 1])
+                    return false;
+            }
+
+            by_name_.resize(count);
+            for (size_t i = 0; i < count; ++i)
+                by_name_[i] = static_cast<std::uint32_t>(i);
+            std::sort(by_name_.begin(), by_name_.end(), [this](std::uint32_t a, std::uint32_t b)
+            {
+                return name(a) < name(b);
+            });
+            return true;
+        }
+    };
+
+    // Builds pack files for PackBackend. Contents are written in the order they are
+    // added; files added by source path are streamed from disk when the pack is written.
+    class PackWriter
+    {
+    public:
+        bool add(std::string_view path, const void* data, size_t size)
+        {
+            Entry entry;
+            if (!prepare(path, entry))
+                return false;
+
+            const std::byte* bytes = static_cast<const std::byte*>(data);
+            entry.data.assign(bytes, bytes + size);
+            entries_.push_back(std::move(entry));
+            return true;
+        }
+
+        bool add_file(std::string_view path, const fs::path& source)
+        {
+            Entry entry;
+            if (!prepare(path, entry))
+                return false;
+
+            entry.source = source;
+            entries_.push_back(std::move(entry));
+            return true;
+        }
+
+        size_t size() const noexcept { return entries_.size(); }
+
+        // Starts every file on a multiple of `alignment`, a power of two, padding with
+        // zeros. 4096 suits unbuffered reads and whole-sector fetches; 1 packs tightly.
+        bool set_alignment(size_t alignment)
+        {
+            if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+                return false;
+            alignment_ = alignment;
+            return true;
+        }
+
+        size_t alignment() const noexcept { return alignment_; }
+
+        Result write(const fs::path& pack_path) const
+        {
+            std::ofstream out(pack_path, std::ios::binary | std::ios::trunc);
+            if (!out)
+                return Result::io_error;
+
+            std::byte header[pack::header_size] = {};
+            out.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+            struct Record
+            {
+                std::uint64_t hash;
+                std::uint64_t offset;
+                std::uint64_t size;
+                std::uint32_t name_offset;
+                std::uint32_t name_length;
+            };
+
+            std::vector<Record> records;
+            records.reserve(entries_.size());
+            std::string names;
+            std::uint64_t offset = pack::header_size;
+
+            const char zeros[256] = {};
+            for (const Entry& entry : entries_)
+            {
+                for (std::uint64_t padding = (alignment_ - offset % alignment_) % alignment_; padding > 0;)
+                {
+                    std::uint64_t chunk = std::min<std::uint64_t>(padding, sizeof(zeros));
+                    out.write(zeros, static_cast<std::streamsize>(chunk));
+                    offset += chunk;
+                    padding -= chunk;
+                }
+
+                std::uint64_t size = 0;
+                if (entry.source.empty())
+                {
+                    if (!entry.data.empty())
+                        out.write(reinterpret_cast<const char*>(entry.data.data()), static_cast<std::streamsize>(entry.data.size()));
+                    size = entry.data.size();
+                }
+                else
+                {
+                    std::ifstream in(entry.source, std::ios::binary);
+                    if (!in)
+                        return Result::not_found;
+
+                    char buffer[64 * 1024];
+                    while (in)
+                    {
+                        in.read(buffer, sizeof(buffer));
+                        std::streamsize got = in.gcount();
+                        if (got <= 0)
+                            break;
+                        out.write(buffer, got);
+                        size += static_cast<std::uint64_t>(got);
+                    }
+                    if (in.bad())
+                        return Result::io_error;
+                }
+
+                if (names.size() + entry.path.size() > UINT32_MAX)
+                    return Result::io_error;
+
+                records.push_back(Record{detail::hash_path(entry.path), offset, size,
+                    static_cast<std::uint32_t>(names.size()), static_cast<std::uint32_t>(entry.path.size())});
+                names += entry.path;
+                offset += size;
+            }
+
+            std::sort(records.begin(), records.end(), [&](const Record& a, const Record& b)
+            {
+                if (a.hash != b.hash)
+                    return a.hash < b.hash;
+                return names.compare(a.name_offset, a.name_length, names, b.name_offset, b.name_length) < 0;
+            });
+
+            const std::uint64_t toc_offset = offset;
+            for (const Record& record : records)
+            {
+                std::byte bytes[pack::entry_size];
+                detail::store_le64(bytes, record.hash);
+                detail::store_le64(bytes + 8, record.offset);
+                detail::store_le64(bytes + 16, record.size);
+                detail::store_le32(bytes + 24, record.name_offset);
+                detail::store_le32(bytes + 28, record.name_length);
+                out.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+            }
+            out.write(names.data(), static_cast<std::streamsize>(names.size()));
+
+            std::memcpy(header, pack::magic, sizeof(pack::magic));
+            detail::store_le32(header + 8, pack::version);
+            detail::store_le32(header + 12, static_cast<std::uint32_t>(records.size()));
+            detail::store_le64(header + 16, toc_offset);
+            detail::store_le64(header + 24, names.size());
+            out.seekp(0);
+            out.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+            return out.good() ? Result::ok : Result::io_error;
+        }
+
+    private:
+        struct Entry
+        {
+            std::string path;
+            std::vector<std::byte> data;
+            fs::path source;
+        };
+
+        std::vector<Entry> entries_;
+        std::unordered_set<std::string> paths_;
+        size_t alignment_ = 1;
+
+        bool prepare(std::string_view path, Entry& entry)
+        {
+            if (!detail::normalize_virtual_path(path, entry.path) || entry.path.empty())
+                return false;
+            if (entries_.size() >= UINT32_MAX || !paths_.insert(entry.path).second)
+                return false;
+            return true;
+        }
+    };
+
+    // Priority classes for IoScheduler, most urgent first.
+    enum class IoPriority
+    {
+        critical,
+        high,
+        normal,
+        background,
+        count
+    };
+
+    struct IoRequest
+    {
+        IoPriority priority = IoPriority::normal;
+        // Earlier deadlines run first within a class. A request still queued when its
+        // deadline passes is dropped and reported as Result::cancelled.
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+        // Requests naming the same device share its queue-depth limit.
+        std::uint32_t device = 0;
+    };
+
+    using IoTicket = std::uint64_t;
+
+    // Worker threads fed from per-class queues instead of one FIFO. A critical request
+    // jumps every queued background one; within a class requests run by deadline, then
+    // in submission order. Background work may hold at most half the workers, and each
+    // device at most its queue-depth limit, so a bulk stream cannot occupy every thread
+    // while latency-sensitive loads wait.
+    class IoScheduler
+    {
+    public:
+        // Called with Result::ok when the request starts, or Result::cancelled when it
+        // is cancelled, expires or is still queued when the scheduler is destroyed.
+        using Task = std::function<void(Result result)>;
+
+        explicit IoScheduler(size_t workers = 4)
+        {
+            workers = std::max<size_t>(workers, 1);
+            class_limits_[static_cast<size_t>(IoPriority::background)] = std::max<size_t>(workers / 2, 1);
+            threads_.reserve(workers);
+            for (size_t i = 0; i < workers; ++i)
+                threads_.emplace_back([this] { run(); });
+        }
+
+        IoScheduler(const IoScheduler&) = delete;
+        IoScheduler& operator=(const IoScheduler&) = delete;
+
+        // Running requests finish; queued ones are reported cancelled.
+        ~IoScheduler()
+        {
+            std::vector<Task> queued;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+                take_all(queued);
+            }
+            changed_.notify_all();
+            for (auto& thread : threads_)
+                thread.join();
+            for (auto& task : queued)
+                task(Result::cancelled);
+        }
+
+        // Reports every queued request cancelled, on this thread; running ones continue.
+        void cancel_all()
+        {
+            std::vector<Task> queued;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                take_all(queued);
+            }
+            idle_.notify_all();
+            for (auto& task : queued)
+                task(Result::cancelled);
+        }
+
+        // Never blocks. Returns a ticket for cancel(); 0 when the scheduler is shutting
+        // down, in which case the task has already been called with Result::cancelled.
+        IoTicket submit(const IoRequest& request, Task task)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (stopping_)
+            {
+                lock.unlock();
+                task(Result::cancelled);
+                return 0;
+            }
+
+            Slot slot{static_cast<size_t>(request.priority), request.device, Key{request.deadline, next_ticket()}};
+            lanes_[slot.priority][slot.device].emplace(slot.key, std::move(task));
+            if (slot.key.deadline != Clock::time_point::max())
+                deadlines_.insert(slot.key);
+            tickets_.emplace(slot.key.ticket, slot);
+            ++queued_;
+            lock.unlock();
+            changed_.notify_one();
+            return slot.key.ticket;
+        }
+
+        // True when the request was still queued; its task is then called with
+        // Result::cancelled on this thread. A running request cannot be stopped.
+        bool cancel(IoTicket ticket)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (tickets_.count(ticket) == 0)
+                return false;
+
+            Task task = take(ticket);
+            lock.unlock();
+            idle_.notify_all();
+            task(Result::cancelled);
+            return true;
+        }
+
+        // Caps how many requests for `device` run at once; 0 removes the cap.
+        void set_device_limit(std::uint32_t device, size_t depth)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (depth == 0)
+                    device_limits_.erase(device);
+                else
+                    device_limits_[device] = depth;
+            }
+            changed_.notify_all();
+        }
+
+        // Caps how many requests of one class run at once; 0 removes the cap.
+        void set_priority_limit(IoPriority priority, size_t max_running)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                class_limits_[static_cast<size_t>(priority)] = max_running;
+            }
+            changed_.notify_all();
+        }
+
+        void wait_idle()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            idle_.wait(lock, [this] { return queued_ == 0 && running_ == 0; });
+        }
+
+        bool idle() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return queued_ == 0 && running_ == 0;
+        }
+
+        size_t queued() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return queued_;
+        }
+
+        size_t worker_count() const noexcept { return threads_.size(); }
+
+        // The scheduler cannot be destroyed from here: its destructor joins every worker.
+        bool on_worker() const noexcept
+        {
+            const std::thread::id self = std::this_thread::get_id();
+            for (const auto& thread : threads_)
+            {
+                if (thread.get_id() == self)
+                    return true;
+            }
+            return false;
+        }
+
+    private:
+        using Clock = std::chrono::steady_clock;
+        static constexpr size_t class_count = static_cast<size_t>(IoPriority::count);
+
+        // Earlier deadlines first, then submission order.
+        struct Key
+        {
+            Clock::time_point deadline;
+            IoTicket ticket;
+
+            bool operator<(const Key& other) const noexcept
+            {
+                if (deadline != other.deadline)
+                    return deadline < other.deadline;
+                return ticket < other.ticket;
+            }
+        };
+
+        // Queued requests of one class for one device, most urgent first.
+        using Lane = std::map<Key, Task>;
+
+        struct Slot
+        {
+            size_t priority;
+            std::uint32_t device;
+            Key key;
+        };
+
+        mutable std::mutex mutex_;
+        std::condition_variable changed_;
+        std::condition_variable idle_;
+        // One lane per class and device with queued work. Empty lanes are dropped, so
+        // a pick compares the head of each busy lane rather than every queued request.
+        std::array<std::unordered_map<std::uint32_t, Lane>, class_count> lanes_;
+        // Queued requests with a deadline, soonest first.
+        std::set<Key> deadlines_;
+        std::unordered_map<IoTicket, Slot> tickets_;
+        std::unordered_map<std::uint32_t, size_t> device_limits_;
+        std::unordered_map<std::uint32_t, size_t> device_running_;
+        std::array<size_t, class_count> class_limits_{};
+        std::array<size_t, class_count> class_running_{};
+        std::vector<std::thread> threads_;
+        size_t queued_ = 0;
+        size_t running_ = 0;
+        bool stopping_ = false;
+
+        // Unique across schedulers, so a stale ticket never cancels another request.
+        static IoTicket next_ticket()
+        {
+            static std::atomic<IoTicket> counter{0};
+            return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+
+        bool device_free(std::uint32_t device) const
+        {
+            auto limit = device_limits_.find(device);
+            if (limit == device_limits_.end())
+                return true;
+            auto running = device_running_.find(device);
+            return running == device_running_.end() || running->second < limit->second;
+        }
+
+        void take_all(std::vector<Task>& out)
+        {
+            for (auto& lanes : lanes_)
+            {
+                for (auto& lane : lanes)
+                {
+                    for (auto& item : lane.second)
+                        out.push_back(std::move(item.second));
+                }
+                lanes.clear();
+            }
+            deadlines_.clear();
+            tickets_.clear();
+            queued_ = 0;
+        }
+
+        // Removes a queued request and returns its task.
+        Task take(IoTicket ticket)
+        {
+            auto found = tickets_.find(ticket);
+            const Slot slot = found->second;
+            tickets_.erase(found);
+            auto lane = lanes_[slot.priority].find(slot.device);
+            auto it = lane->second.find(slot.key);
+            Task task = std::move(it->second);
+            lane->second.erase(it);
+            if (lane->second.empty())
+                lanes_[slot.priority].erase(lane);
+            if (slot.key.deadline != Clock::time_point::max())
+                deadlines_.erase(slot.key);
+            --queued_;
+            return task;
+        }
+
+        // The ticket of the most urgent request that may start now, or 0. Requests at
+        // or past their deadline are moved to `expired` first, and `wake` gets the
+        // soonest remaining deadline, by which a waiting worker must look again.
+        IoTicket next(std::vector<Task>& expired, Clock::time_point& wake)
+        {
+            const Clock::time_point now = Clock::now();
+            while (!deadlines_.empty() && deadlines_.begin()->deadline <= now)
+                expired.push_back(take(deadlines_.begin()->ticket));
+            wake = deadlines_.empty() ? Clock::time_point::max() : deadlines_.begin()->deadline;
+
+            for (size_t priority = 0; priority < class_count; ++priority)
+            {
+                const size_t class_limit = class_limits_[priority];
+                if (class_limit != 0 && class_running_[priority] >= class_limit)
+                    continue;
+                const Key* best = nullptr;
+                for (const auto& lane : lanes_[priority])
+                {
+                    const Key& head = lane.second.begin()->first;
+                    if ((!best || head < *best) && device_free(lane.first))
+                        best = &head;
+                }
+                if (best)
+                    return best->ticket;
+            }
+            return 0;
+        }
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            std::vector<Task> expired;
+            for (;;)
+            {
+                if (stopping_)
+                    return;
+
+                Clock::time_point wake;
+                const IoTicket ticket = next(expired, wake);
+                if (!expired.empty())
+                {
+                    // Counted as running so wait_idle() also waits for these callbacks.
+                    const size_t count = expired.size();
+                    running_ += count;
+                    lock.unlock();
+                    for (auto& task : expired)
+                        task(Result::cancelled);
+                    expired.clear();
+                    lock.lock();
+                    running_ -= count;
+                    if (queued_ == 0 && running_ == 0)
+                        idle_.notify_all();
+                    continue;
+                }
+                if (ticket == 0)
+                {
+                    // Blocked requests still expire on time without other activity.
+                    if (wake == Clock::time_point::max())
+                        changed_.wait(lock);
+                    else
+                        changed_.wait_until(lock, wake);
+                    continue;
+                }
+
+                const Slot slot = tickets_.find(ticket)->second;
+                Task task = take(ticket);
+                ++running_;
+                ++class_running_[slot.priority];
+                ++device_running_[slot.device];
+                lock.unlock();
+
+                task(Result::ok);
+
+                lock.lock();
+                --running_;
+                --class_running_[slot.priority];
+                if (--device_running_[slot.device] == 0)
+                    device_running_.erase(slot.device);
+                changed_.notify_all();
+                if (queued_ == 0 && running_ == 0)
+                    idle_.notify_all();
+            }
+        }
+    };
+
+    // Vfs operations named by statistics and trace hooks.
+    enum class TraceOp
+    {
+        exists_file,
+        read_file,
+        map_file,
+        open,
+        stat,
+        write_file,
+        list_files,
+        list_dirs,
+        walk,
+        count
+    };
+
+#if TINYVFS_ENABLE_STATS
+    // Latency distribution with power-of-two buckets: bucket i counts operations
+    // that took less than 2^i nanoseconds but at least 2^(i-1).
+    struct LatencyHistogram
+    {
+        static constexpr size_t bucket_count = 40;
+
+        std::array<std::uint64_t, bucket_count> buckets{};
+        std::uint64_t count = 0;
+        std::uint64_t total_ns = 0;
+        std::uint64_t max_ns = 0;
+
+        // Upper bound of the bucket holding the `fraction` quantile, e.g. 0.99.
+        std::uint64_t percentile_ns(double fraction) const
+        {
+            if (count == 0)
+                return 0;
+            const double target = fraction * static_cast<double>(count);
+            std::uint64_t seen = 0;
+            for (size_t i = 0; i < bucket_count; ++i)
+            {
+                seen += buckets[i];
+                if (static_cast<double>(seen) >= target && seen > 0)
+                    return std::min(std::uint64_t{1} << i, max_ns);
+            }
+            return max_ns;
+        }
+    };
+
+    // Counters for one mount. A probe is one backend call made while resolving a
+    // path; a hit is a probe that found it. Mounts with few hits under many misses
+    // are the ones worth folding into a lower layer.
+    struct MountStats
+    {
+        std::string mount;
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t bytes_read = 0;
+        std::uint64_t backend_ns = 0;
+    };
+
+    struct VfsStats
+    {
+        std::array<LatencyHistogram, static_cast<size_t>(TraceOp::count)> latency;
+        // Current mounts in mount order; counters of unmounted mounts are dropped.
+        std::vector<MountStats> mounts;
+        std::uint64_t normalize_ns = 0;
+        // probes[n] counts resolved lookups that needed n + 1 probes; the last slot
+        // also takes anything deeper.
+        std::array<std::uint64_t, 8> probes{};
+
+        const LatencyHistogram& operator[](TraceOp op) const { return latency[static_cast<size_t>(op)]; }
+    };
+
+    struct TraceEvent
+    {
+        TraceOp op;
+        std::string_view path;
+        bool found;
+        std::uint64_t bytes;
+        size_t probes;
+        std::uint64_t duration_ns;
+    };
+
+    // Called on the thread doing the operation, so they can open and close zones in
+    // a profiler such as Tracy, ETW or Perfetto. Either may be empty.
+    struct TraceHooks
+    {
+        std::function<void(TraceOp op, std::string_view path)> begin;
+        std::function<void(const TraceEvent& event)> end;
+    };
+
+    namespace detail
+    {
+        inline void atomic_max(std::atomic<std::uint64_t>& target, std::uint64_t value)
+        {
+            std::uint64_t current = target.load(std::memory_order_relaxed);
+            while (current < value && !target.compare_exchange_weak(current, value, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        class AtomicHistogram
+        {
+        public:
+            void record(std::uint64_t ns)
+            {
+                size_t bucket = 0;
+                for (std::uint64_t rest = ns; rest != 0 && bucket + 1 < LatencyHistogram::bucket_count; rest >>= 1)
+                    ++bucket;
+                buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+                count_.fetch_add(1, std::memory_order_relaxed);
+                total_ns_.fetch_add(ns, std::memory_order_relaxed);
+                atomic_max(max_ns_, ns);
+            }
+
+            void load(LatencyHistogram& out) const
+            {
+                for (size_t i = 0; i < LatencyHistogram::bucket_count; ++i)
+                    out.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+                out.count = count_.load(std::memory_order_relaxed);
+                out.total_ns = total_ns_.load(std::memory_order_relaxed);
+                out.max_ns = max_ns_.load(std::memory_order_relaxed);
+            }
+
+            void reset()
+            {
+                for (auto& bucket : buckets_)
+                    bucket.store(0, std::memory_order_relaxed);
+                count_.store(0, std::memory_order_relaxed);
+                total_ns_.store(0, std::memory_order_relaxed);
+                max_ns_.store(0, std::memory_order_relaxed);
+            }
+
+        private:
+            std::array<std::atomic<std::uint64_t>, LatencyHistogram::bucket_count> buckets_{};
+            std::atomic<std::uint64_t> count_{0};
+            std::atomic<std::uint64_t> total_ns_{0};
+            std::atomic<std::uint64_t> max_ns_{0};
+        };
+
+        struct MountCounters
+        {
+            std::atomic<std::uint64_t> hits{0};
+            std::atomic<std::uint64_t> misses{0};
+            std::atomic<std::uint64_t> bytes_read{0};
+            std::atomic<std::uint64_t> backend_ns{0};
+        };
+
+        struct VfsCounters
+        {
+            std::array<AtomicHistogram, static_cast<size_t>(TraceOp::count)> latency;
+            std::atomic<std::uint64_t> normalize_ns{0};
+            std::array<std::atomic<std::uint64_t>, 8> probes{};
+        };
+    }
+#endif
+
+    namespace detail
+    {
+        // Hazard pointers for one shared object: a reader announces the pointer it uses in
+        // a free slot for the length of a call, and a writer frees a replaced object only
+        // once no slot announces it. Slots sit on their own cache lines and each thread
+        // starts probing at its own one, so readers on different cores write no shared line.
+        class HazardSlots
+        {
+        public:
+            static constexpr size_t count = 64;
+
+            // The slot now holding `ptr`, or `count` when every slot is busy.
+            size_t acquire(const void* ptr) noexcept
+            {
+                const size_t home = home_slot();
+                for (size_t i = 0; i < count; ++i)
+                {
+                    const size_t slot = (home + i) % count;
+                    const void* expected = nullptr;
+                    if (slots_[slot].ptr.compare_exchange_strong(expected, ptr, std::memory_order_seq_cst))
+                        return slot;
+                }
+                return count;
+            }
+
+            void release(size_t slot) noexcept
+            {
+                slots_[slot].ptr.store(nullptr, std::memory_order_release);
+            }
+
+            bool protects(const void* ptr) const noexcept
+            {
+                for (const Slot& slot : slots_)
+                {
+                    if (slot.ptr.load(std::memory_order_seq_cst) == ptr)
+                        return true;
+                }
+                return false;
+            }
+
+        private:
+            struct alignas(64) Slot
+            {
+                std::atomic<const void*> ptr{nullptr};
+            };
+
+            std::array<Slot, count> slots_;
+
+            static size_t home_slot() noexcept
+            {
+                static std::atomic<size_t> next{0};
+                static thread_local const size_t slot = next.fetch_add(1, std::memory_order_relaxed);
+                return slot;
+            }
+        };
+    }
+
+    using ReadCallback = std::function<void(std::optional<Blob>)>;
+    // Result::ok or not_found once the read ran; cancelled when it never started.
+    using ScheduledReadCallback = std::function<void(Result result, std::optional<Blob> blob)>;
+
+    // Mounts live in an immutable table published through an atomic pointer.
+    // mount(), unmount() and build_index() copy the table and publish the copy, while
+    // readers pin a snapshot in a hazard slot, without locking or touching a refcount,
+    // and keep using it until they return. A read that started before unmount() can
+    // therefore still finish on the old mount.
+    class Vfs final
+    {
+    public:
+        Vfs()
+        {
+            store_table(std::make_shared<MountTable>());
+        }
+
+        // Outstanding async reads finish before the mounts go away. Must not run on one
+        // of the Vfs's own worker threads, which cannot join themselves.
+        ~Vfs()
+        {
+            wait_async();
+        }
+
+        Vfs(const Vfs&) = delete;
+        Vfs& operator=(const Vfs&) = delete;
+
+        bool mount(std::string_view path, std::shared_ptr<Backend> backend)
+        {
+            if (!backend)
+                return false;
+
+            std::string normalized;
+            if (!detail::normalize_virtual_path(path, normalized))
+                return false;
+
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            const auto current = load_table();
+            auto next = copy_table(*current);
+            next->index.reset();
+            MountPoint point;
+            point.mount = normalized;
+            point.backend = std::move(backend);
+#if TINYVFS_ENABLE_STATS
+            point.counters = std::make_shared<detail::MountCounters>();
+#endif
+            if (watching_)
+                point.watch = point.backend->watch(std::string_view());
+            next->mounts.push_back(std::move(point));
+            reset_caches(*next);
+            store_table(std::move(next));
+            return true;
+        }
+
+        bool mount_disk(std::string_view path, const fs::path& root, DiskBackendOptions options = DiskBackendOptions())
+        {
+            if (options.case_insensitive && options.fold_base.empty())
+                options.fold_base = root;
+            auto backend = std::make_shared<SubtreeBackend>(
+                std::make_shared<DiskBackend>(options),
+                root);
+            return mount(path, backend);
+        }
+
+        bool mount_pack(std::string_view path, const fs::path& pack_file)
+        {
+            auto backend = PackBackend::open(pack_file);
+            if (!backend)
+                return false;
+            return mount(path, backend);
+        }
+
+        bool unmount(std::string_view path)
+        {
+            std::string normalized;
+            if (!detail::normalize_virtual_path(path, normalized))
+                return false;
+
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            const auto current = load_table();
+            auto next = copy_table(*current);
+            next->index.reset();
+            next->mounts.erase(std::remove_if(next->mounts.begin(), next->mounts.end(), [&](const MountPoint& mount)
+            {
+                return mount.mount == normalized;
+            }), next->mounts.end());
+
+            if (next->mounts.size() == current->mounts.size())
+                return false;
+
+            reset_caches(*next);
+            store_table(std::move(next));
+            return true;
+        }
+
+        // Scans every mount once and records the winning mount for each virtual file.
+        // While an index is present, exists_file/read_file resolve with one hash probe
+        // instead of probing each mount; mount() and unmount() drop it.
+        bool build_index()
+        {
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            const auto current = load_table();
+            auto next = copy_table(*current);
+
+            auto index = std::make_shared<Index>();
+            for (size_t i = next->mounts.size(); i-- > 0;)
+            {
+                if (!index_backend(*next, *index, i, std::string()))
+                    return false;
+            }
+
+            next->index = std::move(index);
+            store_table(std::move(next));
+            return true;
+        }
+
+        void clear_index()
+        {
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            auto current = load_table();
+            if (!current->index)
+                return;
+
+            auto next = copy_table(*current);
+            next->index.reset();
+            store_table(std::move(next));
+        }
+
+        bool has_index() const { return load_table()->index != nullptr; }
+
+        // Writes the index to `file` so a later launch can load_index() instead of
+        // scanning: each file's path hash, winning mount, size and mtime, plus every
+        // scanned directory's mtime. Costs one stat per file, so save after
+        // build_index() rather than on a hot path. `stamp`, such as a build id or a
+        // content manifest hash, must match on load.
+        Result save_index(const fs::path& file, std::string_view stamp = {}) const
+        {
+            const auto table = load_table();
+            if (!table->index)
+                return Result::not_found;
+            const Index& index = *table->index;
+
+            std::vector<std::pair<std::string, Index::Entry>> written;
+            {
+                std::lock_guard<std::mutex> lock(index.written_mutex);
+                written.assign(index.written.begin(), index.written.end());
+            }
+            std::unordered_set<std::string_view> overridden;
+            std::unordered_set<std::string> changed_dirs;
+            for (const auto& item : written)
+            {
+                overridden.insert(item.first);
+                size_t slash = item.first.rfind('/');
+                changed_dirs.insert(slash == std::string::npos ? std::string() : item.first.substr(0, slash));
+            }
+
+            struct Record
+            {
+                std::uint64_t hash;
+                FileStat stat;
+                std::string_view path;
+                Index::Entry entry;
+            };
+            std::vector<Record> records;
+            auto add = [&](std::string_view path, const Index::Entry& entry)
+            {
+                auto stat = table->mounts[entry.mount].backend->stat(path.substr(entry.relative_offset));
+                if (stat && stat->type == FileType::file)
+                    records.push_back(Record{detail::hash_path(path), *stat, path, entry});
+            };
+            if (index.records)
+            {
+                for (size_t i = 0; i < index.record_count; ++i)
+                {
+                    std::string_view path = index.record_name(i);
+                    if (overridden.count(path) == 0)
+                        add(path, Index::Entry{detail::load_le32(index.record(i) + 32), detail::load_le32(index.record(i) + 36)});
+                }
+            }
+            else
+            {
+                for (const auto& item : index.entries)
+                {
+                    if (overridden.count(item.first) == 0)
+                        add(item.first, item.second);
+                }
+            }
+            for (const auto& item : written)
+            {
+                if (item.second.mount != Index::removed)
+                    add(item.first, item.second);
+            }
+            std::sort(records.begin(), records.end(), [](const Record& a, const Record& b)
+            {
+                return a.hash != b.hash ? a.hash < b.hash : a.path < b.path;
+            });
+
+            std::string strings;
+            std::vector<std::byte> out(index_snapshot::header_size);
+            auto put32 = [&](std::uint64_t value)
+            {
+                size_t at = out.size();
+                out.resize(at + 4);
+                detail::store_le32(out.data() + at, static_cast<std::uint32_t>(value));
+            };
+            auto put64 = [&](std::uint64_t value)
+            {
+                size_t at = out.size();
+                out.resize(at + 8);
+                detail::store_le64(out.data() + at, value);
+            };
+            auto put_string = [&](std::string_view text)
+            {
+                put32(strings.size());
+                put32(text.size());
+                strings.append(text);
+            };
+
+            strings.append(stamp);
+            for (const MountPoint& mount : table->mounts)
+                put_string(mount.mount);
+            for (const Record& record : records)
+            {
+                put64(record.hash);
+                put64(record.stat.size);
+                put64(static_cast<std::uint64_t>(record.stat.mtime_ns));
+                put_string(record.path);
+                put32(record.entry.mount);
+                put32(record.entry.relative_offset);
+            }
+            // Directories holding files written since the build changed through this Vfs,
+            // which the index already accounts for, so their mtimes are taken again.
+            std::string dir_path;
+            for (const Index::Dir& dir : index.dirs)
+            {
+                const std::string& mount = table->mounts[dir.mount].mount;
+                dir_path = mount;
+                if (!mount.empty() && !dir.path.empty())
+                    dir_path.push_back('/');
+                dir_path += dir.path;
+                std::int64_t mtime_ns = changed_dirs.count(dir_path) != 0 ?
+                    directory_mtime(*table->mounts[dir.mount].backend, dir.path) : dir.mtime_ns;
+                put64(static_cast<std::uint64_t>(mtime_ns));
+                put_string(dir.path);
+                put32(dir.mount);
+                put32(0);
+            }
+            if (strings.size() > UINT32_MAX)
+                return Result::io_error;
+
+            std::byte* header = out.data();
+            std::memcpy(header, index_snapshot::magic, sizeof(index_snapshot::magic));
+            detail::store_le32(header + 8, index_snapshot::version);
+            detail::store_le32(header + 12, static_cast<std::uint32_t>(table->mounts.size()));
+            detail::store_le64(header + 16, records.size());
+            detail::store_le64(header + 24, index.dirs.size());
+            detail::store_le64(header + 32, strings.size());
+            detail::store_le32(header + 40, 0);
+            detail::store_le32(header + 44, static_cast<std::uint32_t>(stamp.size()));
+
+            WriteChunk chunks[2] = {{out.data(), out.size()}, {strings.data(), strings.size()}};
+            WriteOptions options;
+            options.atomic = true;
+            return detail::write_os_file(file, chunks, 2, options);
+        }
+
+        // Adopts an index written by save_index() without scanning any mount. The file is
+        // mapped and searched in place, so loading costs the checks below and no parsing.
+        // False when the file is missing or damaged, was saved for other mount roots or
+        // another stamp, or fails `check`; call build_index() then.
+        bool load_index(const fs::path& file, IndexCheck check = IndexCheck::directories, std::string_view stamp = {})
+        {
+            auto view = detail::map_os_file(file);
+            if (!view || view->size() < index_snapshot::header_size)
+                return false;
+            const std::byte* data = view->data();
+            const std::uint64_t size = view->size();
+            if (std::memcmp(data, index_snapshot::magic, sizeof(index_snapshot::magic)) != 0 ||
+                detail::load_le32(data + 8) != index_snapshot::version)
+            {
+                return false;
+            }
+
+            const std::uint64_t mount_count = detail::load_le32(data + 12);
+            const std::uint64_t entry_count = detail::load_le64(data + 16);
+            const std::uint64_t dir_count = detail::load_le64(data + 24);
+            const std::uint64_t strings_size = detail::load_le64(data + 32);
+            if (entry_count > size / index_snapshot::entry_size || dir_count > size / index_snapshot::dir_size ||
+                strings_size > size ||
+                index_snapshot::header_size + mount_count * index_snapshot::mount_size +
+                    entry_count * index_snapshot::entry_size + dir_count * index_snapshot::dir_size + strings_size != size)
+            {
+                return false;
+            }
+
+            const std::byte* mounts = data + index_snapshot::header_size;
+            const std::byte* entries = mounts + mount_count * index_snapshot::mount_size;
+            const std::byte* dirs = entries + entry_count * index_snapshot::entry_size;
+            const char* strings = reinterpret_cast<const char*>(dirs + dir_count * index_snapshot::dir_size);
+            auto string_at = [&](const std::byte* at, std::string_view& out)
+            {
+                std::uint64_t offset = detail::load_le32(at);
+                std::uint64_t length = detail::load_le32(at + 4);
+                if (offset + length > strings_size)
+                    return false;
+                out = std::string_view(strings + offset, static_cast<size_t>(length));
+                return true;
+            };
+
+            std::string_view saved_stamp;
+            if (!string_at(data + 40, saved_stamp) || saved_stamp != stamp)
+                return false;
+
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            const auto current = load_table();
+            if (current->mounts.size() != mount_count)
+                return false;
+            for (size_t i = 0; i < mount_count; ++i)
+            {
+                std::string_view root;
+                if (!string_at(mounts + i * index_snapshot::mount_size, root) || root != current->mounts[i].mount)
+                    return false;
+            }
+
+            std::uint64_t previous_hash = 0;
+            std::string_view path;
+            for (std::uint64_t i = 0; i < entry_count; ++i)
+            {
+                const std::byte* record = entries + i * index_snapshot::entry_size;
+                const std::uint64_t hash = detail::load_le64(record);
+                const std::uint32_t mount = detail::load_le32(record + 32);
+                if (hash < previous_hash || !string_at(record + 24, path) || mount >= mount_count ||
+                    detail::load_le32(record + 36) > path.size())
+                {
+                    return false;
+                }
+                previous_hash = hash;
+
+                if (check == IndexCheck::files)
+                {
+                    auto stat = current->mounts[mount].backend->stat(path.substr(detail::load_le32(record + 36)));
+                    if (!stat || stat->type != FileType::file || stat->size != detail::load_le64(record + 8) ||
+                        stat->mtime_ns != static_cast<std::int64_t>(detail::load_le64(record + 16)))
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            auto index = std::make_shared<Index>();
+            index->dirs.reserve(static_cast<size_t>(dir_count));
+            for (std::uint64_t i = 0; i < dir_count; ++i)
+            {
+                const std::byte* record = dirs + i * index_snapshot::dir_size;
+                const std::int64_t mtime_ns = static_cast<std::int64_t>(detail::load_le64(record));
+                const std::uint32_t mount = detail::load_le32(record + 16);
+                if (!string_at(record + 8, path) || mount >= mount_count)
+                    return false;
+                if (check != IndexCheck::none && directory_mtime(*current->mounts[mount].backend, path) != mtime_ns)
+                    return false;
+                index->dirs.push_back(Index::Dir{mount, std::string(path), mtime_ns});
+                index->add_dir(virtual_dir(current->mounts[mount], path), mount);
+            }
+
+            index->records = entries;
+            index->record_count = static_cast<size_t>(entry_count);
+            index->strings = strings;
+            index->snapshot = std::move(*view);
+
+            auto next = copy_table(*current);
+            next->index = std::move(index);
+            store_table(std::move(next));
+            return true;
+        }
+
+        // Remembers stat() results, misses included, until the mount stack changes or
+        // the path is written through this Vfs. Changes made behind the Vfs's back are
+        // not seen until clear_stat_cache(). Holds about `capacity` paths.
+        void set_stat_cache(bool enabled, size_t capacity = 65536)
+        {
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            const auto current = load_table();
+            if (!enabled && !current->stats)
+                return;
+            if (enabled && current->stats && current->stats->capacity() == capacity)
+                return;
+
+            auto next = copy_table(*current);
+            next->stats = enabled ? std::make_shared<StatCache>(std::max<size_t>(capacity, 1)) : nullptr;
+            store_table(std::move(next));
+        }
+
+        bool has_stat_cache() const { return load_table()->stats != nullptr; }
+
+        void clear_stat_cache()
+        {
+            const auto table = load_table();
+            if (table->stats)
+                table->stats->clear();
+        }
+
+        // Remembers paths that no mount has, so repeated probes for optional files
+        // (.meta sidecars, localized or platform variants) return without touching a
+        // backend. Filled by exists_file and read_file misses and consulted by every
+        // file lookup. mount() and unmount() start a new set, and write_file removes
+        // the written path; files created behind the Vfs's back need clear_miss_cache().
+        // Unused while an index is present, which already answers misses in memory.
+        void set_miss_cache(bool enabled, size_t capacity = 65536)
+        {
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            const auto current = load_table();
+            if (!enabled && !current->misses)
+                return;
+            if (enabled && current->misses && current->misses->capacity() == capacity)
+                return;
+
+            auto next = copy_table(*current);
+            next->misses = enabled ? std::make_shared<MissCache>(std::max<size_t>(capacity, 1)) : nullptr;
+            store_table(std::move(next));
+        }
+
+        bool has_miss_cache() const { return load_table()->misses != nullptr; }
+
+        size_t miss_cache_size() const
+        {
+            const auto table = load_table();
+            return table->misses ? table->misses->size() : 0;
+        }
+
+        void clear_miss_cache()
+        {
+            const auto table = load_table();
+            if (table->misses)
+                table->misses->clear();
+        }
+
+        // Watches the directory behind every mount that supports it (disk mounts, and
+        // subtree, caching or compressed backends over them) so poll_changes() sees
+        // edits made by other programs. Mounts added later are watched too. Returns the
+        // number of watched mounts.
+        size_t set_watching(bool enabled)
+        {
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            watching_ = enabled;
+            const auto current = load_table();
+            auto next = copy_table(*current);
+
+            size_t watched = 0;
+            for (auto& mount : next->mounts)
+            {
+                if (!enabled)
+                    mount.watch.reset();
+                else if (!mount.watch)
+                    mount.watch = mount.backend->watch(std::string_view());
+                if (mount.watch)
+                    ++watched;
+            }
+            store_table(std::move(next));
+            return watched;
+        }
+
+        // Drains the notifications of watched mounts and updates the index, stat cache
+        // and miss cache file by file (caching backends drop their own copies), then
+        // reports each change as a virtual path. Changes hidden by a higher-priority
+        // mount are skipped, and a file removed from one mount but still served by a
+        // lower one is reported as modified. Returns false when notifications were
+        // lost: the caches are then emptied and the index rebuilt, and callers should
+        // reload anything they derived from the files.
+        bool poll_changes(const ChangeFn& callback)
+        {
+            std::lock_guard<std::mutex> poll_lock(poll_mutex_);
+            const auto table = load_table();
+
+            bool complete = true;
+            std::string virtual_path;
+            detail::PathBuffer buffer;
+            MountTable::Matches matches;
+            for (size_t i = 0; i < table->mounts.size(); ++i)
+            {
+                const MountPoint& mount = table->mounts[i];
+                if (!mount.watch)
+                    continue;
+
+                bool mount_complete = mount.watch->poll([&](ChangeKind kind, std::string_view relative)
+                {
+                    virtual_path = mount.mount;
+                    if (!virtual_path.empty())
+                        virtual_path.push_back('/');
+                    virtual_path.append(relative);
+                    if (detail::normalize_virtual_path(virtual_path, buffer))
+                        apply_change(*table, i, kind, buffer.view(), matches, callback);
+                });
+                complete = complete && mount_complete;
+            }
+
+            if (!complete)
+            {
+                if (table->stats)
+                    table->stats->clear();
+                if (table->misses)
+                    table->misses->clear();
+                if (table->index)
+                    build_index();
+            }
+            return complete;
+        }
+
+#if TINYVFS_ENABLE_STATS
+        // Counters gathered since construction or the last reset_io_stats().
+        VfsStats io_stats() const
+        {
+            VfsStats out;
+            for (size_t i = 0; i < out.latency.size(); ++i)
+                counters_.latency[i].load(out.latency[i]);
+            out.normalize_ns = counters_.normalize_ns.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < out.probes.size(); ++i)
+                out.probes[i] = counters_.probes[i].load(std::memory_order_relaxed);
+
+            const auto table = load_table();
+            for (const auto& mount : table->mounts)
+            {
+                MountStats stats;
+                stats.mount = mount.mount;
+                stats.hits = mount.counters->hits.load(std::memory_order_relaxed);
+                stats.misses = mount.counters->misses.load(std::memory_order_relaxed);
+                stats.bytes_read = mount.counters->bytes_read.load(std::memory_order_relaxed);
+                stats.backend_ns = mount.counters->backend_ns.load(std::memory_order_relaxed);
+                out.mounts.push_back(std::move(stats));
+            }
+            return out;
+        }
+
+        void reset_io_stats()
+        {
+            for (auto& histogram : counters_.latency)
+                histogram.reset();
+            counters_.normalize_ns.store(0, std::memory_order_relaxed);
+            for (auto& slot : counters_.probes)
+                slot.store(0, std::memory_order_relaxed);
+
+            const auto table = load_table();
+            for (const auto& mount : table->mounts)
+            {
+                mount.counters->hits.store(0, std::memory_order_relaxed);
+                mount.counters->misses.store(0, std::memory_order_relaxed);
+                mount.counters->bytes_read.store(0, std::memory_order_relaxed);
+                mount.counters->backend_ns.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        // Applies to operations that start after this returns; operations already
+        // running keep the hooks they started with. Empty hooks turn tracing off.
+        void set_trace_hooks(TraceHooks hooks)
+        {
+            std::lock_guard<std::mutex> lock(write_mutex_);
+            const auto current = load_table();
+            auto next = copy_table(*current);
+            next->hooks.reset();
+            if (hooks.begin || hooks.end)
+                next->hooks = std::make_shared<const TraceHooks>(std::move(hooks));
+            store_table(std::move(next));
+        }
+#endif
+
+        // Metadata of the highest-priority mount that has `path`. Mount roots report as
+        // directories even when no backend lists them.
+        std::optional<FileStat> stat(std::string_view path) const
+        {
+            const auto table = load_table();
+            OpTrace trace(*this, *table, TraceOp::stat, path);
+            detail::PathBuffer buffer;
+            if (!detail::normalize_virtual_path(path, buffer))
+                return std::nullopt;
+            trace.normalized();
+            std::string_view normalized = buffer.view();
+
+            std::optional<FileStat> result;
+            std::uint64_t stat_generation = 0;
+            if (!table->stats || !table->stats->find(normalized, result, stat_generation))
+            {
+                result = stat_mounts(*table, normalized);
+                if (table->stats)
+                    table->stats->insert(normalized, result, stat_generation);
+            }
+            trace.finish(result.has_value());
+            return result;
+        }
+
+
+        bool exists_file(std::string_view path) const
+        {
+            const auto table = load_table();
+            OpTrace trace(*this, *table, TraceOp::exists_file, path);
+            detail::PathBuffer buffer;
+            if (!detail::normalize_virtual_path(path, buffer))
+                return false;
+            trace.normalized();
+            std::string_view normalized = buffer.view();
+
+            if (table->index)
+            {
+                const bool found = table->index->contains(normalized);
+                trace.finish(found);
+                return found;
+            }
+
+            std::uint64_t miss_generation = 0;
+            if (table->misses && table->misses->contains(normalized, miss_generation))
+                return false;
+
+            MountTable::Matches matches;
+            table->match(normalized, matches);
+            for (const auto& match : matches)
+            {
+                auto probe = trace.probe_begin();
+                const bool found = match.mount->backend->exists_file(match.relative);
+                trace.probe_end(*match.mount, probe, found);
+                if (found)
+                {
+                    trace.finish(true);
+                    return true;
+                }
+            }
+
+            if (table->misses)
+                table->misses->insert(normalized, miss_generation);
+            return false;
+        }
+
+        bool exists_dir(std::string_view path) const
+        {
+            const auto table = load_table();
+            detail::PathBuffer buffer;
+            if (!detail::normalize_virtual_path(path, buffer))
+                return false;
+            std::string_view normalized = buffer.view();
+
+            if (normalized.empty())
+                return !table->mounts.empty();
+
+            if (table->find_node(normalized) != MountTable::no_node)
+                return true;
+
+            MountTable::Matches matches;
+            table->match(normalized, matches);
+            for (const auto& match : matches)
+            {
+                if (match.mount->backend->exists_dir(match.relative))
+                    return true;
+            }
+
+            return false;
+        }
+
+        std::optional<Blob> read_file(std::string_view path) const
+        {
+            const auto table = load_table();
+            OpTrace trace(*this, *table, TraceOp::read_file, path);
+            detail::PathBuffer buffer;
+            if (!detail::normalize_virtual_path(path, buffer))
+                return std::nullopt;
+            trace.normalized();
+            std::string_view normalized = buffer.view();
+
+            if (table->index)
+            {
+                Index::Hit hit;
+                if (!table->index->find(normalized, hit))
+                    return std::nullopt;
+                const MountPoint& mount = table->mounts[hit.mount];
+                auto probe = trace.probe_begin();
+                auto data = mount.backend->read_file(hit.relative);
+                trace.probe_end(mount, probe, data.has_value(), data ? data->size() : 0);
+                if (data)
+                    trace.finish(true, data->size());
+                return data;
+            }
+
+            std::uint64_t miss_generation = 0;
+            if (table->misses && table->misses->contains(normalized, miss_generation))
+                return std::nullopt;
+
+            MountTable::Matches matches;
+            table->match(normalized, matches);
+            for (const auto& match : matches)
+            {
+                auto probe = trace.probe_begin();
+                auto data = match.mount->backend->read_file(match.relative);
+                trace.probe_end(*match.mount, probe, data.has_value(), data ? data->size() : 0);
+                if (data)
+                {
+                    trace.finish(true, data->size());
+                    return data;
+                }
+            }
+
+            if (table->misses)
+                table->misses->insert(normalized, miss_generation);
+            return std::nullopt;
+        }
+
+        // Reads into storage from `allocator` without zero-filling it first. Unbuffered
+        // files ask it for sector-aligned storage so reads can land in place. The blob
+        // returns its storage to `allocator`, which must outlive it.
+        std::optional<Blob> read_file(std::string_view path, BlobAllocator& allocator) const
+        {
+            auto file = open(path);
+            if (!file || file->size() > SIZE_MAX)
+                return std::nullopt;
+
+            size_t size = static_cast<size_t>(file->size());
+            Blob blob = Blob::allocate(size, &allocator, std::max(file->handle().direct_alignment(), alignof(std::max_align_t)));
+            if (blob.size() != size)
+                return std::nullopt;
+            if (size > 0 && file->read_at(0, blob.mutable_data(), size) != size)
+                return std::nullopt;
+            return blob;
+        }
+
+        // Reads straight into caller memory. `size` receives the file size, including
+        // when the buffer is too small so the caller can grow it and retry.
+        Result read_file_into(std::string_view path, void* dst, size_t capacity, size_t& size) const
+        {
+            size = 0;
+            detail::PathBuffer buffer;
+            if (!detail::normalize_virtual_path(path, buffer))
+                return Result::invalid_path;
+            std::string_view normalized = buffer.view();
+
+            auto file = open(normalized);
+            if (!file)
+                return Result::not_found;
+            if (file->size() > SIZE_MAX)
+                return Result::buffer_too_small;
+
+            size = static_cast<size_t>(file->size());
+            if (size > capacity)
+                return Result::buffer_too_small;
+            if (size > 0 && file->read_at(0, dst, size) != size)
+                return Result::io_error;
+            return Result::ok;
+        }
+
+        // Zero-copy alternative to read_file: the view aliases a file mapping where the
+        // backend supports one and stays valid after the Vfs is unmounted or destroyed.
+        std::optional<FileView> map_file(std::string_view path) const
+        {
+            const auto table = load_table();
+            OpTrace trace(*this, *table, TraceOp::map_file, path);
+            detail::PathBuffer buffer;
+            if (!detail::normalize_virtual_path(path, buffer))
+                return std::nullopt;
+            trace.normalized();
+            std::string_view normalized = buffer.view();
+
+            if (table->index)
+            {
+                Index::Hit hit;
+                if (!table->index->find(normalized, hit))
+                    return std::nullopt;
+                const MountPoint& mount = table->mounts[hit.mount];
+                auto probe = trace.probe_begin();
+                auto view = mount.backend->map_file(hit.relative);
+                trace.probe_end(mount, probe, view.has_value(), view ? view->size() : 0);
+                if (view)
+                    trace.finish(true, view->size());
+                return view;
+            }
+
+            if (table->misses && table->misses->contains(normalized))
+                return std::nullopt;
+
+            MountTable::Matches matches;
+            table->match(normalized, matches);
+            for (const auto& match : matches)
+            {
+                auto probe = trace.probe_begin();
+                auto view = match.mount->backend->map_file(match.relative);
+                trace.probe_end(*match.mount, probe, view.has_value(), view ? view->size() : 0);
+                if (view)
+                {
+                    trace.finish(true, view->size());
+                    return view;
+                }
+            }
+
+            return std::nullopt;
+        }
+
+        // Resolves every path through the mount stack, then hands each backend its share
+        // of the batch in one call. The callback may see indices out of order.
+        void read_files(const std::vector<std::string_view>& paths, const BatchReadFn& callback) const
+        {
+            const auto table = load_table();
+            std::vector<std::string> normalized(paths.size());
+            std::vector<size_t> pending;
+            pending.reserve(paths.size());
+            for (size_t i = 0; i < paths.size(); ++i)
+            {
+                if (detail::normalize_virtual_path(paths[i], normalized[i]))
+                    pending.push_back(i);
+                else
+                    callback(i, std::nullopt);
+            }
+
+            std::vector<std::string_view> relative;
+            std::vector<size_t> requests;
+            auto read_batch = [&](Backend& backend, std::vector<bool>* found)
+            {
+                backend.read_files(relative, [&](size_t index, std::optional<Blob> blob)
+                {
+                    if (found)
+                    {
+                        if (!blob)
+                            return;
+                        (*found)[index] = true;
+                    }
+                    callback(requests[index], std::move(blob));
+                });
+            };
+
+            if (table->index)
+            {
+                std::unordered_map<size_t, std::vector<std::pair<size_t, std::string_view>>> groups;
+                for (size_t i : pending)
+                {
+                    Index::Hit hit;
+                    if (!table->index->find(normalized[i], hit))
+                        callback(i, std::nullopt);
+                    else
+                        groups[hit.mount].emplace_back(i, hit.relative);
+                }
+
+                for (const auto& [mount, members] : groups)
+                {
+                    relative.clear();
+                    requests.clear();
+                    for (const auto& [i, rel] : members)
+                    {
+                        requests.push_back(i);
+                        relative.push_back(rel);
+                    }
+                    read_batch(*table->mounts[mount].backend, nullptr);
+                }
+                return;
+            }
+
+            // Every (mount, path) pairing from the trie, highest priority mount first;
+            // each mount then gets the paths no higher mount has served.
+            struct Candidate
+            {
+                size_t mount;
+                size_t request;
+                std::string_view relative;
+            };
+
+            std::vector<Candidate> candidates;
+            MountTable::Matches matches;
+            for (size_t i : pending)
+            {
+                table->match(normalized[i], matches);
+                for (const auto& match : matches)
+                    candidates.push_back(Candidate{match.index, i, match.relative});
+            }
+            std::stable_sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b)
+            {
+                return a.mount > b.mount;
+            });
+
+            std::vector<bool> resolved(paths.size(), false);
+            for (size_t first = 0; first < candidates.size();)
+            {
+                size_t last = first;
+                relative.clear();
+                requests.clear();
+                for (; last < candidates.size() && candidates[last].mount == candidates[first].mount; ++last)
+                {
+                    if (resolved[candidates[last].request])
+                        continue;
+                    relative.push_back(candidates[last].relative);
+                    requests.push_back(candidates[last].request);
+                }
+
+                if (!requests.empty())
+                {
+                    std::vector<bool> found(requests.size(), false);
+                    read_batch(*table->mounts[candidates[first].mount].backend, &found);
+                    for (size_t k = 0; k < requests.size(); ++k)
+                    {
+                        if (found[k])
+                            resolved[requests[k]] = true;
+                    }
+                }
+                first = last;
+            }
+
+            for (size_t i : pending)
+            {
+                if (!resolved[i])
+                    callback(i, std::nullopt);
+            }
+        }
+
+        void read_files(std::initializer_list<std::string_view> paths, const BatchReadFn& callback) const
+        {
+            std::vector<std::string_view> path_list(paths);
+            read_files(path_list, callback);
+        }
+
+        // Replaces the worker pool used by read_file_async; the previous pool finishes its
+        // queued reads first. A default pool is created on first use if none is set.
+        void set_io_workers(size_t workers, size_t max_queued = 256)
+        {
+            auto pool = std::make_shared<IoPool>(workers, max_queued);
+            std::vector<std::shared_ptr<IoPool>> done;
+            {
+                std::lock_guard<std::mutex> lock(pool_mutex_);
+                pool_.swap(pool);
+                if (pool)
+                    retired_pools_.push_back(std::move(pool));
+                release_idle(retired_pools_, done);
+            }
+        }
+
+        // The callback runs on a worker thread; the Vfs waits for outstanding reads when
+        // it is destroyed.
+        void read_file_async(std::string_view path, ReadCallback callback) const
+        {
+            io_pool()->submit([this, owned = std::string(path), callback = std::move(callback)]
+            {
+                callback(read_file(owned));
+            });
+        }
+
+        std::future<std::optional<Blob>> read_file_async(std::string_view path) const
+        {
+            auto promise = std::make_shared<std::promise<std::optional<Blob>>>();
+            std::future<std::optional<Blob>> future = promise->get_future();
+            read_file_async(path, [promise](std::optional<Blob> blob)
+            {
+                promise->set_value(std::move(blob));
+            });
+            return future;
+        }
+
+        // Replaces the scheduler used by prioritised reads; requests still queued on the
+        // previous one are cancelled. A four-worker scheduler is created on first use.
+        void set_io_scheduler(size_t workers)
+        {
+            auto scheduler = std::make_shared<IoScheduler>(workers);
+            std::vector<std::shared_ptr<IoScheduler>> done;
+            {
+                std::lock_guard<std::mutex> lock(pool_mutex_);
+                scheduler_.swap(scheduler);
+                if (scheduler)
+                    retired_schedulers_.push_back(scheduler);
+                release_idle(retired_schedulers_, done);
+            }
+            if (scheduler)
+                scheduler->cancel_all();
+        }
+
+        // For device queue-depth and priority limits. The copy stays usable after
+        // set_io_scheduler() replaces it, but no longer serves this Vfs's reads; do not
+        // let the last copy drop on one of the scheduler's own workers.
+        std::shared_ptr<IoScheduler> io_scheduler() const
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex_);
+            if (!scheduler_)
+                scheduler_ = std::make_shared<IoScheduler>();
+            return scheduler_;
+        }
+
+        // Queues a read behind more urgent requests and returns a ticket for
+        // cancel_read(). The callback runs on a scheduler worker, or on the cancelling
+        // thread when cancelled.
+        IoTicket read_file_async(std::string_view path, const IoRequest& request, ScheduledReadCallback callback) const
+        {
+            return io_scheduler()->submit(request, [this, owned = std::string(path), callback = std::move(callback)](Result result)
+            {
+                if (result != Result::ok)
+                {
+                    callback(result, std::nullopt);
+                    return;
+                }
+                auto blob = read_file(owned);
+                Result found = blob ? Result::ok : Result::not_found;
+                callback(found, std::move(blob));
+            });
+        }
+
+        // False when the read already started or finished.
+        bool cancel_read(IoTicket ticket) const
+        {
+            return io_scheduler()->cancel(ticket);
+        }
+
+        // Hints that `paths` will be read soon and returns at once. A worker resolves
+        // each path through the mounts and starts OS readahead (or fills a caching
+        // backend), so a later read_file finds the data in memory.
+        void prefetch(const std::vector<std::string_view>& paths) const
+        {
+            std::vector<std::string> owned(paths.begin(), paths.end());
+            io_pool()->submit([this, owned = std::move(owned)]
+            {
+                for (const auto& path : owned)
+                    prefetch_now(path);
+            });
+        }
+
+        void prefetch(std::initializer_list<std::string_view> paths) const
+        {
+            prefetch(std::vector<std::string_view>(paths));
+        }
+
+        // Blocking form of prefetch for a single path; true when a mount took the hint.
+        bool prefetch_now(std::string_view path) const
+        {
+            const auto table = load_table();
+            detail::PathBuffer buffer;
+            if (!detail::normalize_virtual_path(path, buffer))
+                return false;
+            std::string_view normalized = buffer.view();
+
+            if (table->index)
+            {
+                Index::Hit hit;
+                return table->index->find(normalized, hit) &&
+                    table->mounts[hit.mount].backend->prefetch(hit.relative);
+            }
+
+            if (table->misses && table->misses->contains(normalized))
+                return false;
+
+            MountTable::Matches matches;
+            table->match(normalized, matches);
+            for (const auto& match : matches)
+            {
+                if (match.mount->backend->prefetch(match.relative))
+                    return true;
+            }
+            return false;
+        }
+
+        void wait_async() const
+        {
+            // Replaced pools first, since their callbacks may still queue on the current
+            // ones. Waits on copies so those callbacks can still reach them.
+            drain_retired(retired_pools_);
+            drain_retired(retired_schedulers_);
+            std::shared_ptr<IoPool> pool;
+            std::shared_ptr<IoScheduler> scheduler;
+            {
+                std::lock_guard<std::mutex> lock(pool_mutex_);
+                pool = pool_;
+                scheduler = scheduler_;
+            }
+            if (pool)
+                pool->wait_idle();
+            if (scheduler)
+                scheduler->wait_idle();
+        }
+
+        // Opens a file for partial reads without loading it; see File.
+        std::optional<File> open(std::string_view path) const
+        {
+            const auto table = load_table();
+            OpTrace trace(*this, *table, TraceOp::open, path);
+            detail::PathBuffer buffer;
+            if (!detail::normalize_virtual_path(path, buffer))
+                return std::nullopt;
+            trace.normalized();
+            std::string_view normalized = buffer.view();
+
+            if (table->index)
+            {
+                Index::Hit hit;
+                if (!table->index->find(normalized, hit))
+                    return std::nullopt;
+                const MountPoint& mount = table->mounts[hit.mount];
+                auto probe = trace.probe_begin();
+                auto handle = mount.backend->open_file(hit.relative);
+                trace.probe_end(mount, probe, handle != nullptr);
+                if (!handle)
+                    return std::nullopt;
+                trace.finish(true);
+                return File(std::move(handle));
+            }
+
+            if (table->misses && table->misses->contains(normalized))
+                return std::nullopt;
+
+            MountTable::Matches matches;
+            table->match(normalized, matches);
+            for (const auto& match : matches)
+            {
+                auto probe = trace.probe_begin();
+                auto handle = match.mount->backend->open_file(match.relative);
+                trace.probe_end(*match.mount, probe, handle != nullptr);
+                if (handle)
+                {
+                    trace.finish(true);
+                    return File(std::move(handle));
+                }
+            }
+
+            return std::nullopt;
+        }
+
+        std::optional<std::string> read_text(std::string_view path, bool append_null = false) const
+        {
+            auto blob = read_file(path);
+            if (!blob)
+                return std::nullopt;
+            return blob->to_string(append_null);
+        }
+
+        Result write_file(std::string_view path,
+            const void* data,
+            size_t size,
+            const WriteOptions& options = WriteOptions()) const
+        {
+            WriteChunk chunk{data, size};
+            return write_file_gather(path, &chunk, 1, options);
+        }
+
+        // Writes the chunks back to back as one file, without joining them first when
+        // the backend supports gathered writes.
+        Result write_file_gather(std::string_view path,
+            const WriteChunk* chunks,
+            size_t count,
+            const WriteOptions& options = WriteOptions()) const
+        {
+            const auto table = load_table();
+            OpTrace trace(*this, *table, TraceOp::write_file, path);
+            detail::PathBuffer buffer;
+            if (!detail::normalize_virtual_path(path, buffer))
+                return Result::invalid_path;
+            trace.normalized();
+            std::string_view normalized = buffer.view();
+
+            bool matched = false;
+            Result last_result = Result::not_supported;
+
+            MountTable::Matches matches;
+            table->match(normalized, matches);
+            for (const auto& match : matches)
+            {
+                matched = true;
+                auto probe = trace.probe_begin();
+                Result result = match.mount->backend->write_file_gather(match.relative, chunks, count, options);
+                trace.probe_end(*match.mount, probe, result == Result::ok);
+                if (result == Result::ok)
+                    index_written(*table, normalized, match.index);
+                if (result == Result::ok || result == Result::io_error)
+                {
+                    // Backends may have created parent directories along with the file.
+                    if (table->stats)
+                        table->stats->erase_with_parents(normalized);
+                    if (table->misses)
+                        table->misses->erase(normalized);
+                    trace.finish(result == Result::ok);
+                    return result;
+                }
+                if (result != Result::not_supported)
+                    last_result = result;
+            }
+
+            if (!matched)
+                return Result::not_found;
+
+            return last_result;
+        }
+
+        Result write_file_gather(std::string_view path,
+            std::initializer_list<WriteChunk> chunks,
+            const WriteOptions& options = WriteOptions()) const
+        {
+            return write_file_gather(path, chunks.begin(), chunks.size(), options);
+        }
+
+        Result list_files(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateRef& callback,
+            bool allow_duplicates = false) const
+        {
+            const auto table = load_table();
+            OpTrace trace(*this, *table, TraceOp::list_files, path);
+            detail::PathBuffer buffer;
+            if (!detail::normalize_virtual_path(path, buffer))
+                return Result::invalid_path;
+            trace.normalized();
+            std::string_view normalized = buffer.view();
+
+            MountTable::Matches matches;
+            table->match(normalized, matches);
+            // A single mount cannot shadow itself; let it stream straight to the caller.
+            if (matches.size() == 1)
+            {
+                const auto& match = *matches.begin();
+                Result result = match.mount->backend->list_files(match.relative, extensions, callback, allow_duplicates);
+                if (result == Result::io_error)
+                    return result;
+                trace.finish(true);
+                return Result::ok;
+            }
+
+            bool matched = false;
+            std::unordered_set<std::string> seen;
+
+            auto emit = [&](std::string_view name)
+            {
+                if (allow_duplicates)
+                {
+                    callback(name);
+                    return;
+                }
+
+                if (seen.insert(std::string(name)).second)
+                    callback(name);
+            };
+
+            for (const auto& match : matches)
+            {
+                matched = true;
+                Result result = match.mount->backend->list_files(
+                    match.relative,
+                    extensions,
+                    emit,
+                    true);
+                if (result == Result::io_error)
+                    return result;
+            }
+
+            trace.finish(matched);
+            return matched ? Result::ok : Result::not_found;
+        }
+
+        Result list_files(std::string_view path,
+            std::initializer_list<std::string_view> extensions,
+            const EnumerateRef& callback,
+            bool allow_duplicates = false) const
+        {
+            std::vector<std::string_view> ext_list(extensions);
+            return list_files(path, ext_list, callback, allow_duplicates);
+        }
+
+        Result list_dirs(std::string_view path,
+            const EnumerateRef& callback,
+            bool allow_duplicates = false) const
+        {
+            const auto table = load_table();
+            OpTrace trace(*this, *table, TraceOp::list_dirs, path);
+            detail::PathBuffer buffer;
+            if (!detail::normalize_virtual_path(path, buffer))
+                return Result::invalid_path;
+            trace.normalized();
+            std::string_view normalized = buffer.view();
+
+            std::unordered_set<std::string> seen;
+
+            auto emit = [&](std::string_view name)
+            {
+                if (allow_duplicates)
+                {
+                    callback(name);
+                    return;
+                }
+
+                if (seen.insert(std::string(name)).second)
+                    callback(name);
+            };
+
+            size_t node = table->find_node(normalized);
+            MountTable::Matches matches;
+            table->match(normalized, matches);
+            if (matches.size() == 1 && (node == MountTable::no_node || table->nodes[node].children.empty()))
+            {
+                const auto& match = *matches.begin();
+                Result result = match.mount->backend->list_dirs(match.relative, callback, allow_duplicates);
+                if (result == Result::io_error)
+                    return result;
+                trace.finish(true);
+                return Result::ok;
+            }
+
+            if (node != MountTable::no_node)
+            {
+                for (const auto& child : table->nodes[node].children)
+                    emit(child.first);
+            }
+
+            bool matched = false;
+            for (const auto& match : matches)
+            {
+                matched = true;
+                Result result = match.mount->backend->list_dirs(match.relative, emit, true);
+                if (result == Result::io_error)
+                    return result;
+            }
+
+            const bool found = matched || !seen.empty();
+            trace.finish(found);
+            return found ? Result::ok : Result::not_found;
+        }
+
+        // Recursively lists files below `path` across every mount, with overlay
+        // de-duplication; names are relative to `path`. `threads` lets disk-backed
+        // mounts iterate directories in parallel. The callback runs on this thread.
+        Result walk(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateRef& callback,
+            size_t threads = 1) const
+        {
+            const auto table = load_table();
+            OpTrace trace(*this, *table, TraceOp::walk, path);
+            detail::PathBuffer buffer;
+            if (!detail::normalize_virtual_path(path, buffer))
+                return Result::invalid_path;
+            trace.normalized();
+            std::string_view normalized = buffer.view();
+
+            // Mounts covering the path walk from the matching directory; mounts nested
+            // below it walk from their root and get their mount path as a prefix.
+            struct Source
+            {
+                size_t mount;
+                std::string_view relative;
+                std::string_view prefix;
+            };
+
+            std::vector<Source> sources;
+            MountTable::Matches matches;
+            table->match(normalized, matches);
+            for (const auto& match : matches)
+                sources.push_back(Source{match.index, match.relative, {}});
+            table->for_each_below(normalized, [&](size_t mount, std::string_view prefix)
+            {
+                sources.push_back(Source{mount, {}, prefix});
+            });
+            std::sort(sources.begin(), sources.end(), [](const Source& a, const Source& b)
+            {
+                return a.mount > b.mount;
+            });
+
+            if (sources.size() == 1 && sources.front().prefix.empty())
+            {
+                Result result = table->mounts[sources.front().mount].backend->walk(
+                    sources.front().relative, extensions, callback, threads);
+                if (result == Result::io_error)
+                    return result;
+                trace.finish(true);
+                return Result::ok;
+            }
+
+            bool matched = false;
+            std::unordered_set<std::string> seen;
+            std::string prefixed;
+
+            for (const Source& source : sources)
+            {
+                std::string_view prefix = source.prefix;
+                matched = true;
+                Result result = table->mounts[source.mount].backend->walk(source.relative, extensions, [&](std::string_view name)
+                {
+                    std::string_view full = name;
+                    if (!prefix.empty())
+                    {
+                        prefixed.assign(prefix);
+                        prefixed.push_back('/');
+                        prefixed.append(name);
+                        full = prefixed;
+                    }
+
+                    if (seen.insert(std::string(full)).second)
+                        callback(full);
+                }, threads);
+                if (result == Result::io_error)
+                    return result;
+            }
+
+            trace.finish(matched);
+            return matched ? Result::ok : Result::not_found;
+        }
+
+        Result walk(std::string_view path,
+            std::initializer_list<std::string_view> extensions,
+            const EnumerateRef& callback,
+            size_t threads = 1) const
+        {
+            std::vector<std::string_view> ext_list(extensions);
+            return walk(path, ext_list, callback, threads);
+        }
+
+        // Batched variants hand over up to `batch_size` names per call, so very large
+        // listings pay one callback per chunk instead of one per entry.
+        Result list_files_batched(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateBatchRef& callback,
+            size_t batch_size = 256,
+            bool allow_duplicates = false) const
+        {
+            detail::NameBatcher batcher(callback, batch_size);
+            Result result = list_files(path, extensions, [&](std::string_view name) { batcher.add(name); }, allow_duplicates);
+            batcher.flush();
+            return result;
+        }
+
+        Result list_dirs_batched(std::string_view path,
+            const EnumerateBatchRef& callback,
+            size_t batch_size = 256,
+            bool allow_duplicates = false) const
+        {
+            detail::NameBatcher batcher(callback, batch_size);
+            Result result = list_dirs(path, [&](std::string_view name) { batcher.add(name); }, allow_duplicates);
+            batcher.flush();
+            return result;
+        }
+
+        Result walk_batched(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateBatchRef& callback,
+            size_t batch_size = 256,
+            size_t threads = 1) const
+        {
+            detail::NameBatcher batcher(callback, batch_size);
+            Result result = walk(path, extensions, [&](std::string_view name) { batcher.add(name); }, threads);
+            batcher.flush();
+            return result;
+        }
+
+    private:
+        struct MountPoint
+        {
+            std::string mount;
+            std::shared_ptr<Backend> backend;
+            // Set while watching; shared by every table holding this mount.
+            std::shared_ptr<BackendWatch> watch;
+#if TINYVFS_ENABLE_STATS
+            // Shared by every table holding this mount, so counts survive republishing.
+            std::shared_ptr<detail::MountCounters> counters;
+#endif
+        };
+
+        // Keys view the strings in `paths`, which a deque never relocates. Each key is the
+        // virtual path; the backend-relative path is its suffix past the mount prefix.
+        // The built map is immutable once published. Files created later through
+        // write_file, or changed on disk as reported by poll_changes, go to a small
+        // locked side table that readers only consult after the first such change.
+        struct Index
+        {
+            struct Entry
+            {
+                size_t mount;
+                size_t relative_offset;
+            };
+
+            struct Hit
+            {
+                size_t mount;
+                std::string_view relative;
+            };
+
+            // Mount index of a written-table entry whose file is gone.
+            static constexpr size_t removed = static_cast<size_t>(-1);
+
+            // A directory scanned while building, with its mtime just before the scan.
+            struct Dir
+            {
+                size_t mount;
+                std::string path;
+                std::int64_t mtime_ns;
+            };
+
+            std::deque<std::string> paths;
+            std::unordered_map<std::string_view, Entry> entries;
+            std::vector<Dir> dirs;
+            // Virtual path of each scanned directory to the highest mount holding it, so
+            // stat() of a path the index lacks needs no backend probes.
+            std::unordered_map<std::string_view, size_t> dir_mounts;
+
+            // Set for an index loaded by load_index(): built entries are then the sorted
+            // records inside the mapped snapshot instead of `entries`.
+            FileView snapshot;
+            const std::byte* records = nullptr;
+            size_t record_count = 0;
+            const char* strings = nullptr;
+
+            mutable std::mutex written_mutex;
+            mutable std::unordered_map<std::string, Entry> written;
+            mutable std::atomic<bool> has_written{false};
+
+            bool contains(std::string_view path) const
+            {
+                Hit hit;
+                return find(path, hit);
+            }
+
+            bool find(std::string_view path, Hit& hit) const
+            {
+                if (has_written.load(std::memory_order_acquire))
+                {
+                    std::lock_guard<std::mutex> lock(written_mutex);
+                    auto found = written.find(std::string(path));
+                    if (found != written.end())
+                    {
+                        if (found->second.mount == removed)
+                            return false;
+                        // Nodes are never erased, so the key outlives the lock.
+                        hit = Hit{found->second.mount, std::string_view(found->first).substr(found->second.relative_offset)};
+                        return true;
+                    }
+                }
+
+                std::string_view key;
+                Entry entry;
+                if (!find_built(path, key, entry))
+                    return false;
+                hit = Hit{entry.mount, key.substr(entry.relative_offset)};
+                return true;
+            }
+
+            bool find_built(std::string_view path, std::string_view& key, Entry& entry) const
+            {
+                if (!records)
+                {
+                    auto found = entries.find(path);
+                    if (found == entries.end())
+                        return false;
+                    key = found->first;
+                    entry = found->second;
+                    return true;
+                }
+
+                const std::uint64_t hash = detail::hash_path(path);
+                size_t low = 0;
+                size_t high = record_count;
+                while (low < high)
+                {
+                    size_t mid = low + (high - low) / 2;
+                    if (detail::load_le64(record(mid)) < hash)
+                        low = mid + 1;
+                    else
+                        high = mid;
+                }
+                for (; low < record_count && detail::load_le64(record(low)) == hash; ++low)
+                {
+                    std::string_view name = record_name(low);
+                    if (name == path)
+                    {
+                        key = name;
+                        entry = Entry{detail::load_le32(record(low) + 32), detail::load_le32(record(low) + 36)};
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            const std::byte* record(size_t i) const noexcept
+            {
+                return records + i * index_snapshot::entry_size;
+            }
+
+            std::string_view record_name(size_t i) const noexcept
+            {
+                return std::string_view(strings + detail::load_le32(record(i) + 24), detail::load_le32(record(i) + 28));
+            }
+
+            bool find_dir(std::string_view path, size_t& mount) const
+            {
+                auto found = dir_mounts.find(path);
+                if (found == dir_mounts.end())
+                    return false;
+                mount = found->second;
+                return true;
+            }
+
+            // Used while building, before the index is shared; the highest mount wins.
+            void add_dir(std::string_view path, size_t mount)
+            {
+                auto found = dir_mounts.find(path);
+                if (found == dir_mounts.end())
+                    dir_mounts.emplace(paths.emplace_back(path), mount);
+                else if (found->second < mount)
+                    found->second = mount;
+            }
+
+            // Used while building, before the index is shared; the first mount wins.
+            void add(std::string_view path, size_t mount, size_t relative_offset)
+            {
+                if (entries.find(path) != entries.end())
+                    return;
+
+                const std::string& key = paths.emplace_back(path);
+                entries.emplace(key, Entry{mount, relative_offset});
+            }
+
+            // A written file wins unless it is already served by a higher-priority mount.
+            void add_written(std::string_view path, size_t mount, size_t relative_offset) const
+            {
+                std::lock_guard<std::mutex> lock(written_mutex);
+                auto found = written.find(std::string(path));
+                if (found != written.end())
+                {
+                    if (found->second.mount == removed || found->second.mount <= mount)
+                        found->second = Entry{mount, relative_offset};
+                }
+                else
+                {
+                    std::string_view key;
+                    Entry built;
+                    if (find_built(path, key, built) && built.mount > mount)
+                        return;
+                    written.emplace(std::string(path), Entry{mount, relative_offset});
+                }
+                has_written.store(true, std::memory_order_release);
+            }
+
+            // Records the mount found to serve `path` after a change, or `removed`.
+            void set_written(std::string_view path, size_t mount, size_t relative_offset) const
+            {
+                std::lock_guard<std::mutex> lock(written_mutex);
+                written.insert_or_assign(std::string(path), Entry{mount, relative_offset});
+                has_written.store(true, std::memory_order_release);
+            }
+        };
+
+        // stat() results keyed by normalized virtual path; nullopt records a miss. Keyed
+        // by path hash so lookups do not allocate, and split into independently locked
+        // shards so threads probing different paths rarely share a mutex. A path whose
+        // hash is taken by another is simply not cached, and a shard is emptied once it
+        // holds its share of `capacity`. As in MissCache, every erase or clear starts a
+        // new generation of the affected shard and insert() drops results observed in an
+        // older one, so a stat that raced a write cannot cache the old answer.
+        class StatCache
+        {
+        public:
+            explicit StatCache(size_t capacity)
+                : capacity_(capacity)
+                , shard_capacity_(std::max<size_t>(capacity / shard_count, 1))
+            {
+            }
+
+            size_t capacity() const { return capacity_; }
+
+            bool find(std::string_view path, std::optional<FileStat>& out, std::uint64_t& generation) const
+            {
+                const std::uint64_t key = detail::hash_path(path);
+                Shard& shard = shard_for(key);
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                generation = shard.generation;
+                auto it = shard.entries.find(key);
+                if (it == shard.entries.end() || it->second.path != path)
+                    return false;
+                out = it->second.stat;
+                return true;
+            }
+
+            void insert(std::string_view path, const std::optional<FileStat>& stat, std::uint64_t generation)
+            {
+                const std::uint64_t key = detail::hash_path(path);
+                Shard& shard = shard_for(key);
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                if (generation != shard.generation)
+                    return;
+                auto it = shard.entries.find(key);
+                if (it != shard.entries.end())
+                {
+                    if (it->second.path == path)
+                        it->second.stat = stat;
+                    return;
+                }
+                if (shard.entries.size() >= shard_capacity_)
+                    shard.entries.clear();
+                shard.entries.emplace(key, Entry{std::string(path), stat});
+            }
+
+            void erase(std::string_view path)
+            {
+                const std::uint64_t key = detail::hash_path(path);
+                Shard& shard = shard_for(key);
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                ++shard.generation;
+                auto it = shard.entries.find(key);
+                if (it != shard.entries.end() && it->second.path == path)
+                    shard.entries.erase(it);
+            }
+
+            // Also drops every parent directory, which may have appeared or vanished
+            // along with the file.
+            void erase_with_parents(std::string_view path)
+            {
+                for (std::string_view dir = path;;)
+                {
+                    erase(dir);
+                    size_t slash = dir.rfind('/');
+                    if (slash == std::string_view::npos)
+                        break;
+                    dir = dir.substr(0, slash);
+                }
+            }
+
+            void clear()
+            {
+                for (Shard& shard : shards_)
+                {
+                    std::lock_guard<std::mutex> lock(shard.mutex);
+                    ++shard.generation;
+                    shard.entries.clear();
+                }
+            }
+
+        private:
+            static constexpr size_t shard_count = 16;
+
+            struct Entry
+            {
+                std::string path;
+                std::optional<FileStat> stat;
+            };
+
+            struct alignas(64) Shard
+            {
+                std::mutex mutex;
+                std::unordered_map<std::uint64_t, Entry> entries;
+                std::uint64_t generation = 0;
+            };
+
+            const size_t capacity_;
+            const size_t shard_capacity_;
+            mutable std::array<Shard, shard_count> shards_;
+
+            // High bits pick the shard; the map buckets on the low ones.
+            Shard& shard_for(std::uint64_t key) const noexcept
+            {
+                return shards_[(key >> 32) % shard_count];
+            }
+        };
+
+        // Normalized paths no mount has as a file. Keyed by path hash so lookups do not
+        // allocate; a path whose hash is taken by another is simply not cached. Split
+        // into independently locked shards like StatCache, and a shard is emptied once it
+        // holds its share of `capacity`. Every erase or clear starts a new generation of
+        // the affected shard, and insert() drops misses observed in an older one, so a
+        // lookup that raced a write cannot record the written file as missing.
+        class MissCache
+        {
+        public:
+            explicit MissCache(size_t capacity)
+                : capacity_(capacity)
+                , shard_capacity_(std::max<size_t>(capacity / shard_count, 1))
+            {
+            }
+
+            size_t capacity() const { return capacity_; }
+
+            bool contains(std::string_view path) const
+            {
+                std::uint64_t generation = 0;
+                return contains(path, generation);
+            }
+
+            bool contains(std::string_view path, std::uint64_t& generation) const
+            {
+                const std::uint64_t key = detail::hash_path(path);
+                Shard& shard = shard_for(key);
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                generation = shard.generation;
+                auto it = shard.entries.find(key);
+                return it != shard.entries.end() && it->second == path;
+            }
+
+            void insert(std::string_view path, std::uint64_t generation)
+            {
+                const std::uint64_t key = detail::hash_path(path);
+                Shard& shard = shard_for(key);
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                if (generation != shard.generation)
+                    return;
+                if (shard.entries.size() >= shard_capacity_)
+                    shard.entries.clear();
+                shard.entries.emplace(key, std::string(path));
+            }
+
+            void erase(std::string_view path)
+            {
+                const std::uint64_t key = detail::hash_path(path);
+                Shard& shard = shard_for(key);
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                ++shard.generation;
+                auto it = shard.entries.find(key);
+                if (it != shard.entries.end() && it->second == path)
+                    shard.entries.erase(it);
+            }
+
+            void clear()
+            {
+                for (Shard& shard : shards_)
+                {
+                    std::lock_guard<std::mutex> lock(shard.mutex);
+                    ++shard.generation;
+                    shard.entries.clear();
+                }
+            }
+
+            size_t size() const
+            {
+                size_t total = 0;
+                for (Shard& shard : shards_)
+                {
+                    std::lock_guard<std::mutex> lock(shard.mutex);
+                    total += shard.entries.size();
+                }
+                return total;
+            }
+
+        private:
+            static constexpr size_t shard_count = 16;
+
+            struct alignas(64) Shard
+            {
+                std::mutex mutex;
+                std::unordered_map<std::uint64_t, std::string> entries;
+                std::uint64_t generation = 0;
+            };
+
+            const size_t capacity_;
+            const size_t shard_capacity_;
+            mutable std::array<Shard, shard_count> shards_;
+
+            // High bits pick the shard; the map buckets on the low ones.
+            Shard& shard_for(std::uint64_t key) const noexcept
+            {
+                return shards_[(key >> 32) % shard_count];
+            }
+        };
+
+        // One published state of the mount stack. Never modified after publication,
+        // apart from the internally locked index write table, stat cache and miss cache.
+        //
+        // Mount roots are also arranged in a trie of path components so lookups only
+        // visit mounts whose prefix matches. Node keys view the mount strings, so a copy
+        // drops the trie and store_table() rebuilds it for the copy's own strings.
+        struct MountTable
+        {
+            static constexpr size_t no_node = static_cast<size_t>(-1);
+
+            struct Node
+            {
+                std::unordered_map<std::string_view, size_t> children;
+                // Mount indices rooted at this node, in mount order.
+                std::vector<size_t> mounts;
+            };
+
+            struct Match
+            {
+                const MountPoint* mount;
+                size_t index;
+                std::string_view relative;
+            };
+
+            // Matches for one lookup; stays on the stack for ordinary mount depths.
+            class Matches
+            {
+            public:
+                void clear() noexcept
+                {
+                    count_ = 0;
+                    overflow_.clear();
+                }
+
+                void push_back(const Match& match)
+                {
+                    if (count_ < inline_capacity)
+                    {
+                        inline_[count_++] = match;
+                        return;
+                    }
+                    if (overflow_.empty())
+                        overflow_.assign(inline_, inline_ + inline_capacity);
+                    overflow_.push_back(match);
+                    ++count_;
+                }
+
+                Match* begin() noexcept { return count_ <= inline_capacity ? inline_ : overflow_.data(); }
+                Match* end() noexcept { return begin() + count_; }
+                const Match* begin() const noexcept { return count_ <= inline_capacity ? inline_ : overflow_.data(); }
+                const Match* end() const noexcept { return begin() + count_; }
+                size_t size() const noexcept { return count_; }
+
+            private:
+                static constexpr size_t inline_capacity = 16;
+                Match inline_[inline_capacity];
+                std::vector<Match> overflow_;
+                size_t count_ = 0;
+            };
+
+            std::vector<MountPoint> mounts;
+            std::shared_ptr<const Index> index;
+            std::shared_ptr<StatCache> stats;
+            std::shared_ptr<MissCache> misses;
+#if TINYVFS_ENABLE_STATS
+            std::shared_ptr<const TraceHooks> hooks;
+#endif
+            std::vector<Node> nodes;
+
+            MountTable() = default;
+            // Only for Vfs::copy_table(), which drops the copied trie.
+            MountTable(const MountTable&) = default;
+            MountTable& operator=(const MountTable&) = delete;
+
+            void build_trie()
+            {
+                nodes.assign(1, Node());
+                for (size_t i = 0; i < mounts.size(); ++i)
+                {
+                    std::string_view rest = mounts[i].mount;
+                    size_t node = 0;
+                    while (!rest.empty())
+                    {
+                        size_t split = rest.find('/');
+                        std::string_view part = rest.substr(0, split);
+                        rest = split == std::string_view::npos ? std::string_view() : rest.substr(split + 1);
+
+                        auto found = nodes[node].children.find(part);
+                        if (found != nodes[node].children.end())
+                        {
+                            node = found->second;
+                            continue;
+                        }
+
+                        size_t child = nodes.size();
+                        nodes.emplace_back();
+                        nodes[node].children.emplace(part, child);
+                        node = child;
+                    }
+                    nodes[node].mounts.push_back(i);
+                }
+            }
+
+            size_t find_node(std::string_view path) const
+            {
+                size_t node = 0;
+                while (!path.empty())
+                {
+                    size_t split = path.find('/');
+                    auto found = nodes[node].children.find(path.substr(0, split));
+                    if (found == nodes[node].children.end())
+                        return no_node;
+                    node = found->second;
+                    path = split == std::string_view::npos ? std::string_view() : path.substr(split + 1);
+                }
+                return node;
+            }
+
+            // Mounts whose root covers `path`, highest priority first, with the path
+            // relative to each mount root.
+            void match(std::string_view path, Matches& out) const
+            {
+                out.clear();
+                size_t node = 0;
+                std::string_view rest = path;
+                for (;;)
+                {
+                    for (size_t mount : nodes[node].mounts)
+                        out.push_back(Match{&mounts[mount], mount, rest});
+                    if (rest.empty())
+                        break;
+
+                    size_t split = rest.find('/');
+                    auto found = nodes[node].children.find(rest.substr(0, split));
+                    if (found == nodes[node].children.end())
+                        break;
+                    node = found->second;
+                    rest = split == std::string_view::npos ? std::string_view() : rest.substr(split + 1);
+                }
+
+                std::sort(out.begin(), out.end(), [](const Match& a, const Match& b)
+                {
+                    return a.index > b.index;
+                });
+            }
+
+            // Mounts rooted strictly below `path`, with their root relative to `path`.
+            template <typename Fn>
+            void for_each_below(std::string_view path, Fn&& fn) const
+            {
+                size_t start = find_node(path);
+                if (start == no_node)
+                    return;
+
+                const size_t skip = path.empty() ? 0 : path.size() + 1;
+                std::vector<size_t> pending;
+                for (const auto& child : nodes[start].children)
+                    pending.push_back(child.second);
+
+                while (!pending.empty())
+                {
+                    size_t node = pending.back();
+                    pending.pop_back();
+                    for (size_t mount : nodes[node].mounts)
+                        fn(mount, std::string_view(mounts[mount].mount).substr(skip));
+                    for (const auto& child : nodes[node].children)
+                        pending.push_back(child.second);
+                }
+            }
+        };
+
+        // Serializes mount table updates; readers never take it.
+        std::mutex write_mutex_;
+        // Guarded by write_mutex_.
+        bool watching_ = false;
+        // One poll_changes() at a time, since a BackendWatch is single-threaded.
+        std::mutex poll_mutex_;
+        // The published table for one call. The reader announces it in a hazard slot and
+        // re-checks that it is still current, so a writer cannot free it meanwhile. Only
+        // when every slot is taken does it fall back to copying the owning shared_ptr,
+        // which may lock inside the standard library.
+        class TableRef
+        {
+        public:
+            explicit TableRef(const Vfs& vfs)
+                : vfs_(vfs)
+            {
+                for (;;)
+                {
+                    const MountTable* table = vfs.current_.load(std::memory_order_seq_cst);
+                    slot_ = vfs.hazards_.acquire(table);
+                    if (slot_ == detail::HazardSlots::count)
+                    {
+                        fallback_ = vfs.load_owner();
+                        table_ = fallback_.get();
+                        return;
+                    }
+                    if (vfs.current_.load(std::memory_order_seq_cst) == table)
+                    {
+                        table_ = table;
+                        return;
+                    }
+                    vfs.hazards_.release(slot_);
+                }
+            }
+
+            ~TableRef()
+            {
+                if (slot_ != detail::HazardSlots::count)
+                    vfs_.hazards_.release(slot_);
+            }
+
+            TableRef(const TableRef&) = delete;
+            TableRef& operator=(const TableRef&) = delete;
+
+            const MountTable* operator->() const noexcept { return table_; }
+            const MountTable& operator*() const noexcept { return *table_; }
+
+        private:
+            const Vfs& vfs_;
+            const MountTable* table_ = nullptr;
+            size_t slot_ = detail::HazardSlots::count;
+            std::shared_ptr<const MountTable> fallback_;
+        };
+
+        mutable detail::HazardSlots hazards_;
+        std::atomic<const MountTable*> current_{nullptr};
+        // Replaced tables that a hazard slot still announced; guarded by write_mutex_ and
+        // freed by a later store_table() once no reader uses them.
+        std::vector<std::shared_ptr<const MountTable>> retired_;
+
+        TableRef load_table() const { return TableRef(*this); }
+
+        void store_table(std::shared_ptr<MountTable> table)
+        {
+            table->build_trie();
+            std::shared_ptr<const MountTable> next(std::move(table));
+            if (auto previous = load_owner())
+                retired_.push_back(std::move(previous));
+            store_owner(next);
+            current_.store(next.get(), std::memory_order_seq_cst);
+
+            retired_.erase(std::remove_if(retired_.begin(), retired_.end(), [this](const auto& old)
+            {
+                return !hazards_.protects(old.get());
+            }), retired_.end());
+        }
+
+        // Owns the published table; readers only touch it on the fallback path.
+#if defined(__cpp_lib_atomic_shared_ptr)
+        std::atomic<std::shared_ptr<const MountTable>> table_;
+
+        std::shared_ptr<const MountTable> load_owner() const { return table_.load(std::memory_order_acquire); }
+        void store_owner(std::shared_ptr<const MountTable> table) { table_.store(std::move(table), std::memory_order_release); }
+#else
+        std::shared_ptr<const MountTable> table_;
+
+        std::shared_ptr<const MountTable> load_owner() const { return std::atomic_load_explicit(&table_, std::memory_order_acquire); }
+        void store_owner(std::shared_ptr<const MountTable> table)
+        {
+            std::atomic_store_explicit(&table_, std::move(table), std::memory_order_release);
+        }
+#endif
+
+        // The current table with every field carried over, for a publisher to change only
+        // what it means to. The trie's keys would view the old table's mount strings, so
+        // it is dropped here and rebuilt by store_table().
+        static std::shared_ptr<MountTable> copy_table(const MountTable& current)
+        {
+            auto next = std::make_shared<MountTable>(current);
+            next->nodes.clear();
+            return next;
+        }
+
+        // Fresh, empty caches of the same capacity, for when the mount stack changes.
+        static void reset_caches(MountTable& next)
+        {
+            if (next.stats)
+                next.stats = std::make_shared<StatCache>(next.stats->capacity());
+            if (next.misses)
+                next.misses = std::make_shared<MissCache>(next.misses->capacity());
+        }
+
+#if TINYVFS_ENABLE_STATS
+        mutable detail::VfsCounters counters_;
+
+        // Times one public operation and feeds the counters and trace hooks. An
+        // operation that never reaches finish() is reported as not found.
+        class OpTrace
+        {
+        public:
+            using Clock = std::chrono::steady_clock;
+            using TimePoint = Clock::time_point;
+
+            OpTrace(const Vfs& vfs, const MountTable& table, TraceOp op, std::string_view path)
+                : counters_(vfs.counters_)
+                , hooks_(table.hooks.get())
+                , op_(op)
+                , path_(path)
+                , start_(Clock::now())
+            {
+                if (hooks_ && hooks_->begin)
+                    hooks_->begin(op_, path_);
+            }
+
+            OpTrace(const OpTrace&) = delete;
+            OpTrace& operator=(const OpTrace&) = delete;
+
+            ~OpTrace()
+            {
+                if (!finished_)
+                    finish(false);
+            }
+
+            void normalized()
+            {
+                counters_.normalize_ns.fetch_add(elapsed_ns(start_), std::memory_order_relaxed);
+            }
+
+            TimePoint probe_begin() const { return Clock::now(); }
+
+            void probe_end(const MountPoint& mount, TimePoint begin, bool hit, std::uint64_t bytes = 0)
+            {
+                ++probes_;
+                detail::MountCounters& counters = *mount.counters;
+                (hit ? counters.hits : counters.misses).fetch_add(1, std::memory_order_relaxed);
+                if (bytes != 0)
+                    counters.bytes_read.fetch_add(bytes, std::memory_order_relaxed);
+                counters.backend_ns.fetch_add(elapsed_ns(begin), std::memory_order_relaxed);
+            }
+
+            void finish(bool found, std::uint64_t bytes = 0)
+            {
+                finished_ = true;
+                const std::uint64_t duration = elapsed_ns(start_);
+                counters_.latency[static_cast<size_t>(op_)].record(duration);
+                if (found && probes_ > 0)
+                {
+                    const size_t slot = std::min(probes_, counters_.probes.size()) - 1;
+                    counters_.probes[slot].fetch_add(1, std::memory_order_relaxed);
+                }
+                if (hooks_ && hooks_->end)
+                    hooks_->end(TraceEvent{op_, path_, found, bytes, probes_, duration});
+            }
+
+        private:
+            static std::uint64_t elapsed_ns(TimePoint since)
+            {
+                return static_cast<std::uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - since).count());
+            }
+
+            detail::VfsCounters& counters_;
+            const TraceHooks* hooks_;
+            TraceOp op_;
+            std::string_view path_;
+            TimePoint start_;
+            size_t probes_ = 0;
+            bool finished_ = false;
+        };
+#else
+        // Stand-in with the same surface; every call compiles to nothing.
+        struct OpTrace
+        {
+            struct TimePoint
+            {
+            };
+
+            OpTrace(const Vfs&, const MountTable&, TraceOp, std::string_view) {}
+
+            void normalized() {}
+            TimePoint probe_begin() const { return TimePoint(); }
+            void probe_end(const MountPoint&, TimePoint, bool, std::uint64_t = 0) {}
+            void finish(bool, std::uint64_t = 0) {}
+        };
+#endif
+
+        // Mounts are visited from the highest priority down, so the first entry
+        // recorded for a virtual path is the one a mount walk would have returned.
+        static bool index_backend(const MountTable& table, Index& index, size_t mount_index, const std::string& relative_dir)
+        {
+            const MountPoint& mount = table.mounts[mount_index];
+            const size_t relative_offset = mount.mount.empty() ? 0 : mount.mount.size() + 1;
+            // Taken before listing, so a change during the scan fails a later check.
+            const std::int64_t mtime_ns = directory_mtime(*mount.backend, relative_dir);
+
+            std::vector<std::string> files;
+            Result result = mount.backend->list_files(
+                relative_dir,
+                {},
+                [&](std::string_view name)
+                {
+                    files.emplace_back(name);
+                },
+                true);
+            if (result == Result::io_error)
+                return false;
+            if (result != Result::ok)
+                return true;
+            index.dirs.push_back(Index::Dir{mount_index, relative_dir, mtime_ns});
+            index.add_dir(virtual_dir(mount, relative_dir), mount_index);
+
+            std::string path;
+            for (const auto& name : files)
+            {
+                path = mount.mount;
+                if (!path.empty())
+                    path.push_back('/');
+                if (!relative_dir.empty())
+                {
+                    path += relative_dir;
+                    path.push_back('/');
+                }
+                path += name;
+                index.add(path, mount_index, relative_offset);
+            }
+
+            std::vector<std::string> dirs;
+            result = mount.backend->list_dirs(
+                relative_dir,
+                [&](std::string_view name)
+                {
+                    dirs.emplace_back(name);
+                },
+                true);
+            if (result == Result::io_error)
+                return false;
+
+            for (const auto& name : dirs)
+            {
+                std::string child = relative_dir;
+                if (!child.empty())
+                    child.push_back('/');
+                child += name;
+                if (!index_backend(table, index, mount_index, child))
+                    return false;
+            }
+
+            return true;
+        }
+
+        static std::string virtual_dir(const MountPoint& mount, std::string_view relative_dir)
+        {
+            std::string path = mount.mount;
+            if (!path.empty() && !relative_dir.empty())
+                path.push_back('/');
+            path += relative_dir;
+            return path;
+        }
+
+        // -1 when the backend cannot stat the directory, so it compares equal to itself.
+        static std::int64_t directory_mtime(Backend& backend, std::string_view relative_dir)
+        {
+            auto status = backend.stat(relative_dir);
+            return status && status->type == FileType::directory ? status->mtime_ns : -1;
+        }
+
+        static size_t relative_offset(const MountTable& table, size_t mount_index)
+        {
+            const std::string& mount = table.mounts[mount_index].mount;
+            return mount.empty() ? 0 : mount.size() + 1;
+        }
+
+        static void index_written(const MountTable& table, std::string_view normalized, size_t mount_index)
+        {
+            if (!table.index)
+                return;
+
+            table.index->add_written(normalized, mount_index, relative_offset(table, mount_index));
+        }
+
+        // Updates the caches and index for one file that changed in `mount_index`, and
+        // reports the change as the whole mount stack sees it.
+        static void apply_change(const MountTable& table,
+            size_t mount_index,
+            ChangeKind kind,
+            std::string_view path,
+            MountTable::Matches& matches,
+            const ChangeFn& callback)
+        {
+            if (table.stats)
+                table.stats->erase_with_parents(path);
+            if (table.misses)
+                table.misses->erase(path);
+
+            // Matches run from the highest priority down, so the first lower mount that
+            // has the file is the one that serves it once this mount's copy is gone.
+            size_t below = Index::removed;
+            table.match(path, matches);
+            for (const auto& match : matches)
+            {
+                if (match.index == mount_index)
+                {
+                    if (kind == ChangeKind::modified)
+                        break;
+                    continue;
+                }
+                if (!match.mount->backend->exists_file(match.relative))
+                    continue;
+                if (match.index > mount_index)
+                    return;
+                below = match.index;
+                break;
+            }
+
+            if (table.index)
+            {
+                if (kind != ChangeKind::removed)
+                    table.index->set_written(path, mount_index, relative_offset(table, mount_index));
+                else
+                    table.index->set_written(path, below, below == Index::removed ? 0 : relative_offset(table, below));
+            }
+
+            if (kind != ChangeKind::modified && below != Index::removed)
+                kind = ChangeKind::modified;
+            callback(kind, path);
+        }
+
+        static std::optional<FileStat> stat_mounts(const MountTable& table, std::string_view normalized)
+        {
+            if (table.index)
+            {
+                Index::Hit hit;
+                if (table.index->find(normalized, hit))
+                {
+                    if (auto result = table.mounts[hit.mount].backend->stat(hit.relative))
+                        return result;
+                }
+
+                size_t mount = 0;
+                if (table.index->find_dir(normalized, mount))
+                {
+                    const size_t offset = relative_offset(table, mount);
+                    std::string_view relative = normalized.size() > offset ? normalized.substr(offset) : std::string_view();
+                    auto result = table.mounts[mount].backend->stat(relative);
+                    if (result && result->type == FileType::directory)
+                        return result;
+                }
+            }
+
+            // The index is authoritative for files and scanned directories, so the mounts
+            // are only asked for directories created since, through writes or changes
+            // seen by poll_changes().
+            if (!table.index || table.index->has_written.load(std::memory_order_acquire))
+            {
+                MountTable::Matches matches;
+                table.match(normalized, matches);
+                for (const auto& match : matches)
+                {
+                    auto result = match.mount->backend->stat(match.relative);
+                    if (result && (!table.index || result->type == FileType::directory))
+                        return result;
+                }
+            }
+
+            if (table.find_node(normalized) != MountTable::no_node && !table.mounts.empty())
+            {
+                FileStat result;
+                result.type = FileType::directory;
+                return result;
+            }
+
+            return std::nullopt;
+        }
+
+        // ~Vfs() drains all of these before any member is destroyed. Callers work on
+        // copies, so a pool or scheduler replaced meanwhile stays alive until their call
+        // returns, and pool_mutex_ is never held while waiting. Replaced ones are kept
+        // until they are idle and can be joined off their own workers.
+        mutable std::mutex pool_mutex_;
+        mutable std::shared_ptr<IoPool> pool_;
+        mutable std::shared_ptr<IoScheduler> scheduler_;
+        mutable std::vector<std::shared_ptr<IoPool>> retired_pools_;
+        mutable std::vector<std::shared_ptr<IoScheduler>> retired_schedulers_;
+
+        std::shared_ptr<IoPool> io_pool() const
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex_);
+            if (!pool_)
+                pool_ = std::make_shared<IoPool>();
+            return pool_;
+        }
+
+        // Moves retired pools that are idle and not running this thread into `done`, for
+        // the caller to join once pool_mutex_ is released. Needs pool_mutex_.
+        template <typename Pool>
+        static void release_idle(std::vector<std::shared_ptr<Pool>>& retired, std::vector<std::shared_ptr<Pool>>& done)
+        {
+            for (auto it = retired.begin(); it != retired.end();)
+            {
+                if (!(*it)->on_worker() && (*it)->idle())
+                {
+                    done.push_back(std::move(*it));
+                    it = retired.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+
+        // Waits for every retired pool and joins it here. One running this thread cannot
+        // be joined by it and stays retired.
+        template <typename Pool>
+        void drain_retired(std::vector<std::shared_ptr<Pool>>& retired) const
+        {
+            std::vector<std::shared_ptr<Pool>> pools;
+            {
+                std::lock_guard<std::mutex> lock(pool_mutex_);
+                pools.swap(retired);
+            }
+            std::vector<std::shared_ptr<Pool>> kept;
+            for (auto& pool : pools)
+            {
+                if (pool->on_worker())
+                    kept.push_back(std::move(pool));
+                else
+                    pool->wait_idle();
+            }
+            pools.clear();
+            if (!kept.empty())
+            {
+                std::lock_guard<std::mutex> lock(pool_mutex_);
+                for (auto& pool : kept)
+                    retired.push_back(std::move(pool));
+            }
+        }
+    };
+
+    namespace detail
+    {
+        // The backend a static layer calls: held by value, or through a smart pointer for
+        // backends that cannot be moved or are only handed out shared, like PackBackend.
+        template <typename B>
+        B* static_target(B& backend) noexcept { return &backend; }
+
+        template <typename B>
+        B* static_target(std::shared_ptr<B>& backend) noexcept { return backend.get(); }
+
+        template <typename B>
+        B* static_target(std::unique_ptr<B>& backend) noexcept { return backend.get(); }
+    }
+
+    // SubtreeBackend for StaticVfs: the wrapped backend's type is known, so with a final
+    // class such as DiskBackend the calls are direct and the join inlines into the caller.
+    template <typename Inner>
+    class StaticSubtree
+    {
+    public:
+        StaticSubtree(Inner inner, fs::path base)
+            : inner_(std::move(inner))
+            , base_(std::move(base).lexically_normal())
+            , base_text_(base_.generic_string())
+        {
+        }
+
+        bool exists_file(std::string_view path)
+        {
+            detail::PathBuffer buffer;
+            return target().exists_file(map(path, buffer));
+        }
+
+        bool exists_dir(std::string_view path)
+        {
+            detail::PathBuffer buffer;
+            return target().exists_dir(map(path, buffer));
+        }
+
+        std::optional<FileStat> stat(std::string_view path)
+        {
+            detail::PathBuffer buffer;
+            return target().stat(map(path, buffer));
+        }
+
+        std::optional<Blob> read_file(std::string_view path)
+        {
+            detail::PathBuffer buffer;
+            return target().read_file(map(path, buffer));
+        }
+
+        std::optional<FileView> map_file(std::string_view path)
+        {
+            detail::PathBuffer buffer;
+            return target().map_file(map(path, buffer));
+        }
+
+        std::unique_ptr<FileHandle> open_file(std::string_view path)
+        {
+            detail::PathBuffer buffer;
+            return target().open_file(map(path, buffer));
+        }
+
+        Result write_file_gather(std::string_view path,
+            const WriteChunk* chunks,
+            size_t count,
+            const WriteOptions& options)
+        {
+            detail::PathBuffer buffer;
+            return target().write_file_gather(map(path, buffer), chunks, count, options);
+        }
+
+        Result list_files(std::string_view path,
             const std::vector<std::string_view>& extensions,
-            const EnumerateFn& callback,
-            bool allow_duplicates) override
+            const EnumerateRef& callback,
+            bool allow_duplicates)
         {
-            return backend_->list_files(map(path), extensions, callback, allow_duplicates);
+            detail::PathBuffer buffer;
+            return target().list_files(map(path, buffer), extensions, callback, allow_duplicates);
         }
 
         Result list_dirs(std::string_view path,
-            const EnumerateFn& callback,
-            bool allow_duplicates) override
+            const EnumerateRef& callback,
+            bool allow_duplicates)
+        {
+            detail::PathBuffer buffer;
+            return target().list_dirs(map(path, buffer), callback, allow_duplicates);
+        }
+
+        Result walk(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateRef& callback,
+            size_t threads)
         {
-            return backend_->list_dirs(map(path), callback, allow_duplicates);
+            detail::PathBuffer buffer;
+            return target().walk(map(path, buffer), extensions, callback, threads);
         }
 
+        // Null when a smart-pointer inner backend is empty.
+        auto* inner() noexcept { return detail::static_target(inner_); }
+
     private:
-        std::shared_ptr<Backend> backend_;
+        Inner inner_;
         fs::path base_;
+        std::string base_text_;
 
-        std::string map(std::string_view path) const
-        {
-            if (base_.empty())
-                return fs::path(path).lexically_normal().generic_string();
-            if (path.empty())
-                return base_.generic_string();
+        auto& target() noexcept { return *detail::static_target(inner_); }
 
-            fs::path combined = base_ / fs::path(path);
-            return combined.lexically_normal().generic_string();
+        std::string_view map(std::string_view path, detail::PathBuffer& out) const
+        {
+            return detail::map_subtree(base_, base_text_, path, out);
         }
     };
 
-    class Vfs final
+    // One layer of a StaticVfs: a backend, by value or smart pointer, under a virtual root.
+    template <typename B>
+    struct StaticMount
     {
-    public:
-        bool mount(std::string_view path, std::shared_ptr<Backend> backend)
-        {
-            if (!backend)
-                return false;
+        std::string root;
+        B backend;
+    };
 
-            std::string normalized;
-            if (!detail::normalize_virtual_path(path, normalized))
-                return false;
+    template <typename B>
+    StaticMount<std::decay_t<B>> static_mount(std::string_view root, B&& backend)
+    {
+        return StaticMount<std::decay_t<B>>{std::string(root), std::forward<B>(backend)};
+    }
 
-            mounts_.push_back(MountPoint{normalized, std::move(backend)});
-            return true;
-        }
+    // A disk directory mounted at `root`, as Vfs::mount_disk would.
+    inline StaticMount<StaticSubtree<DiskBackend>> static_disk(std::string_view root,
+        const fs::path& directory,
+        DiskBackendOptions options = DiskBackendOptions())
+    {
+        if (options.case_insensitive && options.fold_base.empty())
+            options.fold_base = directory;
+        return static_mount(root, StaticSubtree<DiskBackend>(DiskBackend(options), directory));
+    }
 
-        bool mount_disk(std::string_view path, const fs::path& root)
+    // Vfs with the mount layout fixed at compile time, for shipping builds. Each layer is
+    // called through its concrete type, with no virtual dispatch, refcounting or table
+    // lookup per operation; later layers shadow earlier ones, as later mounts do in Vfs.
+    // There are no caches, traces, index or watches. Calls are as thread-safe as the
+    // backends they reach.
+    template <typename... Layers>
+    class StaticVfs
+    {
+    public:
+        explicit StaticVfs(Layers... layers)
+            : layers_(std::move(layers)...)
         {
-            auto backend = std::make_shared<SubtreeBackend>(
-                std::make_shared<DiskBackend>(),
-                root);
-            return mount(path, backend);
+            valid_ = normalize_roots(std::index_sequence_for<Layers...>());
         }
 
-        bool unmount(std::string_view path)
-        {
-            std::string normalized;
-            if (!detail::normalize_virtual_path(path, normalized))
-                return false;
-
-            bool removed = false;
-            for (size_t i = 0; i < mounts_.size();)
-            {
-                if (mounts_[i].mount == normalized)
-                {
-                    mounts_.erase(mounts_.begin() + static_cast<std::ptrdiff_t>(i));
-                    removed = true;
-                }
-                else
-                {
-                    ++i;
-                }
-            }
+        // False when a root is not a valid virtual path or a smart-pointer backend is
+        // empty; such layers never match.
+        bool valid() const noexcept { return valid_; }
 
-            return removed;
-        }
+        template <size_t I>
+        auto& layer() noexcept { return std::get<I>(layers_); }
 
         bool exists_file(std::string_view path) const
         {
-            std::string normalized;
-            if (!detail::normalize_virtual_path(path, normalized))
-                return false;
-
-            for (auto it = mounts_.rbegin(); it != mounts_.rend(); ++it)
+            return probe(path, [](auto& backend, std::string_view relative)
             {
-                std::string relative;
-                if (!detail::relative_to_mount(normalized, it->mount, relative))
-                    continue;
-                if (it->backend->exists_file(relative))
-                    return true;
-            }
-
-            return false;
+                return backend.exists_file(relative);
+            });
         }
 
         bool exists_dir(std::string_view path) const
         {
-            std::string normalized;
-            if (!detail::normalize_virtual_path(path, normalized))
+            detail::PathBuffer buffer;
+            if (!detail::normalize_virtual_path(path, buffer))
                 return false;
-
-            if (normalized.empty())
-                return !mounts_.empty();
-
-            for (const auto& mount : mounts_)
+            std::string_view normalized = buffer.view();
+            if (above_root(normalized, std::index_sequence_for<Layers...>()))
+                return true;
+            return visit(normalized, [](auto& backend, std::string_view relative)
             {
-                if (mount.mount == normalized)
-                    return true;
-
-                if (mount.mount.size() > normalized.size() &&
-                    mount.mount.compare(0, normalized.size(), normalized) == 0 &&
-                    mount.mount[normalized.size()] == '/')
-                {
-                    return true;
-                }
-            }
+                return backend.exists_dir(relative);
+            });
+        }
 
-            for (auto it = mounts_.rbegin(); it != mounts_.rend(); ++it)
+        std::optional<FileStat> stat(std::string_view path) const
+        {
+            std::optional<FileStat> result;
+            probe(path, [&](auto& backend, std::string_view relative)
             {
-                std::string relative;
-                if (!detail::relative_to_mount(normalized, it->mount, relative))
-                    continue;
-                if (it->backend->exists_dir(relative))
-                    return true;
-            }
-
-            return false;
+                result = backend.stat(relative);
+                return result.has_value();
+            });
+            return result;
         }
 
         std::optional<Blob> read_file(std::string_view path) const
         {
-            std::string normalized;
-            if (!detail::normalize_virtual_path(path, normalized))
-                return std::nullopt;
-
-            for (auto it = mounts_.rbegin(); it != mounts_.rend(); ++it)
+            std::optional<Blob> result;
+            probe(path, [&](auto& backend, std::string_view relative)
             {
-                std::string relative;
-                if (!detail::relative_to_mount(normalized, it->mount, relative))
-                    continue;
-                if (auto data = it->backend->read_file(relative))
-                    return data;
-            }
-
-            return std::nullopt;
+                result = backend.read_file(relative);
+                return result.has_value();
+            });
+            return result;
         }
 
         std::optional<std::string> read_text(std::string_view path, bool append_null = false) const
@@ -542,139 +8551,362 @@ namespace tinyvfs
             return blob->to_string(append_null);
         }
 
-        Result write_file(std::string_view path, const void* data, size_t size) const
+        std::optional<FileView> map_file(std::string_view path) const
         {
-            std::string normalized;
-            if (!detail::normalize_virtual_path(path, normalized))
+            std::optional<FileView> result;
+            probe(path, [&](auto& backend, std::string_view relative)
+            {
+                result = backend.map_file(relative);
+                return result.has_value();
+            });
+            return result;
+        }
+
+        std::optional<File> open(std::string_view path) const
+        {
+            std::unique_ptr<FileHandle> handle;
+            probe(path, [&](auto& backend, std::string_view relative)
+            {
+                handle = backend.open_file(relative);
+                return handle != nullptr;
+            });
+            if (!handle)
+                return std::nullopt;
+            return File(std::move(handle));
+        }
+
+        Result write_file(std::string_view path,
+            const void* data,
+            size_t size,
+            const WriteOptions& options = WriteOptions()) const
+        {
+            WriteChunk chunk{data, size};
+            return write_file_gather(path, &chunk, 1, options);
+        }
+
+        // Same rules as Vfs: the newest layer that accepts the write takes it.
+        Result write_file_gather(std::string_view path,
+            const WriteChunk* chunks,
+            size_t count,
+            const WriteOptions& options = WriteOptions()) const
+        {
+            detail::PathBuffer buffer;
+            if (!detail::normalize_virtual_path(path, buffer))
                 return Result::invalid_path;
 
             bool matched = false;
             Result last_result = Result::not_supported;
-
-            for (auto it = mounts_.rbegin(); it != mounts_.rend(); ++it)
+            Result final_result = Result::not_supported;
+            const bool done = visit(buffer.view(), [&](auto& backend, std::string_view relative)
             {
-                std::string relative;
-                if (!detail::relative_to_mount(normalized, it->mount, relative))
-                    continue;
-
                 matched = true;
-                Result result = it->backend->write_file(relative, data, size);
+                Result result = backend.write_file_gather(relative, chunks, count, options);
                 if (result == Result::ok || result == Result::io_error)
-                    return result;
+                {
+                    final_result = result;
+                    return true;
+                }
                 if (result != Result::not_supported)
                     last_result = result;
-            }
-
-            if (!matched)
-                return Result::not_found;
-
-            return last_result;
+                return false;
+            });
+            if (done)
+                return final_result;
+            return matched ? last_result : Result::not_found;
         }
 
+        // Listings follow Vfs's overlay rules: a name several layers have is reported
+        // once unless `allow_duplicates`, and a single layer streams straight through.
         Result list_files(std::string_view path,
             const std::vector<std::string_view>& extensions,
-            const EnumerateFn& callback,
+            const EnumerateRef& callback,
             bool allow_duplicates = false) const
         {
-            std::string normalized;
-            if (!detail::normalize_virtual_path(path, normalized))
+            detail::PathBuffer buffer;
+            if (!detail::normalize_virtual_path(path, buffer))
                 return Result::invalid_path;
+            std::string_view normalized = buffer.view();
 
-            bool matched = false;
-            std::unordered_set<std::string> seen;
+            const size_t matches = count_matches(normalized);
+            if (matches == 0)
+                return Result::not_found;
 
+            std::unordered_set<std::string> seen;
             auto emit = [&](std::string_view name)
             {
-                if (allow_duplicates)
-                {
-                    callback(name);
-                    return;
-                }
-
                 if (seen.insert(std::string(name)).second)
                     callback(name);
             };
 
-            for (auto it = mounts_.rbegin(); it != mounts_.rend(); ++it)
+            Result failure = Result::ok;
+            visit(normalized, [&](auto& backend, std::string_view relative)
             {
-                std::string relative;
-                if (!detail::relative_to_mount(normalized, it->mount, relative))
-                    continue;
-
-                matched = true;
-                Result result = it->backend->list_files(
-                    relative,
-                    extensions,
-                    emit,
-                    true);
-                if (result == Result::io_error)
-                    return result;
-            }
-
-            return matched ? Result::ok : Result::not_found;
+                Result result = matches == 1 || allow_duplicates ?
+                    backend.list_files(relative, extensions, callback, allow_duplicates) :
+                    backend.list_files(relative, extensions, emit, true);
+                if (result != Result::io_error)
+                    return false;
+                failure = result;
+                return true;
+            });
+            return failure;
         }
 
         Result list_files(std::string_view path,
             std::initializer_list<std::string_view> extensions,
-            const EnumerateFn& callback,
+            const EnumerateRef& callback,
             bool allow_duplicates = false) const
         {
             std::vector<std::string_view> ext_list(extensions);
             return list_files(path, ext_list, callback, allow_duplicates);
         }
 
+        // Directories holding a layer root are listed whether or not a backend has them.
         Result list_dirs(std::string_view path,
-            const EnumerateFn& callback,
+            const EnumerateRef& callback,
             bool allow_duplicates = false) const
         {
-            std::string normalized;
-            if (!detail::normalize_virtual_path(path, normalized))
+            detail::PathBuffer buffer;
+            if (!detail::normalize_virtual_path(path, buffer))
                 return Result::invalid_path;
+            std::string_view normalized = buffer.view();
 
             std::unordered_set<std::string> seen;
-
             auto emit = [&](std::string_view name)
             {
-                if (allow_duplicates)
-                {
-                    callback(name);
-                    return;
-                }
-
                 if (seen.insert(std::string(name)).second)
                     callback(name);
             };
 
-            for (const auto& mount : mounts_)
+            size_t matches = 0;
+            bool nested = false;
+            each_layer([&](auto&, std::string_view root)
             {
-                std::string child;
-                if (detail::child_mount_name(normalized, mount.mount, child))
-                    emit(child);
-            }
+                std::string_view rest;
+                if (relative_to(root, normalized, rest))
+                    ++matches;
+                else if (relative_to(normalized, root, rest))
+                    nested = true;
+                return false;
+            });
 
-            bool matched = false;
-            for (auto it = mounts_.rbegin(); it != mounts_.rend(); ++it)
+            Result failure = Result::ok;
+            each_layer([&](auto& backend, std::string_view root)
             {
-                std::string relative;
-                if (!detail::relative_to_mount(normalized, it->mount, relative))
-                    continue;
+                std::string_view relative;
+                if (!relative_to(root, normalized, relative))
+                {
+                    if (relative_to(normalized, root, relative))
+                        emit(relative.substr(0, relative.find('/')));
+                    return false;
+                }
+                Result result = (matches == 1 && !nested) || allow_duplicates ?
+                    backend.list_dirs(relative, callback, allow_duplicates) :
+                    backend.list_dirs(relative, emit, true);
+                if (result != Result::io_error)
+                    return false;
+                failure = result;
+                return true;
+            });
+            if (failure != Result::ok)
+                return failure;
+            return matches != 0 || !seen.empty() ? Result::ok : Result::not_found;
+        }
 
-                matched = true;
-                Result result = it->backend->list_dirs(relative, emit, true);
-                if (result == Result::io_error)
-                    return result;
-            }
+        // Recursively lists files below `path` across every layer, newest first, with
+        // names relative to `path`. Layers rooted below it walk from their root with
+        // their root as a prefix, as nested mounts do in Vfs.
+        Result walk(std::string_view path,
+            const std::vector<std::string_view>& extensions,
+            const EnumerateRef& callback,
+            size_t threads = 1) const
+        {
+            detail::PathBuffer buffer;
+            if (!detail::normalize_virtual_path(path, buffer))
+                return Result::invalid_path;
+            std::string_view normalized = buffer.view();
+
+            size_t sources = 0;
+            bool nested = false;
+            each_layer([&](auto&, std::string_view root)
+            {
+                std::string_view rest;
+                if (relative_to(root, normalized, rest))
+                    ++sources;
+                else if (relative_to(normalized, root, rest))
+                {
+                    ++sources;
+                    nested = true;
+                }
+                return false;
+            });
+            if (sources == 0)
+                return Result::not_found;
+
+            std::unordered_set<std::string> seen;
+            std::string prefixed;
+            Result failure = Result::ok;
+            each_layer([&](auto& backend, std::string_view root)
+            {
+                std::string_view relative;
+                std::string_view prefix;
+                if (!relative_to(root, normalized, relative))
+                {
+                    if (!relative_to(normalized, root, prefix))
+                        return false;
+                    relative = std::string_view();
+                }
+
+                Result result = Result::ok;
+                if (sources == 1 && !nested)
+                {
+                    result = backend.walk(relative, extensions, callback, threads);
+                }
+                else
+                {
+                    result = backend.walk(relative, extensions, [&](std::string_view name)
+                    {
+                        std::string_view full = name;
+                        if (!prefix.empty())
+                        {
+                            prefixed.assign(prefix);
+                            prefixed.push_back('/');
+                            prefixed.append(name);
+                            full = prefixed;
+                        }
+
+                        if (seen.insert(std::string(full)).second)
+                            callback(full);
+                    }, threads);
+                }
+                if (result != Result::io_error)
+                    return false;
+                failure = result;
+                return true;
+            });
+            return failure;
+        }
 
-            return (matched || !seen.empty()) ? Result::ok : Result::not_found;
+        Result walk(std::string_view path,
+            std::initializer_list<std::string_view> extensions,
+            const EnumerateRef& callback,
+            size_t threads = 1) const
+        {
+            std::vector<std::string_view> ext_list(extensions);
+            return walk(path, ext_list, callback, threads);
         }
 
     private:
-        struct MountPoint
+        // Backends are mutated through const calls, as Vfs does through its mount table.
+        mutable std::tuple<Layers...> layers_;
+        bool valid_ = true;
+
+        template <size_t... I>
+        bool normalize_roots(std::index_sequence<I...>)
         {
-            std::string mount;
-            std::shared_ptr<Backend> backend;
-        };
+            return (normalize_root(std::get<I>(layers_)) & ... & true);
+        }
+
+        template <typename Layer>
+        static bool normalize_root(Layer& layer)
+        {
+            std::string normalized;
+            if (!detail::normalize_virtual_path(layer.root, normalized))
+                return false;
+            layer.root = std::move(normalized);
+            return detail::static_target(layer.backend) != nullptr;
+        }
+
+        // The part of `path` below `root`, if it lies in the layer at all.
+        static bool relative_to(std::string_view root, std::string_view path, std::string_view& relative) noexcept
+        {
+            if (root.empty())
+            {
+                relative = path;
+                return true;
+            }
+            if (path.size() < root.size() || path.compare(0, root.size(), root) != 0)
+                return false;
+            if (path.size() == root.size())
+            {
+                relative = std::string_view();
+                return true;
+            }
+            if (path[root.size()] != '/')
+                return false;
+            relative = path.substr(root.size() + 1);
+            return true;
+        }
+
+        // Directories containing a layer root exist even if no backend has them.
+        template <size_t... I>
+        bool above_root(std::string_view path, std::index_sequence<I...>) const noexcept
+        {
+            std::string_view relative;
+            return (... || (!std::get<I>(layers_).root.empty() &&
+                relative_to(path, std::get<I>(layers_).root, relative)));
+        }
+
+        size_t count_matches(std::string_view normalized) const
+        {
+            size_t matches = 0;
+            visit(normalized, [&](auto&, std::string_view)
+            {
+                ++matches;
+                return false;
+            });
+            return matches;
+        }
+
+        template <typename Fn>
+        bool probe(std::string_view path, const Fn& fn) const
+        {
+            detail::PathBuffer buffer;
+            if (!detail::normalize_virtual_path(path, buffer))
+                return false;
+            return visit(buffer.view(), fn);
+        }
+
+        // Calls `fn(backend, relative)` on each matching layer, newest first, until it
+        // returns true.
+        template <typename Fn, size_t I = sizeof...(Layers)>
+        bool visit(std::string_view normalized, const Fn& fn) const
+        {
+            if constexpr (I == 0)
+            {
+                (void)normalized;
+                (void)fn;
+                return false;
+            }
+            else
+            {
+                auto& layer = std::get<I - 1>(layers_);
+                auto* backend = detail::static_target(layer.backend);
+                std::string_view relative;
+                if (backend && relative_to(layer.root, normalized, relative) && fn(*backend, relative))
+                    return true;
+                return visit<Fn, I - 1>(normalized, fn);
+            }
+        }
 
-        std::vector<MountPoint> mounts_;
+        // Calls `fn(backend, root)` on each layer with a backend, newest first, until it
+        // returns true.
+        template <typename Fn, size_t I = sizeof...(Layers)>
+        bool each_layer(const Fn& fn) const
+        {
+            if constexpr (I == 0)
+            {
+                (void)fn;
+                return false;
+            }
+            else
+            {
+                auto& layer = std::get<I - 1>(layers_);
+                auto* backend = detail::static_target(layer.backend);
+                if (backend && fn(*backend, std::string_view(layer.root)))
+                    return true;
+                return each_layer<Fn, I - 1>(fn);
+            }
+        }
     };
 }
@@ -0,0 +1,200 @@
+#include "tiny_vfs.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace fs = tinyvfs::fs;
+
+namespace
+{
+    struct Options
+    {
+        fs::path output;
+        std::vector<fs::path> inputs;
+        fs::path trace;
+        std::string strip;
+        size_t alignment = 4096;
+        bool quiet = false;
+    };
+
+    void print_usage()
+    {
+        std::cout <<
+            "usage: tiny_vfs_pack [options] <output.pak> <dir>...\n"
+            "  Packs every file under the given directories; a file in a later directory\n"
+            "  replaces the same path in an earlier one, as with stacked mounts.\n"
+            "  --trace <log>     lay out files in first-access order from a trace log\n"
+            "                    (one virtual path per line, '#' starts a comment)\n"
+            "  --strip <root>    virtual root to remove from trace paths, e.g. assets\n"
+            "  --align <bytes>   start every file on this boundary (default 4096, 1 = tight)\n"
+            "  --quiet           only report errors\n";
+    }
+
+    // Relative pack path to source file, with later inputs overriding earlier ones.
+    bool collect(const std::vector<fs::path>& inputs, std::map<std::string, fs::path>& files)
+    {
+        for (const fs::path& input : inputs)
+        {
+            std::error_code ec;
+            if (!fs::is_directory(input, ec))
+            {
+                std::cerr << "not a directory: " << input.string() << "\n";
+                return false;
+            }
+
+            const auto options = fs::directory_options::skip_permission_denied;
+            for (fs::recursive_directory_iterator it(input, options, ec), end; !ec && it != end; it.increment(ec))
+            {
+                if (!it->is_regular_file(ec))
+                    continue;
+                std::string path;
+                if (tinyvfs::detail::normalize_virtual_path(fs::relative(it->path(), input, ec).generic_string(), path) &&
+                    !path.empty())
+                {
+                    files[path] = it->path();
+                }
+            }
+            if (ec)
+            {
+                std::cerr << "failed to scan " << input.string() << ": " << ec.message() << "\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Paths in the order the trace first touched them, limited to files being packed.
+    bool read_trace(const Options& options, const std::map<std::string, fs::path>& files, std::vector<std::string>& order)
+    {
+        std::ifstream in(options.trace);
+        if (!in)
+        {
+            std::cerr << "cannot open trace " << options.trace.string() << "\n";
+            return false;
+        }
+
+        std::string root;
+        if (!options.strip.empty() && !tinyvfs::detail::normalize_virtual_path(options.strip, root))
+        {
+            std::cerr << "invalid --strip root: " << options.strip << "\n";
+            return false;
+        }
+
+        std::unordered_set<std::string> seen;
+        std::string line;
+        std::string path;
+        while (std::getline(in, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (line.empty() || line.front() == '#' || !tinyvfs::detail::normalize_virtual_path(line, path))
+                continue;
+
+            if (!root.empty())
+            {
+                if (path.size() <= root.size() || path.compare(0, root.size(), root) != 0 || path[root.size()] != '/')
+                    continue;
+                path.erase(0, root.size() + 1);
+            }
+            if (files.count(path) != 0 && seen.insert(path).second)
+                order.push_back(path);
+        }
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view arg = argv[i];
+        if (arg == "--trace" && i + 1 < argc)
+        {
+            options.trace = argv[++i];
+        }
+        else if (arg == "--strip" && i + 1 < argc)
+        {
+            options.strip = argv[++i];
+        }
+        else if (arg == "--align" && i + 1 < argc)
+        {
+            options.alignment = static_cast<size_t>(std::strtoull(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--quiet")
+        {
+            options.quiet = true;
+        }
+        else if (!arg.empty() && arg.front() != '-')
+        {
+            if (options.output.empty())
+                options.output = argv[i];
+            else
+                options.inputs.emplace_back(argv[i]);
+        }
+        else
+        {
+            print_usage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    if (options.output.empty() || options.inputs.empty())
+    {
+        print_usage();
+        return 1;
+    }
+
+    tinyvfs::PackWriter writer;
+    if (!writer.set_alignment(options.alignment))
+    {
+        std::cerr << "--align must be a power of two\n";
+        return 1;
+    }
+
+    std::map<std::string, fs::path> files;
+    if (!collect(options.inputs, files))
+        return 1;
+
+    // Traced files first, as the game touched them; the rest follow in path order,
+    // which keeps each directory together.
+    std::vector<std::string> order;
+    if (!options.trace.empty() && !read_trace(options, files, order))
+        return 1;
+    const size_t traced = order.size();
+    std::unordered_set<std::string> placed(order.begin(), order.end());
+    for (const auto& file : files)
+    {
+        if (placed.count(file.first) == 0)
+            order.push_back(file.first);
+    }
+
+    for (const std::string& path : order)
+    {
+        if (!writer.add_file(path, files[path]))
+        {
+            std::cerr << "cannot add " << path << "\n";
+            return 1;
+        }
+    }
+
+    if (writer.write(options.output) != tinyvfs::Result::ok)
+    {
+        std::cerr << "failed to write " << options.output.string() << "\n";
+        return 1;
+    }
+
+    if (!options.quiet)
+    {
+        std::error_code ec;
+        std::cout << "packed " << order.size() << " files (" << traced << " in trace order) into "
+                  << options.output.string() << ", " << fs::file_size(options.output, ec) << " bytes\n";
+    }
+    return 0;
+}